@@ -156,10 +156,13 @@ sub to_type_name ( $ $ ; \% ) {
 
   if ($p->{use_type}) 
   {
-    $str .= "const " if $t->{const};
+    $str .= "const " if $t->{const} && !($name eq 'string' && $t->{pointer});
 
     if ($name eq 'string') {
-      if ($is_native && $pos eq 'parm') {
+      if ($t->{pointer}) {
+	$str .= "const char *";
+	$str .= " const" if $t->{const};
+      } elsif ($is_native && $pos eq 'parm') {
 	$accum->{headers}{'parm string'} = true;
 	$str .= "ParmString";
       } else {
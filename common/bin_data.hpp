@@ -0,0 +1,83 @@
+// This file is part of The New Aspell and is distributed under the
+// GNU LGPL license version 2.0 or 2.1.  You should have received a copy
+// of the LGPL license along with this library if you did not you can
+// find it at http://www.gnu.org/.
+
+#ifndef ACOMMON_BIN_DATA__HPP
+#define ACOMMON_BIN_DATA__HPP
+
+#include <string.h>
+
+#include "parm_string.hpp"
+#include "string.hpp"
+
+namespace acommon {
+
+  // Writes and reads the simple binary format used for precompiled
+  // data, such as language bundles and the filter mode index.  It is
+  // simply a sequence of 32 bit integers, in native byte order, raw
+  // bytes and length prefixed null terminated strings.  Since it
+  // contains no pointers or offsets it can be mapped at any address.
+
+  class BinDataOut {
+    String data_;
+  public:
+    void put(unsigned int v) {data_.append(&v, sizeof(v));}
+    void put(const void * d, unsigned int size) {data_.append(d, size);}
+    void put_str(ParmString s) {
+      put(s.size());
+      data_.append(s.str(), s.size() + 1);
+    }
+    const String & data() const {return data_;}
+  };
+
+  // Reading past the end of the data or reading an invalid string
+  // does not crash, instead zeros or empty strings are returned and
+  // the reader is marked as bad, so it is enough to check bad() once
+  // everything is read.
+  class BinDataIn {
+    const char * pos_;
+    const char * end_;
+    bool bad_;
+  public:
+    BinDataIn(const char * b, const char * e)
+      : pos_(b), end_(e), bad_(false) {}
+    bool bad() const {return bad_;}
+    void set_bad() {bad_ = true;}
+    void get(void * d, unsigned int size) {
+      if (bad_ || (unsigned int)(end_ - pos_) < size) {
+        bad_ = true;
+        memset(d, 0, size);
+        return;
+      }
+      memcpy(d, pos_, size);
+      pos_ += size;
+    }
+    unsigned int get() {unsigned int v; get(&v, sizeof(v)); return v;}
+    // get the number of items that follow, "min_size" is the minimum
+    // size of each item and is used to reject nonsense counts
+    unsigned int get_count(unsigned int min_size) {
+      unsigned int n = get();
+      if ((unsigned int)(end_ - pos_) / min_size < n) {bad_ = true; n = 0;}
+      return n;
+    }
+    // the returned string points into the data
+    const char * get_str(unsigned int * size = 0) {
+      unsigned int n = get();
+      if (bad_ || (unsigned int)(end_ - pos_) <= n || pos_[n] != '\0') {
+        bad_ = true;
+        n = 0;
+        if (size) *size = 0;
+        return "";
+      }
+      const char * s = pos_;
+      pos_ += n + 1;
+      if (size) *size = n;
+      return s;
+    }
+    bool at_end() const {return pos_ == end_;}
+  };
+
+}
+
+#endif
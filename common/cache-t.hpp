@@ -3,11 +3,31 @@
 
 #include "lock.hpp"
 #include "cache.hpp"
+#include "hash_fun.hpp"
+#include "parm_string.hpp"
+#include "string.hpp"
+#include "vector.hpp"
 
 //#include "iostream.hpp"
 
 namespace acommon {
 
+// Data::CacheKey's other than strings need to provide an overload of
+// this function
+static inline unsigned long cache_key_hash(ParmString key)
+{
+  return hash<const char *>()(key);
+}
+
+//
+// Objects are found with a fixed size hash table which can be
+// searched without holding the lock.  Readers announce themselves by
+// incrementing one of two counters, selected by the current epoch,
+// and an object is only deleted after it is removed from the table
+// and synchronize() has waited for all readers which might still see
+// it.
+//
+
 class GlobalCacheBase
 {
 public:
@@ -19,15 +39,40 @@ public: // but don't use
   // The global cache lock must exist while any cache instance is active
   static Mutex global_cache_lock;
 protected:
+  static const unsigned int num_buckets = 64;
   Cacheable * first;
+  Cacheable * buckets[num_buckets];
+  unsigned int epoch;
+  int readers[2];
+  class ReadLock {
+    GlobalCacheBase * cache;
+    unsigned int idx;
+  public:
+    ReadLock(GlobalCacheBase * c) : cache(c), idx(atomic_load(c->epoch) & 1) {
+      atomic_add(cache->readers[idx], 1);
+    }
+    ~ReadLock() {atomic_add(cache->readers[idx], -1);}
+  };
+  Cacheable * bucket(unsigned long h) {return atomic_load(buckets[h % num_buckets]);}
+  // "del" removes an object from the cache, it may not be deleted
+  // until "synchronize" is called
   void del(Cacheable * d);
-  void add(Cacheable * n);
+  void synchronize();
+  void add(Cacheable * n, unsigned long hash);
+  // gets a reference to a found object, returns false if the
+  // refcount is zero and it can not be used again
+  bool take(Cacheable * d);
   GlobalCacheBase(const char * n);
   ~GlobalCacheBase();
 public:
   void release(Cacheable * d);
   void detach(Cacheable * d);
-  void detach_all();
+  // if "free_unused" is true objects which are not in use are also
+  // deleted
+  void detach_all(bool free_unused = true);
+  void pin(Cacheable * d, bool);
+  void list_contents(Vector<String> &);
+  friend void trim_retained();
 };
 
 template <class D>
@@ -38,14 +83,28 @@ public:
   typedef typename Data::CacheKey Key;
 public:
   GlobalCache(const char * n) : GlobalCacheBase(n) {}
-  // "find" and "add" will _not_ acquire a lock
+  // "lookup" returns an object which is in use, with its refcount
+  // incremented, without acquiring a lock.  "find" also returns
+  // objects which are no longer in use but are retained, however the
+  // lock must be held, as it must for "add".
+  Data * lookup(const Key & key) {
+    unsigned long h = cache_key_hash(key);
+    ReadLock rl(this);
+    for (Cacheable * p = bucket(h); p; p = atomic_load(p->hash_next)) {
+      if (p->hash == h && static_cast<D *>(p)->cache_key_eq(key) && p->try_copy())
+        return static_cast<D *>(p);
+    }
+    return 0;
+  }
   Data * find(const Key & key) {
-    D * cur = static_cast<D *>(first);
-    while (cur && !cur->cache_key_eq(key))
-      cur = static_cast<D *>(cur->next);
-    return cur;
+    unsigned long h = cache_key_hash(key);
+    for (Cacheable * p = bucket(h); p; p = p->hash_next) {
+      if (p->hash == h && static_cast<D *>(p)->cache_key_eq(key) && take(p))
+        return static_cast<D *>(p);
+    }
+    return 0;
   }
-  void add(Data * n) {GlobalCacheBase::add(n);}
+  void add(Data * n, const Key & key) {GlobalCacheBase::add(n, cache_key_hash(key));}
   // "release" and "detach" _will_ acquire a lock
   void release(Data * d) {GlobalCacheBase::release(d);}
   void detach(Data * d) {GlobalCacheBase::detach(d);}
@@ -56,20 +115,19 @@ PosibErr<Data *> get_cache_data(GlobalCache<Data> * cache,
                                 typename Data::CacheConfig * config, 
                                 const typename Data::CacheKey & key)
 {
+  Data * n = cache->lookup(key);
+  if (n) return n;
   LOCK(&cache->lock);
-  Data * n = cache->find(key);
+  n = cache->find(key);
   //CERR << "Getting " << key << " for " << cache->name << "\n";
-  if (n) {
-    n->refcount++;
-    return n;
-  }
+  if (n) return n;
   PosibErr<Data *> res = Data::get_new(key, config);
   if (res.has_err()) {
     //CERR << "ERROR\n"; 
     return res;
   }
   n = res.data;
-  cache->add(n);
+  cache->add(n, key);
   //CERR << "LOADED FROM DISK\n";
   return n;
 }
@@ -80,20 +138,19 @@ PosibErr<Data *> get_cache_data(GlobalCache<Data> * cache,
                                 typename Data::CacheConfig2 * config2,
                                 const typename Data::CacheKey & key)
 {
+  Data * n = cache->lookup(key);
+  if (n) return n;
   LOCK(&cache->lock);
-  Data * n = cache->find(key);
+  n = cache->find(key);
   //CERR << "Getting " << key << "\n";
-  if (n) {
-    n->refcount++;
-    return n;
-  }
+  if (n) return n;
   PosibErr<Data *> res = Data::get_new(key, config, config2);
   if (res.has_err()) {
     //CERR << "ERROR\n"; 
     return res;
   }
   n = res.data;
-  cache->add(n);
+  cache->add(n, key);
   //CERR << "LOADED FROM DISK\n";
   return n;
 }
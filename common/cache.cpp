@@ -2,17 +2,94 @@
 
 #include "stack_ptr.hpp"
 #include "cache-t.hpp"
+#include "string_pair_enumeration.hpp"
 
 namespace acommon {
 
 static GlobalCacheBase * first_cache = 0;
 Mutex GlobalCacheBase::global_cache_lock;
 
-void Cacheable::copy() const
+//
+// Objects which are no longer used but are kept around are on a
+// single list, shared by all caches, with the most recently released
+// object first.  The retain lock protects the list and the retention
+// settings; when both are needed a cache's lock must be acquired
+// first.
+//
+
+static Mutex retain_lock;
+static Cacheable * lru_first = 0;
+static Cacheable * lru_last = 0;
+static size_t retained_total = 0;
+static size_t max_retained_size = 0;
+static unsigned int max_retained_idle = 0;
+
+static void lru_push(Cacheable * d)
+{
+  d->lru_prev = 0;
+  d->lru_next = lru_first;
+  if (lru_first) lru_first->lru_prev = d;
+  else lru_last = d;
+  lru_first = d;
+  d->retained = true;
+  retained_total += d->retained_size;
+}
+
+static void lru_remove(Cacheable * d)
+{
+  if (d->lru_prev) d->lru_prev->lru_next = d->lru_next;
+  else lru_first = d->lru_next;
+  if (d->lru_next) d->lru_next->lru_prev = d->lru_prev;
+  else lru_last = d->lru_prev;
+  d->lru_next = d->lru_prev = 0;
+  d->retained = false;
+  retained_total -= d->retained_size;
+}
+
+// removes unused objects until the retention limits are met, must be
+// called without any locks held
+void trim_retained()
 {
-  //CERR << "COPY\n";
-  LOCK(&cache->lock);
-  copy_no_lock();
+  for (;;) {
+    Cacheable * d;
+    {
+      LOCK(&retain_lock);
+      d = lru_last;
+      if (!d) return;
+      if (retained_total <= max_retained_size
+          && (max_retained_idle == 0 
+              || time(0) - d->released < (time_t)max_retained_idle))
+        return;
+      lru_remove(d);
+      d->evicting = true;
+    }
+    {
+      // the object may have been found in the mean time but since it
+      // is marked as evicting it will not be reused
+      GlobalCacheBase * c = d->cache;
+      LOCK(&c->lock);
+      if (d->attached()) {
+        c->del(d);
+        c->synchronize();
+      }
+    }
+    delete d;
+  }
+}
+
+void set_cache_retention(size_t max_size, unsigned int max_idle)
+{
+  {
+    LOCK(&retain_lock);
+    max_retained_size = max_size;
+    max_retained_idle = max_idle;
+  }
+  trim_retained();
+}
+
+void Cacheable::pin(bool p) const
+{
+  if (cache) cache->pin(const_cast<Cacheable *>(this), p);
 }
 
 void GlobalCacheBase::del(Cacheable * n)
@@ -21,9 +98,33 @@ void GlobalCacheBase::del(Cacheable * n)
   if (n->next) n->next->prev = n->prev;
   n->next = 0;
   n->prev = 0;
+  // n->hash_next is left alone as a reader may still be at n
+  Cacheable * * p = &buckets[n->hash % num_buckets];
+  while (*p != n) p = &(*p)->hash_next;
+  atomic_store(*p, n->hash_next);
+}
+
+static inline void wait_for_readers(const int & count)
+{
+  while (atomic_load(count) != 0)
+    thread_yield();
 }
 
-void GlobalCacheBase::add(Cacheable * n) 
+void GlobalCacheBase::synchronize()
+{
+  // the removal of the objects must be visible before the readers are
+  // checked
+  atomic_fence();
+  unsigned int e = epoch;
+  // a reader may have read the epoch before the last time it was
+  // changed, so first wait for any readers using the old counter
+  wait_for_readers(readers[e ^ 1]);
+  atomic_store(epoch, e ^ 1);
+  atomic_fence();
+  wait_for_readers(readers[e]);
+}
+
+void GlobalCacheBase::add(Cacheable * n, unsigned long hash) 
 {
   assert(n->refcount > 0);
   n->next = first;
@@ -31,45 +132,121 @@ void GlobalCacheBase::add(Cacheable * n)
   if (first) first->prev = &n->next;
   first = n;
   n->cache = this;
+  n->hash = hash;
+  Cacheable * & b = buckets[hash % num_buckets];
+  n->hash_next = b;
+  atomic_store(b, n);
+}
+
+bool GlobalCacheBase::take(Cacheable * d)
+{
+  if (d->try_copy()) return true;
+  LOCK(&retain_lock);
+  if (!d->unused || d->evicting) return false;
+  if (d->retained) lru_remove(d);
+  d->unused = false;
+  atomic_store(d->refcount, 1);
+  return true;
 }
 
 void GlobalCacheBase::release(Cacheable * d) 
 {
   //CERR << "RELEASE\n";
-  LOCK(&lock);
-  d->refcount--;
-  assert(d->refcount >= 0);
-  if (d->refcount != 0) return;
-  //CERR << "DEL\n";
-  if (d->attached()) del(d);
-  delete d;
+  int r = atomic_add(d->refcount, -1);
+  assert(r >= 0);
+  if (r != 0) return;
+  // Once the refcount drops to zero nothing else can get a reference
+  // to the object until it is marked as unused.
+  bool retained = false;
+  {
+    LOCK(&lock);
+    if (d->attached()) {
+      if (d->pinned) {
+        d->unused = true;
+        return;
+      }
+      size_t size = d->memory_used();
+      {
+        LOCK(&retain_lock);
+        if (max_retained_size > 0) {
+          d->unused = true;
+          d->retained_size = size;
+          d->released = time(0);
+          lru_push(d);
+          retained = true;
+        }
+      }
+      if (!retained) {
+        del(d);
+        synchronize();
+      }
+    }
+  }
+  // The object is deleted without holding the lock as its destructor
+  // may release other objects from the same cache.
+  if (retained) trim_retained();
+  else delete d;
 }
 
 void GlobalCacheBase::detach(Cacheable * d)
 {
   LOCK(&lock);
-  if (d->attached()) del(d);
+  if (d->attached()) {
+    del(d);
+    synchronize();
+  }
 }
 
-void GlobalCacheBase::detach_all()
+void GlobalCacheBase::detach_all(bool free_unused)
 {
-  LOCK(&lock);
-  Cacheable * p = first;
-  while (p) {
-    *p->prev = 0;
-    p->prev = 0;
-    p = p->next;
+  Cacheable * unused = 0;
+  {
+    LOCK(&lock);
+    {
+      LOCK(&retain_lock);
+      Cacheable * p = first;
+      while (p) {
+        Cacheable * n = p->next;
+        *p->prev = 0;
+        p->prev = 0;
+        p->pinned = false;
+        if (p->unused && !p->evicting) {
+          // not in use so nothing else will delete it
+          if (p->retained) lru_remove(p);
+          if (free_unused) {p->next = unused; unused = p;}
+        }
+        p = n;
+      }
+      first = 0;
+    }
+    for (unsigned int i = 0; i != num_buckets; ++i)
+      atomic_store(buckets[i], (Cacheable *)0);
+    synchronize();
+  }
+  while (unused) {
+    Cacheable * n = unused->next;
+    delete unused;
+    unused = n;
   }
 }
 
+void GlobalCacheBase::pin(Cacheable * d, bool p)
+{
+  LOCK(&lock);
+  if (d->attached()) d->pinned = p;
+}
+
 void release_cache_data(GlobalCacheBase * cache, const Cacheable * d)
 {
   cache->release(const_cast<Cacheable *>(d));
 }
 
 GlobalCacheBase::GlobalCacheBase(const char * n)
-  : name (n)
+  : name (n), first(0), epoch(0)
 {
+  for (unsigned int i = 0; i != num_buckets; ++i)
+    buckets[i] = 0;
+  readers[0] = readers[1] = 0;
   LOCK(&global_cache_lock);
   next = first_cache;
   prev = &first_cache;
@@ -79,7 +256,9 @@ GlobalCacheBase::GlobalCacheBase(const char * n)
 
 GlobalCacheBase::~GlobalCacheBase()
 {
-  detach_all();
+  // Unused objects are not deleted here since the caches of any
+  // objects they refer to may already be gone.
+  detach_all(false);
   LOCK(&global_cache_lock);
   *prev = next;
   if (next) next->prev = prev;
@@ -91,7 +270,7 @@ bool reset_cache(const char * which)
   bool any = false;
   for (GlobalCacheBase * i = first_cache; i; i = i->next)
   {
-    if (which && strcmp(i->name, which) == 0) {i->detach_all(); any = true;}
+    if (!which || strcmp(i->name, which) == 0) {i->detach_all(); any = true;}
   }
   return any;
 }
@@ -102,6 +281,67 @@ int aspell_reset_cache(const char * which)
   return reset_cache(which);
 }
 
+extern "C"
+void aspell_set_cache_retention(unsigned long max_size, unsigned int max_idle)
+{
+  set_cache_retention(max_size, max_idle);
+}
+
+void GlobalCacheBase::list_contents(Vector<String> & res)
+{
+  LOCK(&lock);
+  for (Cacheable * p = first; p; p = p->next) {
+    bool used = atomic_load(p->refcount) > 0;
+    if (!used && (!p->unused || p->evicting)) continue;
+    String key = name;
+    const char * desc = p->cache_desc();
+    if (*desc) {key += ' '; key += desc;}
+    String val;
+    val.printf("%lu %s", (unsigned long)p->memory_used(),
+               used ? "used" : p->pinned ? "pinned" : "retained");
+    res.push_back(key);
+    res.push_back(val);
+  }
+}
+
+class CacheContentsEnumeration : public StringPairEnumeration
+{
+  Vector<String> data_; // key, value, key, value, ...
+  unsigned int pos_;
+public:
+  CacheContentsEnumeration() : pos_(0) {}
+  Vector<String> & data() {return data_;}
+  bool at_end() const {return pos_ >= data_.size();}
+  StringPair next()
+  {
+    if (at_end()) return StringPair();
+    StringPair res(data_[pos_].str(), data_[pos_ + 1].str());
+    pos_ += 2;
+    return res;
+  }
+  StringPairEnumeration * clone() const {return new CacheContentsEnumeration(*this);}
+  void assign(const StringPairEnumeration * other)
+  {
+    *this = *static_cast<const CacheContentsEnumeration *>(other);
+  }
+};
+
+StringPairEnumeration * cache_contents()
+{
+  trim_retained();
+  CacheContentsEnumeration * res = new CacheContentsEnumeration;
+  LOCK(&GlobalCacheBase::global_cache_lock);
+  for (GlobalCacheBase * i = first_cache; i; i = i->next)
+    i->list_contents(res->data());
+  return res;
+}
+
+extern "C"
+StringPairEnumeration * aspell_cache_contents()
+{
+  return cache_contents();
+}
+
 #if 0
 
 struct CacheableImpl : public Cacheable
@@ -1,15 +1,21 @@
 #ifndef ACOMMON_CACHE__HPP
 #define ACOMMON_CACHE__HPP
 
+#include <stddef.h>
+#include <time.h>
+
+#include "lock.hpp"
 #include "posib_err.hpp"
 
 namespace acommon {
 
 class GlobalCacheBase;
+class StringPairEnumeration;
 template <class Data> class GlobalCache;
 
-// get_cache_data (both versions) and release_cache_data will acquires
-// the cache's lock
+// get_cache_data (both versions) only acquires the cache's lock if
+// the object is not already in use, release_cache_data only if the
+// object is no longer used
 
 template <class Data>
 PosibErr<Data *> get_cache_data(GlobalCache<Data> *, 
@@ -33,17 +39,60 @@ class Cacheable
 public: // but don't use
   Cacheable * next;
   Cacheable * * prev;
-  mutable int refcount;
+  mutable int refcount; // only changed atomically
   GlobalCacheBase * cache;
+  // for the cache's hash table
+  Cacheable * hash_next;
+  unsigned long hash;
+  // used once the refcount drops to zero and the object is kept
+  // around (see set_cache_retention) or is pinned
+  Cacheable * lru_next;
+  Cacheable * lru_prev;
+  time_t released;
+  size_t retained_size;
+  bool unused;   // kept in the cache even though the refcount is zero
+  bool retained; // on the list of unused objects
+  bool evicting; // being removed from the cache, don't reuse
+  mutable bool pinned;
 public:
   bool attached() {return prev;}
-  void copy_no_lock() const {refcount++;}
-  void copy() const; // Acquires cache->lock
-  void release() const {release_cache_data(cache,this);} // Acquires cache->lock
-  Cacheable(GlobalCacheBase * c = 0) : next(0), prev(0), refcount(1), cache(c) {}
+  // "copy" may only be used when a reference to the object is
+  // already held
+  void copy_no_lock() const {copy();}
+  void copy() const;
+  // increments the refcount unless it is zero
+  bool try_copy() const;
+  void release() const {release_cache_data(cache,this);} // May acquire cache->lock
+  // a pinned object stays in the cache when no longer used until
+  // the cache is reset
+  void pin(bool) const; // Acquires cache->lock
+  // an estimate of the memory used by the object in bytes or 0 if
+  // not known
+  virtual size_t memory_used() const {return 0;}
+  // a short description of the object, such as the file it was
+  // loaded from, used by cache_contents
+  virtual const char * cache_desc() const {return "";}
+  Cacheable(GlobalCacheBase * c = 0) 
+    : next(0), prev(0), refcount(1), cache(c), hash_next(0), hash(0),
+      lru_next(0), lru_prev(0), released(0), retained_size(0), 
+      unused(false), retained(false), evicting(false), pinned(false) {}
   virtual ~Cacheable() {}
 };
 
+inline void Cacheable::copy() const
+{
+  atomic_add(refcount, 1);
+}
+
+inline bool Cacheable::try_copy() const
+{
+  int r = atomic_load(refcount);
+  while (r > 0) {
+    if (atomic_cas(refcount, r, r + 1)) return true;
+  }
+  return false;
+}
+
 template <class Data>
 class CachePtr
 {
@@ -81,6 +130,20 @@ PosibErr<void> setup(CachePtr<Data> & res,
 
 bool reset_cache(const char * = 0);
 
+// Normally an object is deleted as soon as it is no longer used.
+// With retention enabled, unused objects are kept, so that they can
+// be reused, until either the total size of them exceeds "max_size"
+// bytes or they have not been used for "max_idle" seconds; the least
+// recently used object is removed first.  A "max_size" of 0 disables
+// retention and a "max_idle" of 0 means there is no time limit.
+void set_cache_retention(size_t max_size, unsigned int max_idle);
+
+// returns a list of all the objects in the global caches, the first
+// string is the cache name and a description of the object, the
+// second the estimated memory used followed by "used", "retained" or
+// "pinned"
+StringPairEnumeration * cache_contents();
+
 }
 
 #endif
@@ -29,6 +29,7 @@
 #include "file_util.hpp"
 #include "fstream.hpp"
 #include "getdata.hpp"
+#include "hash-t.hpp"
 #include "itemize.hpp"
 #include "mutable_container.hpp"
 #include "posib_err.hpp"
@@ -42,6 +43,7 @@
 #include "gettext.h"
 
 #include "iostream.hpp"
+#include "lock.hpp"
 
 #define DEFAULT_LANG "en_US"
 
@@ -76,6 +78,131 @@ namespace acommon {
 
   const int Config::num_parms_[9] = {1, 1, 0, 0, 0,
                                      1, 1, 1, 0};
+
+  //
+  // Key and entry indexes
+  //
+  // Speller setup retrieves the same keys over and over so keyinfo
+  // and lookup use hash tables rather than searching the key tables
+  // and the entries.  The main and extra key tables are static so
+  // each is indexed once for the whole process.  The keys of the
+  // filter modules are indexed per Config, the first time one is
+  // looked up, and as the modules are normally the same for a Config
+  // and its copies the copies share the index.  Filter modules loaded
+  // later are added to it as they are found, making a private copy
+  // first if it is shared.  The entry index maps each key to the
+  // entries for it.  The per Config indexes are built by const
+  // methods, so this is done while holding "index_lock_"; they are
+  // only invalidated by methods which change the Config.  (Filter
+  // modules loaded by keyinfo still change a const Config.)
+  //
+
+  struct StrEqual {
+    bool operator() (const char * x, const char * y) const 
+      {return strcmp(x, y) == 0;}
+  };
+
+  class KeyInfoIndex 
+    : public hash_map<const char *, const KeyInfo *, 
+                      hash<const char *>, StrEqual>
+  {
+  public:
+    const KeyInfo * find(const char * key) const {
+      const_iterator i = hash_map<const char *, const KeyInfo *, 
+                                  hash<const char *>, StrEqual>::find(key);
+      return i == end() ? 0 : i->second;
+    }
+    // keys which are already indexed are skipped as keyinfo returns
+    // the first one
+    void add(const KeyInfo * i, const KeyInfo * end) {
+      for (; i != end; ++i)
+        insert(value_type(i->name, i));
+    }
+    void add(const ConfigModule & m);
+  };
+
+  // Only the keys which keyinfo would look for in "m" are added, that
+  // is those named "[f-]<module name>-<option>".
+  void KeyInfoIndex::add(const ConfigModule & m)
+  {
+    unsigned len = strlen(m.name);
+    for (const KeyInfo * i = m.begin; i != m.end; ++i) {
+      const char * s = strncmp(i->name, "f-", 2) == 0 ? i->name + 2 : i->name;
+      const char * h = strchr(s, '-');
+      if (h && (unsigned)(h - s) == len && memcmp(s, m.name, len) == 0)
+        insert(value_type(i->name, i));
+    }
+  }
+
+  struct TableIndex : public KeyInfoIndex {
+    const KeyInfo * begin;
+    const KeyInfo * end;
+    TableIndex * next;
+  };
+
+  static TableIndex * table_indexes = 0;
+  static Mutex table_indexes_lock;
+
+  // Indexes are never removed from the list so it can be searched
+  // without taking the lock.
+  static const KeyInfoIndex * table_index(const KeyInfo * begin, 
+                                          const KeyInfo * end)
+  {
+    if (begin == end) return 0;
+    for (TableIndex * i = atomic_load(table_indexes); i; i = i->next)
+      if (i->begin == begin && i->end == end) return i;
+    LOCK(&table_indexes_lock);
+    for (TableIndex * i = table_indexes; i; i = i->next)
+      if (i->begin == begin && i->end == end) return i;
+    TableIndex * index = new TableIndex;
+    index->begin = begin;
+    index->end   = end;
+    index->add(begin, end);
+    index->next = table_indexes;
+    atomic_store(table_indexes, index);
+    return index;
+  }
+
+  class ModuleIndex : public KeyInfoIndex {
+  public:
+    int refcount; // only changed atomically
+    unsigned num_modules; // the number of filter modules indexed
+    ModuleIndex() : refcount(1), num_modules(0) {}
+    ModuleIndex(const ModuleIndex & other) 
+      : KeyInfoIndex(other), refcount(1), num_modules(other.num_modules) {}
+  };
+
+  // the entries (other than NoOp ones) for each key in the order
+  // they appear in the entry list
+  class EntryIndex 
+    : public hash_map<const char *, Vector<const Config::Entry *>, 
+                      hash<const char *>, StrEqual>
+  {};
+
+  // must be called while holding "index_lock_"
+  const KeyInfoIndex * Config::module_index() const
+  {
+    if (!module_index_) {
+      module_index_ = new ModuleIndex;
+    } else if (module_index_->num_modules == filter_modules.size()) {
+      return module_index_;
+    } else if (atomic_load(module_index_->refcount) != 1) {
+      ModuleIndex * copy = new ModuleIndex(*module_index_);
+      const_cast<Config *>(this)->release_module_index();
+      module_index_ = copy;
+    }
+    for (; module_index_->num_modules < filter_modules.size(); 
+         ++module_index_->num_modules)
+      module_index_->add(filter_modules[module_index_->num_modules]);
+    return module_index_;
+  }
+
+  void Config::release_module_index()
+  {
+    if (module_index_ && atomic_add(module_index_->refcount, -1) == 0)
+      delete module_index_;
+    module_index_ = 0;
+  }
   
   typedef Notifier * NotifierPtr;
   
@@ -84,6 +211,7 @@ namespace acommon {
 		 const KeyInfo * mainend)
     : name_(name)
     , first_(0), insert_point_(&first_), others_(0)
+    , module_index_(0), entry_index_(0), entry_index_valid_(false)
     , committed_(true), attached_(false)
     , md_info_list_index(-1)
     , settings_read_in_(false)
@@ -94,6 +222,8 @@ namespace acommon {
     keyinfo_end   = mainend;
     extra_begin = 0;
     extra_end   = 0;
+    main_index_  = table_index(keyinfo_begin, keyinfo_end);
+    extra_index_ = 0;
   }
 
   Config::~Config() {
@@ -101,6 +231,8 @@ namespace acommon {
   }
 
   Config::Config(const Config & other) 
+    : CanHaveError(), module_index_(0), entry_index_(0), 
+      entry_index_valid_(false)
   {
     copy(other);
   }
@@ -135,8 +267,16 @@ namespace acommon {
     keyinfo_end   = other.keyinfo_end;
     extra_begin   = other.extra_begin;
     extra_end     = other.extra_end;
+    main_index_   = other.main_index_;
+    extra_index_  = other.extra_index_;
     filter_modules = other.filter_modules;
 
+    {
+      LOCK(&other.index_lock_);
+      module_index_ = other.module_index_;
+      if (module_index_) atomic_add(module_index_->refcount, 1);
+    }
+
 #ifdef HAVE_LIBDL
     filter_modules_ptrs = other.filter_modules_ptrs;
     for (Vector<Cacheable *>::iterator i = filter_modules_ptrs.begin();
@@ -174,6 +314,11 @@ namespace acommon {
 
   void Config::del()
   {
+    release_module_index();
+    delete entry_index_;
+    entry_index_ = 0;
+    entry_index_valid_ = false;
+
     while (first_) {
       Entry * tmp = first_->next;
       delete first_;
@@ -212,6 +357,7 @@ namespace acommon {
     assert(filter_modules_ptrs.empty());
     filter_modules.clear();
     filter_modules.assign(modbegin, modend);
+    release_module_index();
   }
 
   void Config::set_extra(const KeyInfo * begin, 
@@ -219,6 +365,7 @@ namespace acommon {
   {
     extra_begin = begin;
     extra_end   = end;
+    extra_index_ = table_index(extra_begin, extra_end);
   }
 
   //
@@ -302,18 +449,41 @@ namespace acommon {
   // retrieve methods
   //
 
-  const Config::Entry * Config::lookup(const char * key) const
+  void Config::entry_added(const Entry * entry)
   {
-    const Entry * res = 0;
-    const Entry * cur = first_;
+    if (!entry_index_valid_) return;
+    if (entry->next) // not the last entry
+      entries_changed();
+    else if (entry->action != NoOp)
+      (*entry_index_)[entry->key.str()].push_back(entry);
+  }
 
-    while (cur) {
-      if (cur->key == key && cur->action != NoOp)  res = cur;
-      cur = cur->next;
+  const Vector<const Config::Entry *> * 
+  Config::entries_for(const char * key) const
+  {
+    if (!atomic_load(entry_index_valid_)) {
+      LOCK(&index_lock_);
+      if (!entry_index_valid_) {
+        if (!entry_index_) entry_index_ = new EntryIndex;
+        entry_index_->clear();
+        for (const Entry * cur = first_; cur; cur = cur->next) {
+          if (cur->action != NoOp) 
+            (*entry_index_)[cur->key.str()].push_back(cur);
+        }
+        atomic_store(entry_index_valid_, true);
+      }
     }
 
-    if (!res || res->action == Reset) return 0;
-    return res;
+    EntryIndex::const_iterator i = entry_index_->find(key);
+    if (i == entry_index_->end()) return 0;
+    return &i->second;
+  }
+
+  const Config::Entry * Config::lookup(const char * key) const
+  {
+    const Vector<const Entry *> * entries = entries_for(key);
+    if (!entries || entries->back()->action == Reset) return 0;
+    return entries->back();
   }
 
   bool Config::have(ParmStr key) const 
@@ -387,19 +557,21 @@ namespace acommon {
                            MutableContainer & m,
                            bool include_default) const
   {
-    const Entry * cur = first_;
-    const Entry * first_to_use = 0;
-
-    while (cur) {
-      if (cur->key == ki->name && 
-          (first_to_use == 0 || 
-           cur->action == Reset || cur->action == Set 
-           || cur->action == ListClear)) 
-        first_to_use = cur;
-      cur = cur->next;
+    // only the entries for this key matter, and only from the last
+    // Reset, Set or ListClear on
+    const Vector<const Entry *> * entries = entries_for(ki->name);
+    Vector<const Entry *>::const_iterator i, end;
+    if (entries) {
+      i = entries->end();
+      end = entries->end();
+      while (i != entries->begin()) {
+        --i;
+        if ((*i)->action == Reset || (*i)->action == Set 
+            || (*i)->action == ListClear) break;
+      }
     }
 
-    cur = first_to_use;
+    const Entry * cur = entries ? *i : 0;
 
     if (include_default && 
         (!cur || 
@@ -409,29 +581,23 @@ namespace acommon {
       separate_list(def, m, true);
     }
 
-    if (cur && cur->action == Reset) {
-      cur = cur->next;
-    }
+    if (!cur) return;
 
-    if (cur && cur->action == Set) {
+    if (cur->action == Set) {
       if (!include_default) m.clear();
       m.add(cur->value);
-      cur = cur->next;
-    }
-
-    if (cur && cur->action == ListClear) {
+    } else if (cur->action == ListClear) {
       if (!include_default) m.clear();
-      cur = cur->next;
     }
+    if (cur->action == Reset || cur->action == Set 
+        || cur->action == ListClear)
+      ++i;
 
-    while (cur) {
-      if (cur->key == ki->name) {
-        if (cur->action == ListAdd)
-          m.add(cur->value);
-        else if (cur->action == ListRemove)
-          m.remove(cur->value);
-      }
-      cur = cur->next;
+    for (; i != end; ++i) {
+      if ((*i)->action == ListAdd)
+        m.add((*i)->value);
+      else if ((*i)->action == ListRemove)
+        m.remove((*i)->value);
     }
   }
 
@@ -446,69 +612,53 @@ namespace acommon {
     return no_err;
   }
 
-  static const KeyInfo * find(ParmStr key, 
-			      const KeyInfo * i, 
-			      const KeyInfo * end) 
+  // returns the filter option named "key" or, if "key" does not have
+  // the "f-" prefix, the one named "f-<key>"
+  static const KeyInfo * find_option(const KeyInfoIndex * index, ParmStr key)
   {
-    while (i != end) {
-      if (strcmp(key, i->name) == 0)
-	return i;
-      ++i;
-    }
-    return i;
+    const KeyInfo * i = index->find(key);
+    if (i || strncmp(key, "f-", 2) == 0) return i;
+    VARARRAY(char, k, key.size() + 3);
+    memcpy(k, "f-", 2);
+    memcpy(k + 2, key, key.size() + 1);
+    return index->find(k);
   }
 
-  static const ConfigModule * find(ParmStr key, 
-				   const ConfigModule * i, 
-				   const ConfigModule * end) 
+  const KeyInfo * Config::find_module_option(ParmStr key) const
   {
-    while (i != end) {
-      if (strcmp(key, i->name) == 0)
-	return i;
-      ++i;
-    }
-    return i;
+    LOCK(&index_lock_);
+    return find_option(module_index(), key);
   }
 
   PosibErr<const KeyInfo *> Config::keyinfo(ParmStr key) const
   {
     typedef PosibErr<const KeyInfo *> Ret;
     {
-      const KeyInfo * i;
-      i = acommon::find(key, keyinfo_begin, keyinfo_end);
-      if (i != keyinfo_end) return Ret(i);
-      
-      i = acommon::find(key, extra_begin, extra_end);
-      if (i != extra_end) return Ret(i);
-      
+      const KeyInfo * i = 0;
+      if (main_index_ && (i = main_index_->find(key))) return Ret(i);
+      if (extra_index_ && (i = extra_index_->find(key))) return Ret(i);
+
       const char * s = strncmp(key, "f-", 2) == 0 ? key + 2 : key.str();
       const char * h = strchr(s, '-');
       if (h == 0) goto err;
 
+      i = find_module_option(key);
+      if (i) return Ret(i);
+
+      if (!load_filter_hook || !committed_) goto err;
+
+      // The option may belong to a filter module which is not loaded
+      // yet.  If the module is already loaded the hook simply returns
+      // it.
       String k(s, h - s);
-      const ConfigModule * j = acommon::find(k,
-					     filter_modules.pbegin(),
-					     filter_modules.pend());
-      
-      if (j == filter_modules.pend() && load_filter_hook && committed_) {
+      {
         // FIXME: This isn't quite right
         PosibErrBase pe = load_filter_hook(const_cast<Config *>(this), k);
         pe.ignore_err();
-        j = acommon::find(k,
-                          filter_modules.pbegin(),
-                          filter_modules.pend());
       }
 
-      if (j == filter_modules.pend()) goto err;
-
-      i = acommon::find(key, j->begin, j->end);
-      if (i != j->end) return Ret(i);
-      
-      if (strncmp(key, "f-", 2) != 0) k = "f-";
-      else                            k = "";
-      k += key;
-      i = acommon::find(k, j->begin, j->end);
-      if (i != j->end) return Ret(i);
+      i = find_module_option(key);
+      if (i) return Ret(i);
     }
   err:  
     return Ret().prim_err(unknown_key, key);
@@ -791,6 +941,7 @@ namespace acommon {
     entry->next = *insert_point_;
     *insert_point_ = entry;
     insert_point_ = &entry->next;
+    entry_added(entry);
   }
 
   PosibErr<void> Config::replace(ParmStr key, ParmStr value)
@@ -855,6 +1006,7 @@ namespace acommon {
       entry->next = *insert_point_;
       *insert_point_ = entry;
       insert_point_ = &entry->next;
+      entry_added(entry);
       entry.release();
       if (committed_) RET_ON_ERR(commit(entry0)); // entry0 == entry
       
@@ -883,6 +1035,7 @@ namespace acommon {
       entry->next = *insert_point_;
       *insert_point_ = entry;
       insert_point_ = &entry->next;
+      entry_added(entry);
       if (committed_) RET_ON_ERR(commit(entry));
       src = src->next;
     }
@@ -910,6 +1063,7 @@ namespace acommon {
       }
       src = src->next;
     }
+    entries_changed();
   }
 
 
@@ -931,7 +1085,10 @@ namespace acommon {
       
       const KeyInfo * ki = pe;
 
-      entry->key = ki->name;
+      if (entry->key != ki->name) {
+        entry->key = ki->name;
+        entries_changed();
+      }
       
       // FIXME: This is the correct thing to do but it causes problems
       //        with changing a filter mode in "pipe" mode and probably
@@ -1010,6 +1167,7 @@ namespace acommon {
     }
   error:
     entry->action = NoOp;
+    entries_changed();
     if (!entry->file.empty())
       return pe.with_file(entry->file, entry->line_num);
     else
@@ -1313,6 +1471,7 @@ namespace acommon {
     others_ = first_;
     first_ = 0;
     insert_point_ = &first_;
+    entries_changed();
     Conv to_utf8;
     if (codeset)
       RET_ON_ERR(to_utf8.setup(*this, codeset, "utf-8", NormTo));
@@ -1320,6 +1479,7 @@ namespace acommon {
       *insert_point_ = others_;
       others_ = others_->next;
       (*insert_point_)->next = 0;
+      entry_added(*insert_point_);
       RET_ON_ERR_SET(commit(*insert_point_, codeset ? &to_utf8 : 0), int, place_holder);
       if (phs && place_holder != -1 && (phs->empty() || phs->back() != place_holder))
         phs->push_back(place_holder);
@@ -1367,6 +1527,8 @@ namespace acommon {
        N_("create dictionary aliases")}
     , {"dict-dir", KeyInfoString, DICT_DIR,
        N_("location of the main word list")}
+    , {"dict-index", KeyInfoBool, "true",
+       N_("keep an index of the installed dictionaries")}
     , {"encoding",   KeyInfoString, "!encoding",
        N_("encoding to expect data to be in"), KEYINFO_COMMON}
     , {"filter",   KeyInfoList  , "url",
@@ -1377,8 +1539,16 @@ namespace acommon {
     //   N_("path(s) aspell looks for options descriptions")}
     , {"mode",     KeyInfoString, "url",
        N_("filter mode"), KEYINFO_COMMON}
+    , {"mode-index", KeyInfoBool, "true",
+       N_("keep an index of the filter modes")}
     , {"extra-dicts", KeyInfoList, "",
        N_("extra dictionaries to use")}
+    , {"guess-affixes", KeyInfoBool, "true",
+       N_("find possible root/affix combinations of misspelled words"), 
+       KEYINFO_MAY_CHANGE}
+    , {"check-cache", KeyInfoInt, "0",
+       N_("number of recently checked words to remember, 0 to disable"), 
+       KEYINFO_MAY_CHANGE}
     , {"home-dir", KeyInfoString, HOME_DIR,
        N_("location for personal files")}
     , {"ignore",   KeyInfoInt   , "1",
@@ -1423,6 +1593,10 @@ namespace acommon {
     , {"per-conf-path", KeyInfoString, "<home-dir/per-conf>", 0}
     , {"personal", KeyInfoString, PERSONAL,
        N_("personal dictionary file name")}
+    , {"personal-cache", KeyInfoBool, "false",
+       N_("keep a compiled copy of large personal word lists")}
+    , {"personal-journal", KeyInfoBool, "false",
+       N_("save personal word lists by appending to a journal")}
     , {"personal-path", KeyInfoString, "<home-dir/personal>", 0}
     , {"prefix",   KeyInfoString, PREFIX,
        N_("prefix directory")}
@@ -1433,6 +1607,9 @@ namespace acommon {
        N_("consider run-together words legal"), KEYINFO_MAY_CHANGE}
     , {"run-together-limit",  KeyInfoInt,   "2",
        N_("maximum number that can be strung together"), KEYINFO_MAY_CHANGE}
+    , {"run-together-dp",     KeyInfoBool,  "false",
+       N_("find run-together words using dynamic programming"), 
+       KEYINFO_MAY_CHANGE}
     , {"run-together-min",    KeyInfoInt,   "3",
        N_("minimal length of interior words"), KEYINFO_MAY_CHANGE}
     , {"save-repl", KeyInfoBool  , "true",
@@ -1498,12 +1675,20 @@ namespace acommon {
        N_("create a backup file by appending \".bak\"")}
     , {"byte-offsets", KeyInfoBool, "false",
        N_("use byte offsets instead of character offsets")}
+    , {"count", KeyInfoBool, "false",
+       N_("print number of misspellings in list mode")}
     , {"guess", KeyInfoBool, "false",
        N_("create missing root/affix combinations"), KEYINFO_MAY_CHANGE}
+    , {"jobs", KeyInfoInt, "1",
+       N_("number of threads to use in list mode")}
     , {"keymapping", KeyInfoString, "aspell",
        N_("keymapping for check mode: \"aspell\" or \"ispell\"")}
+    , {"pipe-protocol", KeyInfoString, "ispell",
+       N_("protocol for pipe mode: \"ispell\" or \"batch\"")}
     , {"reverse", KeyInfoBool, "false",
        N_("reverse the order of the suggest list")}
+    , {"socket", KeyInfoString, "",
+       N_("Unix domain socket used by serve and list")}
     , {"suggest", KeyInfoBool, "true",
        N_("suggest possible replacements"), KEYINFO_MAY_CHANGE}
     , {"time"   , KeyInfoBool, "false",
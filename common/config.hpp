@@ -9,6 +9,7 @@
 
 #include "can_have_error.hpp"
 #include "key_info.hpp"
+#include "lock.hpp"
 #include "posib_err.hpp"
 #include "string.hpp"
 #include "vector.hpp"
@@ -21,6 +22,9 @@ namespace acommon {
   class MutableContainer;
   class Cacheable;
   struct Conv;
+  class KeyInfoIndex;
+  class ModuleIndex;
+  class EntryIndex;
 
   // The Config class is used to hold configuration information.
   // it has a set of keys which it will except.  Inserting or even
@@ -114,6 +118,20 @@ namespace acommon {
     Entry * * insert_point_;
     Entry * others_;
 
+    // keyinfo and lookup use these instead of searching the key
+    // tables and entries, see config.cpp, const methods only update
+    // them while holding "index_lock_"
+    mutable Mutex index_lock_;
+    mutable ModuleIndex * module_index_;
+    mutable EntryIndex * entry_index_;
+    mutable bool entry_index_valid_;
+    void entries_changed() {entry_index_valid_ = false;}
+    void entry_added(const Entry *);
+    const Vector<const Entry *> * entries_for(const char * key) const;
+    const KeyInfoIndex * module_index() const;
+    const KeyInfo * find_module_option(ParmStr key) const;
+    void release_module_index();
+
     bool committed_;
     bool attached_;    // if attached can't copy
     Vector<Notifier *> notifier_list;
@@ -124,6 +142,10 @@ namespace acommon {
     const KeyInfo       * keyinfo_end;
     const KeyInfo       * extra_begin;
     const KeyInfo       * extra_end;
+    // the main and extra tables must be static as they are indexed
+    // once for the whole process
+    const KeyInfoIndex  * main_index_;
+    const KeyInfoIndex  * extra_index_;
 
     int md_info_list_index;
 
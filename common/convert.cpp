@@ -1012,6 +1012,13 @@ namespace acommon {
 
   Convert::~Convert() {}
 
+  unsigned int Convert::in_width() const
+  {
+    if (decode_->key == "ucs-2") return sizeof(Uni16);
+    if (decode_->key == "ucs-4") return sizeof(Uni32);
+    return 1;
+  }
+
   PosibErr<void> Convert::init(const Config & c, ParmStr in, ParmStr out)
   {
     RET_ON_ERR(setup(decode_c, &decode_cache, &c, in));
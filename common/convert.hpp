@@ -126,6 +126,10 @@ namespace acommon {
     const char * in_code() const   {return decode_->key.c_str();}
     const char * out_code() const  {return encode_->key.c_str();}
 
+    // the size in bytes of a code unit of the input, positions in the
+    // decoded text are counted in these units
+    unsigned int in_width() const;
+
     void append_null(CharVector & out) const
     {
       const char nul[4] = {0,0,0,0}; // 4 should be enough
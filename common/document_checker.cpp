@@ -4,18 +4,36 @@
  * LGPL license along with this library if you did not you can find it
  * at http://www.gnu.org/.                                              */
 
+#include <algorithm>
+
 #include "document_checker.hpp"
 #include "tokenizer.hpp"
 #include "convert.hpp"
 #include "speller.hpp"
 #include "config.hpp"
+#include "hash-t.hpp"
 
 namespace acommon {
 
+  // A buffer being incrementally checked.  "lines" contains the offset,
+  // in code units, of the start of every line (including the empty line
+  // after a final newline) and "states" the filter state at the start
+  // of each of those lines.  Lines are always processed one at a time
+  // so the tokenizer does not carry any state across line boundaries.
+  struct DocumentChecker::Buffer {
+    String text;
+    Vector<unsigned> lines;
+    Vector<String> states;
+    bool have_states;
+  };
+
   DocumentChecker::DocumentChecker() 
-    : status_fun_(0), speller_(0) {}
+    : status_fun_(0), speller_(0), changed_pos_(0) {}
   DocumentChecker::~DocumentChecker() 
   {
+    hash_map<int, Buffer *>::iterator i = buffers_.begin();
+    for (; i != buffers_.end(); ++i)
+      delete i->second;
   }
 
   PosibErr<void> DocumentChecker
@@ -28,6 +46,22 @@ namespace acommon {
     return no_err;
   }
 
+  PosibErr<void> DocumentChecker::reload_filter()
+  {
+    hash_map<int, Buffer *>::iterator i = buffers_.begin();
+    for (; i != buffers_.end(); ++i)
+      delete i->second;
+    buffers_.clear();
+    changed_.clear();
+    changed_pos_ = 0;
+    proc_str_.clear();
+    proc_str_.append(0);
+    tokenizer_->reset(proc_str_.pbegin(), proc_str_.pbegin());
+    if (!filter_) filter_.reset(new Filter);
+    return setup_filter(*filter_, speller_->config(), speller_->filter_cache_,
+                        true, true, false);
+  }
+
   void DocumentChecker::set_status_fun(void (* sf)(void *, Token, int), 
 				       void * d)
   {
@@ -41,7 +75,19 @@ namespace acommon {
       filter_->reset();
   }
 
+  unsigned DocumentChecker::in_width() const
+  {
+    return conv_->in_width();
+  }
+
   void DocumentChecker::process(const char * str, int size)
+  {
+    changed_.clear();
+    changed_pos_ = 0;
+    filter_line(str, size);
+  }
+
+  void DocumentChecker::filter_line(const char * str, int size)
   {
     proc_str_.clear();
     conv_->decode(str, size, proc_str_);
@@ -54,6 +100,13 @@ namespace acommon {
   }
 
   Token DocumentChecker::next_misspelling()
+  {
+    if (changed_pos_ < changed_.size())
+      return changed_[changed_pos_++];
+    return check_next();
+  }
+
+  Token DocumentChecker::check_next()
   {
     bool correct;
     Token tok;
@@ -73,5 +126,176 @@ namespace acommon {
     return tok;
   }
 
-}
+  // Returns the position of the first newline in [pos, end) of str or
+  // end if there is none.  Positions are in code units of the given
+  // width.
+  static unsigned find_newline(const char * str, unsigned pos, unsigned end,
+                               unsigned width)
+  {
+    if (width == 2) {
+      const unsigned short * s = reinterpret_cast<const unsigned short *>(str);
+      while (pos != end && s[pos] != '\n') ++pos;
+      return pos;
+    } else if (width == 4) {
+      const unsigned int * s = reinterpret_cast<const unsigned int *>(str);
+      while (pos != end && s[pos] != '\n') ++pos;
+      return pos;
+    } else {
+      const char * nl = static_cast<const char *>
+        (memchr(str + pos, '\n', end - pos));
+      return nl ? nl - str : end;
+    }
+  }
+
+  // Returns the length, in code units of the given width, of the null
+  // terminated string str.
+  static unsigned null_term_len(const char * str, unsigned width)
+  {
+    unsigned len = 0;
+    if (width == 2) {
+      const unsigned short * s = reinterpret_cast<const unsigned short *>(str);
+      while (s[len]) ++len;
+    } else if (width == 4) {
+      const unsigned int * s = reinterpret_cast<const unsigned int *>(str);
+      while (s[len]) ++len;
+    } else {
+      len = strlen(str);
+    }
+    return len;
+  }
 
+  Token DocumentChecker::edit(int id, unsigned begin, unsigned end,
+                              const char * str, int size)
+  {
+    const unsigned width = conv_->in_width();
+    unsigned len = size < 0 ? null_term_len(str, width) : size / width;
+
+    Buffer * & buf = buffers_[id];
+    if (!buf) {
+      buf = new Buffer;
+      buf->lines.push_back(0);
+      buf->states.resize(1);
+      if (filter_) {
+        filter_->reset();
+        buf->have_states = filter_->save_state(buf->states[0]);
+      } else {
+        buf->have_states = true;
+      }
+    }
+
+    // splice the edit into the text, only the text after it is moved
+    String & text = buf->text;
+    unsigned text_len = text.size() / width;
+    if (end > text_len) end = text_len;
+    if (begin > end) begin = end;
+    int delta = len - (end - begin);
+    text.erase(begin * width, (end - begin) * width);
+    text.insert(begin * width, str, len * width);
+    text_len += delta;
+
+    Vector<unsigned> & lines = buf->lines;
+    Vector<String> & states = buf->states;
+    unsigned first = std::upper_bound(lines.begin(), lines.end(), begin) 
+                     - lines.begin() - 1;
+
+    // get the filter into the state it was at the start of the first
+    // changed line
+    if (filter_) {
+      filter_->reset();
+      if (buf->have_states) {
+        filter_->restore_state(states[first]);
+      } else {
+        for (unsigned i = 0; i != first; ++i)
+          filter_line(text.data() + lines[i] * width, 
+                      (lines[i+1] - lines[i]) * width);
+      }
+    }
+
+    // The lines after the first changed one are re-checked until the
+    // filter state converges with the one saved before the edit.  The
+    // lines found, and the states at their start, then replace those
+    // in [first + 1, keep) of the old ones.
+    changed_.clear();
+    changed_pos_ = 0;
+    Vector<unsigned> new_lines;
+    Vector<String> new_states;
+    unsigned keep = lines.size();
+    Token range;
+    range.offset = lines[first];
+    unsigned pos = range.offset;
+    unsigned ins_end = begin + len;
+    String state;
+    while (pos != text_len) {
+      unsigned nl = find_newline(text.data(), pos, text_len, width);
+      unsigned line_end = nl != text_len ? nl + 1 : text_len;
+      filter_line(text.data() + pos * width, (line_end - pos) * width);
+      while (Token tok = check_next()) {
+        tok.offset += pos;
+        changed_.push_back(tok);
+      }
+      pos = line_end;
+      if (nl == text_len) break;
+      state.clear();
+      if (filter_ && buf->have_states) 
+        filter_->save_state(state);
+      if (pos >= ins_end && buf->have_states) {
+        // the text from here on is unchanged, so if the filter is in
+        // the same state as before the edit the rest of the buffer
+        // will also check the same
+        unsigned old_pos = pos - delta;
+        Vector<unsigned>::iterator j 
+          = std::lower_bound(lines.begin() + first + 1, lines.end(), old_pos);
+        if (j != lines.end() && *j == old_pos 
+            && states[j - lines.begin()] == state) 
+        {
+          keep = j - lines.begin();
+          break;
+        }
+      }
+      new_lines.push_back(pos);
+      new_states.push_back(String());
+      new_states.back().swap(state);
+    }
+    range.len = pos - range.offset;
+
+    // splice the new lines into the old ones, the states are moved
+    // with swap rather than copied
+    for (unsigned i = keep; i != lines.size(); ++i)
+      lines[i] += delta;
+    unsigned removed = keep - (first + 1);
+    unsigned added = new_lines.size();
+    if (added > removed) {
+      unsigned n = added - removed;
+      lines.insert(lines.begin() + keep, n, 0);
+      states.resize(states.size() + n);
+      for (unsigned i = states.size(); i-- != keep + n;)
+        states[i].swap(states[i - n]);
+    } else if (removed > added) {
+      unsigned n = removed - added;
+      lines.erase(lines.begin() + keep - n, lines.begin() + keep);
+      for (unsigned i = keep - n; i + n != states.size(); ++i)
+        states[i].swap(states[i + n]);
+      states.resize(states.size() - n);
+    }
+    for (unsigned i = 0; i != added; ++i) {
+      lines[first + 1 + i] = new_lines[i];
+      states[first + 1 + i].swap(new_states[i]);
+    }
+
+    // make sure nothing from the last line is returned once the
+    // changed misspellings are exhausted
+    proc_str_.clear();
+    proc_str_.append(0);
+    tokenizer_->reset(proc_str_.pbegin(), proc_str_.pbegin());
+    return range;
+  }
+
+  void DocumentChecker::remove_buffer(int id)
+  {
+    hash_map<int, Buffer *>::iterator i = buffers_.find(id);
+    if (i == buffers_.end()) return;
+    delete i->second;
+    buffers_.erase(i);
+  }
+
+}
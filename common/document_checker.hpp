@@ -13,6 +13,7 @@
 #include "can_have_error.hpp"
 #include "filter_char.hpp"
 #include "filter_char_vector.hpp"
+#include "hash.hpp"
 
 namespace acommon {
 
@@ -34,11 +35,44 @@ namespace acommon {
     // config only used for this method.
     // speller expected to stick around.
     PosibErr<void> setup(Tokenizer *, Speller *, Filter *);
+    // sets the filter up again for the current options of the
+    // speller's config, for example after changing the mode, taking
+    // it from the speller's filter cache if possible.  As the saved
+    // filter states are no longer valid all buffers are removed.
+    PosibErr<void> reload_filter();
     void reset();
     void process(const char * str, int size);
     Token next_misspelling();
+
+    // Incrementally check an edited buffer.
+    //
+    // Replaces [begin, end) of the buffer with the given id (which is
+    // created empty when first used) with "str", in place, and
+    // re-checks the lines affected by the edit.  Checking starts from
+    // the checkpoint of the filter state saved at the start of the
+    // first changed line and stops as soon as the state converges
+    // with the one saved before the edit.  The range re-checked, in
+    // the new buffer, is returned.
+    //
+    // ALL the misspellings in that range are then returned by
+    // next_misspelling, with offsets relative to the start of the
+    // buffer, including those which were already reported before the
+    // edit and did not change.  The caller is expected to replace
+    // whatever it has for the range with them, or to compare them with
+    // what it had if it needs to know which changed.  Misspellings
+    // outside of the range are not affected by the edit other than
+    // being shifted by the change in size.
+    //
+    // As for tokens, positions are counted in code units of the input
+    // encoding while "size" is in bytes as for process, or -1 if
+    // "str" is null terminated.
+    Token edit(int buffer, unsigned begin, unsigned end, 
+               const char * str, int size);
+    void remove_buffer(int buffer);
     
     Filter * filter() {return filter_;}
+    // the size in bytes of a code unit of the input encoding
+    unsigned in_width() const;
 
     void set_status_fun(void (*)(void *, Token, int), void *); 
    
@@ -53,6 +87,13 @@ namespace acommon {
     Speller * speller_;
     Convert * conv_;
     FilterCharVector proc_str_;
+
+    struct Buffer;
+    hash_map<int, Buffer *> buffers_;
+    Vector<Token> changed_;
+    unsigned changed_pos_;
+    void filter_line(const char * str, int size);
+    Token check_next();
   };
 
   PosibErr<DocumentChecker *> new_document_checker(Speller *);
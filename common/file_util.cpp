@@ -27,7 +27,11 @@
 #ifdef WIN32
 
 #  include <io.h>
+#  include <direct.h>
+#  include <process.h>
 #  define ACCESS _access
+#  define MKDIR(d) _mkdir(d)
+#  define GETPID _getpid
 #  include <windows.h>
 #  include <winbase.h>
 
@@ -35,6 +39,8 @@
 
 #  include <unistd.h>
 #  define ACCESS access
+#  define MKDIR(d) mkdir(d, 0777)
+#  define GETPID getpid
 
 #endif
 
@@ -88,6 +94,14 @@ namespace acommon {
     return s.st_mtime;
   }
 
+  bool get_file_info(ParmString name, time_t & mtime, long & size) {
+    struct stat s;
+    if (stat(name, &s) != 0) return false;
+    mtime = s.st_mtime;
+    size  = s.st_size;
+    return true;
+  }
+
   PosibErr<void> open_file_readlock(FStream & in, ParmString file) {
     RET_ON_ERR(in.open(file, "r"));
 #ifdef USE_FILE_LOCKS
@@ -153,6 +167,45 @@ namespace acommon {
     remove(new_name);
     return rename(orig_name, new_name) == 0;
   }
+
+  bool replace_file(ParmString file, const void * data, unsigned int size)
+  {
+    // the process id keeps two processes from writing the same
+    // temporary file
+    String tmp = file;
+    tmp.printf(".%d.new", (int)GETPID());
+    FILE * out = fopen(tmp.str(), "wb");
+    if (!out) return false;
+    bool ok = fwrite(data, 1, size, out) == size;
+    if (fclose(out) != 0) ok = false;
+#ifdef WIN32
+    // rename will not replace an existing file
+    if (ok) remove(file);
+#endif
+    if (ok && rename(tmp.str(), file) != 0) ok = false;
+    if (!ok) remove(tmp.str());
+    return ok;
+  }
+
+  bool make_dir(ParmString dir)
+  {
+    return MKDIR(dir) == 0 || file_exists(dir);
+  }
+
+  bool make_index_dir(ParmString dir)
+  {
+    if (file_exists(dir)) return true;
+    if (MKDIR(dir) != 0) return file_exists(dir);
+    time_t created = time(0);
+    while (time(0) <= created + 1) {
+#ifdef WIN32
+      Sleep(250);
+#else
+      usleep(250000);
+#endif
+    }
+    return true;
+  }
  
   const char * get_file_name(const char * path) {
     const char * file_name;
@@ -26,6 +26,8 @@ namespace acommon {
   //void open_file(FStream & in, const string & file,
   //               ParmString mode = "r");
   time_t get_modification_time(FStream & f);
+  // returns false if the file does not exist
+  bool get_file_info(ParmString name, time_t & mtime, long & size);
   PosibErr<void> open_file_readlock(FStream& in, ParmString file);
   PosibErr<bool> open_file_writelock(FStream & in, ParmString file);
   // returns true if the file already exists
@@ -33,6 +35,18 @@ namespace acommon {
   bool remove_file(ParmString name);
   bool file_exists(ParmString name);
   bool rename_file(ParmString orig, ParmString new_name);
+  // writes "data" to a temporary file next to "file" which is then
+  // renamed to "file", so that a reader sees either the old or the
+  // new contents; returns false, leaving "file" as it was, on error
+  bool replace_file(ParmString file, const void * data, unsigned int size);
+  // creates the directory if it does not exist yet
+  bool make_dir(ParmString dir);
+  // Like make_dir but for the directory of an index which records the
+  // modification time of the parent directory.  Creating it modifies
+  // the parent, so it then waits until that time is more than a
+  // second in the past, as the indexes do not trust a more recent
+  // time.  Must be called before the parent is read.
+  bool make_index_dir(ParmString dir);
   // will return NULL if path is NULL.
   const char * get_file_name(const char * path);
 
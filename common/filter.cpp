@@ -57,6 +57,40 @@ namespace acommon {
       (*cur)->process(start, stop);
   }
 
+  // The state of the filters is stored one after another, each
+  // prefixed with its size.
+
+  bool Filter::save_state(String & state) const
+  {
+    Filters::const_iterator cur, end;
+    cur = filters_.begin();
+    end = filters_.end();
+    for (; cur != end; ++cur) {
+      unsigned pos = state.size();
+      state.append("\0\0\0\0", 4);
+      if (!(*cur)->save_state(state)) return false;
+      unsigned size = state.size() - pos - 4;
+      memcpy(state.data() + pos, &size, 4);
+    }
+    return true;
+  }
+
+  void Filter::restore_state(ParmString state)
+  {
+    const char * s = state.str();
+    const char * stop = s + state.size();
+    Filters::iterator cur, end;
+    cur = filters_.begin();
+    end = filters_.end();
+    for (; cur != end && s + 4 <= stop; ++cur) {
+      unsigned size;
+      memcpy(&size, s, 4);
+      s += 4;
+      (*cur)->restore_state(ParmString(s, size));
+      s += size;
+    }
+  }
+
   void Filter::clear()
   {
     Filters::iterator cur, end;
@@ -66,6 +100,7 @@ namespace acommon {
       delete *cur;
     }
     filters_.clear();
+    key.clear();
   }
 
   Filter::~Filter() 
@@ -73,6 +108,48 @@ namespace acommon {
     clear();
   }
 
+  FilterCache::~FilterCache()
+  {
+    for (Vector<Filter *>::iterator i = filters_.begin(); 
+         i != filters_.end(); ++i)
+      delete *i;
+  }
+
+  void FilterCache::put(Filter & filter)
+  {
+    if (filter.key.empty()) {
+      filter.clear();
+      return;
+    }
+    Filter * f;
+    if (filters_.size() < max_size) {
+      f = new Filter;
+    } else {
+      f = filters_.front();
+      filters_.erase(filters_.begin());
+      f->clear();
+    }
+    f->swap(filter);
+    filters_.push_back(f);
+  }
+
+  bool FilterCache::get(const String & key, Filter & filter)
+  {
+    for (Vector<Filter *>::iterator i = filters_.end(); 
+         i != filters_.begin();)
+    {
+      --i;
+      if ((*i)->key == key) {
+        Filter * f = *i;
+        filters_.erase(i);
+        filter.swap(*f);
+        delete f;
+        return true;
+      }
+    }
+    return false;
+  }
+
   static PosibErr<int> version_compare(const char * x, const char * y)
   {
     do {
@@ -20,6 +20,7 @@ namespace acommon {
 
   class Config;
   class Speller;
+  class String;
   class IndividualFilter;
   class StringList;
   struct ConfigModule;
@@ -31,7 +32,17 @@ namespace acommon {
     void clear();
     void reset();
     void process(FilterChar * & start, FilterChar * & stop);
+    // returns false if any of the filters can not save its state
+    bool save_state(String & state) const;
+    void restore_state(ParmString state);
     void add_filter(IndividualFilter * filter);
+    void swap(Filter & other) {
+      filters_.swap(other.filters_);
+      key.swap(other.key);
+    }
+    // identifies the filter options the filters were set up for when
+    // set up with a FilterCache, otherwise empty
+    String key;
     // setup the filter where the string list is the list of 
     // filters to use.
     Filter();
@@ -40,16 +51,44 @@ namespace acommon {
  private:
     typedef Vector<IndividualFilter *> Filters;
     Filters filters_;
+    Filter(const Filter &);
+    void operator=(const Filter &);
+  };
+
+  // Holds filters which are no longer in use so that going back to
+  // the same mode, or more precisely the same filter options, only
+  // means taking them out of the cache rather than setting them up
+  // again.  Each speller has one, see reload_filters.
+  class FilterCache {
+  public:
+    FilterCache() {}
+    ~FilterCache();
+    // takes the filters from "filter", which is left empty
+    void put(Filter & filter);
+    // moves the filters set up for "key" into "filter", which must
+    // be empty, returns false if there are none
+    bool get(const String & key, Filter & filter);
+  private:
+    static const unsigned max_size = 8;
+    Vector<Filter *> filters_; // the most recently used last
+    FilterCache(const FilterCache &);
+    void operator=(const FilterCache &);
   };
 
   PosibErr<void> set_mode_from_extension(Config * config,
-                                         ParmString filename,
-                                         FILE * in = NULL);
+                                         ParmString filename);
   
   PosibErr<void> setup_filter(Filter &, Config *, 
 			      bool use_decoder, 
 			      bool use_filter, 
 			      bool use_encoder);
+  // Like the above but the filters already in the Filter are moved
+  // to the cache and the ones for the current options are taken from
+  // it if it has them.  In either case the filters are reset.
+  PosibErr<void> setup_filter(Filter &, Config *, FilterCache *,
+			      bool use_decoder, 
+			      bool use_filter, 
+			      bool use_encoder);
   void activate_dynamic_filteroptions(Config *c);
   void activate_filter_modes(Config * config);
 
@@ -62,6 +101,10 @@ namespace acommon {
   PosibErr<StringPairEnumeration *> available_filters(Config *);
   PosibErr<StringPairEnumeration *> available_filter_modes(Config *);
 
+  // writes the index of the filter modes in the filter path, it is
+  // used when the "mode-index" option is set
+  PosibErr<void> write_mode_index(Config *);
+
 };
 
 #endif /* ASPELL_FILTER__HPP */
@@ -145,7 +145,7 @@ namespace acommon {
     const_iterator begin() const {return const_iterator(table_);}
     const_iterator end()   const {return const_iterator(table_end_,*table_end_);}
     size_type size() const  {return size_;}
-    bool      empty() const {return size_ + 1;}
+    bool      empty() const {return size_ == 0;}
     std::pair<iterator,bool> insert(const value_type &); 
     void erase(iterator);
     size_type erase(const key_type &);
@@ -180,7 +180,11 @@ namespace acommon {
 	(range.first,range.second);
     }
         
-    void resize(Size s) {resize_i(next_largest(s));}
+    // only ever grows the table
+    void resize(Size s) {
+      PrimeIndex i = next_largest(s);
+      if (i != prime_index_) resize_i(i);
+    }
 
     //other niceties: swap, copy, equal
 
@@ -8,6 +8,7 @@
 #define ACOMMON_FILTER__HPP
 
 #include <assert.h>
+#include <string.h>
 
 #include "string.hpp"
 #include "posib_err.hpp"
@@ -80,6 +81,18 @@ namespace acommon {
     //
     virtual void process(FilterChar * & start, FilterChar * & stop) = 0;
 
+    // save the internal state of the filter
+    //
+    // The state is appended to "state" so that processing can later
+    // be resumed from the same point with restore_state.  Should
+    // return false if the filter does not support this, in which case
+    // a document must always be filtered from the beginning.
+    virtual bool save_state(String & state) const {return false;}
+
+    // restore the internal state of the filter previously saved with
+    // save_state
+    virtual void restore_state(ParmStr state) {}
+
     virtual ~IndividualFilter() {}
 
     const char * name() const {return name_.str();}
@@ -95,6 +108,45 @@ namespace acommon {
     double order_num_; // between 0 and 1 exclusive
   };
 
+  //
+  // Helpers for implementing save_state and restore_state.  The
+  // state is only meant to be restored by the same version of the
+  // filter so values are simply stored in native byte order.
+  //
+
+  template <typename T>
+  inline void save_filter_state(String & state, const T & val)
+  {
+    state.append(&val, sizeof(T));
+  }
+
+  inline void save_filter_state(String & state, const String & str)
+  {
+    save_filter_state(state, static_cast<unsigned>(str.size()));
+    state.append(str.data(), str.size());
+  }
+
+  class FilterStateReader {
+    const char * cur_;
+    const char * end_;
+  public:
+    FilterStateReader(ParmStr state) 
+      : cur_(state.str()), end_(state.str() + state.size()) {}
+    template <typename T>
+    void get(T & val) {
+      if (cur_ + sizeof(T) > end_) {val = T(); return;}
+      memcpy(&val, cur_, sizeof(T));
+      cur_ += sizeof(T);
+    }
+    void get(String & str) {
+      unsigned size = 0;
+      get(size);
+      if (cur_ + size > end_) size = end_ - cur_;
+      str.assign(cur_, size);
+      cur_ += size;
+    }
+  };
+
 }
 
 #endif
@@ -25,6 +25,7 @@
 #include "asc_ctype.hpp"
 #include "config.hpp"
 #include "errors.hpp"
+#include "file_util.hpp"
 #include "fstream.hpp"
 #include "getdata.hpp"
 #include "info.hpp"
@@ -35,6 +36,7 @@
 #include "stack_ptr.hpp"
 #include "strtonum.hpp"
 #include "lock.hpp"
+#include "lsort.hpp"
 #include "string_map.hpp"
 
 #include "gettext.h"
@@ -70,6 +72,54 @@ namespace acommon {
 
   typedef Vector<DictExt> DictExtList;
 
+  struct DictInfoNode;
+
+  // The dictionaries found in the dict-dirs, and the names of the
+  // module files in the data and dict dirs, can be kept in an index,
+  // "aspell-index/aspell-dicts.idx" in the dict-dir, so that the
+  // directories do not need to be read, nor the names of the
+  // dictionaries parsed, every time the lists are filled.  The index
+  // is only written by write_dict_index, which is used by "aspell
+  // build-index".  Each directory is stored with its modification
+  // time and is read again if that changed.  The dictionaries in the
+  // index are only used if none of the dict-dirs changed.
+  class DictIndex
+  {
+  public:
+    struct Dict {
+      String name, code, variety, size_str, module, info_file;
+      bool direct;
+    };
+  private:
+    struct DirModules {
+      String path;
+      time_t mtime;
+      bool valid;   // true if it has not changed since the index was written
+      bool scanned; // true if "files" is up to date
+      Vector<String> files; // the names of the .asmi files
+    };
+    Vector<DirModules> dirs_;
+    Vector<String> dict_dirs_;
+    String exts_; // the extensions the dictionaries were found with
+    Vector<Dict> dicts_;
+    DirModules & find(ParmString dir);
+  public:
+    void clear() {
+      dirs_.clear(); dict_dirs_.clear(); exts_.clear(); dicts_.clear();}
+    void read(ParmString file);
+    // returns the names of the .asmi files in "dir", reading the
+    // directory if it is not in the index
+    const Vector<String> & module_files(ParmString dir);
+    // returns the dictionaries found in "dirs" with the extensions
+    // "exts", or 0 if they are not in the index
+    const Vector<Dict> * dicts(const StringList & dirs, 
+                               const DictExtList & exts);
+    // notes that "dir" is about to be read for dictionaries
+    void dict_dir_read(ParmString dir) {find(dir);}
+    PosibErr<void> write(ParmString file, const StringList & dict_dirs,
+                         const DictExtList &, const DictInfoNode * dicts);
+  };
+
   struct MDInfoListAll
   // this is in an invalid state if some of the lists
   // has data but others don't
@@ -81,8 +131,11 @@ namespace acommon {
     DictExtList    dict_exts;
     DictInfoList   dict_info_list;
     StringMap      dict_aliases;
+    DictIndex      dict_index; // only used while filling the lists
     void clear();
-    PosibErr<void> fill(Config *, StringList &);
+    // if "use_index" is false the index is not read, and is instead
+    // left with what was found so that it can be written
+    PosibErr<void> fill(Config *, StringList &, bool use_index = true);
     bool has_data() const {return module_info_list.head_ != 0;}
     void fill_helper_lists(const StringList &);
     PosibErr<void> fill_dict_aliases(Config *);
@@ -178,12 +231,9 @@ namespace acommon {
     StringListEnumeration els = list_all.for_dirs.elements_obj();
     const char * dir;
     while ( (dir = els.next()) != 0) {
-      Dir d(opendir(dir));
-      if (d==0) continue;
-    
-      struct dirent * entry;
-      while ( (entry = readdir(d)) != 0) {
-	const char * name = entry->d_name;
+      const Vector<String> & files = list_all.dict_index.module_files(dir);
+      for (unsigned i = 0; i != files.size(); ++i) {
+	const char * name = files[i].str();
 	const char * dot_loc = strrchr(name, '.');
 	unsigned int name_size = dot_loc == 0 ? strlen(name) :  dot_loc - name;
       
@@ -288,10 +338,29 @@ namespace acommon {
     String size_str;
     String info_file;
     bool direct;
+    bool in_dir; // false for dictionaries from "dict-alias"
+    unsigned pos; // only used while sorting
   };
 
   bool operator< (const DictInfoNode & r, const DictInfoNode & l);
 
+  // the sort in lsort.hpp is not stable, so entries which compare
+  // equal are ordered by their position in the list before sorting
+  struct DictInfoNodeLess {
+    bool operator() (const DictInfoNode * x, const DictInfoNode * y) const {
+      if (*x < *y) return true;
+      if (*y < *x) return false;
+      return x->pos < y->pos;}
+  };
+
+  static DictInfoNode * sort_dict_info(DictInfoNode * head)
+  {
+    unsigned pos = 0;
+    for (DictInfoNode * n = head; n; n = n->next)
+      n->pos = pos++;
+    return sort(head, DictInfoNodeLess());
+  }
+
   void DictInfoList::clear() 
   {
     while (head_ != 0) {
@@ -336,9 +405,15 @@ namespace acommon {
                            find_dict_ext(list_all.dict_exts, ".alias")->module));
     }
 
+    if (fill_from_index(list_all)) {
+      head_ = sort_dict_info(head_);
+      return no_err;
+    }
+
     els = list_all.dict_dirs.elements_obj();
     const char * dir;
     while ( (dir = els.next()) != 0) {
+      list_all.dict_index.dict_dir_read(dir);
       Dir d(opendir(dir));
       if (d==0) continue;
     
@@ -358,9 +433,54 @@ namespace acommon {
 			     dir, name, name_size, i->module));
       }
     }
+    // proc_file adds to the front, so entries which compare equal
+    // stay with the last one added first
+    head_ = sort_dict_info(head_);
     return no_err;
   }
 
+  // Adds the dictionaries in the index in front of those from
+  // "dict-alias".  They were written in the order they were sorted
+  // in, and entries which compare equal are kept in the order they
+  // are in before sorting, so the order is the same as if the
+  // directories were read.
+  bool DictInfoList::fill_from_index(MDInfoListAll & list_all)
+  {
+    const Vector<DictIndex::Dict> * dicts 
+      = list_all.dict_index.dicts(list_all.dict_dirs, list_all.dict_exts);
+    if (!dicts) return false;
+    Vector<const ModuleInfo *> modules(dicts->size());
+    for (unsigned i = 0; i != dicts->size(); ++i) {
+      const String & name = (*dicts)[i].module;
+      ModuleInfoNode * mod = list_all.module_info_list.find(name.str(), name.size());
+      if (!mod) return false;
+      modules[i] = &mod->c_struct;
+    }
+    DictInfoNode * * tail = &head_;
+    DictInfoNode * aliases = head_;
+    for (unsigned i = 0; i != dicts->size(); ++i) {
+      const DictIndex::Dict & d = (*dicts)[i];
+      DictInfoNode * to_add = new DictInfoNode();
+      to_add->name      = d.name;
+      to_add->code      = d.code;
+      to_add->variety   = d.variety;
+      to_add->size_str  = d.size_str;
+      to_add->info_file = d.info_file;
+      to_add->direct    = d.direct;
+      to_add->in_dir    = true;
+      to_add->c_struct.name     = to_add->name.str();
+      to_add->c_struct.code     = to_add->code.str();
+      to_add->c_struct.variety  = to_add->variety.str();
+      to_add->c_struct.size_str = to_add->size_str.str();
+      to_add->c_struct.size     = atoi(to_add->c_struct.size_str);
+      to_add->c_struct.module   = modules[i];
+      *tail = to_add;
+      tail = &to_add->next;
+    }
+    *tail = aliases;
+    return true;
+  }
+
   PosibErr<void> DictInfoList::proc_file(MDInfoListAll & list_all,
 					 Config * config,
 					 const char * dir,
@@ -368,7 +488,6 @@ namespace acommon {
 					 unsigned int name_size,
 					 const ModuleInfo * module)
   {
-    DictInfoNode * * prev = &head_;
     StackPtr<DictInfoNode> to_add(new DictInfoNode());
     const char * p0;
     const char * p1;
@@ -411,6 +530,7 @@ namespace acommon {
     // Need to do it here as module is about to get a value
     // if it is null
     to_add->direct = module == 0 ? false : true;
+    to_add->in_dir = dir != 0;
 
     if (!module) {
       assert(p2 != 0); //FIXME: return error
@@ -438,10 +558,9 @@ namespace acommon {
     }
     to_add->info_file += name;
   
-    while (*prev != 0 && *(DictInfoNode *)*prev < *to_add)
-      prev = &(*prev)->next;
-    to_add->next = *prev;
-    *prev = to_add.release();
+    // the list is sorted once everything is added
+    to_add->next = head_;
+    head_ = to_add.release();
 
     return no_err;
   }
@@ -511,16 +630,228 @@ namespace acommon {
     dict_dirs.clear();
     dict_exts.clear();
     dict_info_list.clear();
+    dict_index.clear();
+  }
+
+  /////////////////////////////////////////////////////////////////
+  //
+  // DictIndex Impl
+  //
+
+  static const char * const DICT_INDEX_HEADER = "aspell_dict_index-2";
+
+  static void get_exts_key(const DictExtList & exts, String & key)
+  {
+    key.clear();
+    for (DictExtList::const_iterator i = exts.begin(); i != exts.end(); ++i) {
+      key += ' ';
+      key += i->ext;
+    }
+  }
+
+  static time_t dir_mtime(ParmString dir)
+  {
+    time_t mtime;
+    long size;
+    if (!get_file_info(dir, mtime, size)) mtime = 0;
+    return mtime;
+  }
+
+  DictIndex::DirModules & DictIndex::find(ParmString dir)
+  {
+    Vector<DirModules>::iterator i = dirs_.begin();
+    while (i != dirs_.end() && i->path != dir) ++i;
+    if (i != dirs_.end()) return *i;
+    dirs_.push_back(DirModules());
+    DirModules & d = dirs_.back();
+    d.path = dir;
+    d.mtime = dir_mtime(dir);
+    d.valid = false;
+    d.scanned = false;
+    return d;
+  }
+
+  void DictIndex::read(ParmString file)
+  {
+    clear();
+    FStream in;
+    if (in.open(file, "r").get_err()) return;
+    String line;
+    size_t header_size = strlen(DICT_INDEX_HEADER);
+    if (!in.getline(line) 
+        || strncmp(line.str(), DICT_INDEX_HEADER, header_size) != 0)
+      return;
+    exts_.assign(line.mstr() + header_size, line.size() - header_size);
+    bool complete = false;
+    while (in.getline(line)) {
+      char * l = line.mstr();
+      if (complete) {
+        clear();
+        return;
+      } else if (line == "end") {
+        complete = true;
+      } else if (strncmp(l, "dir ", 4) == 0) {
+        char * end;
+        DirModules d;
+        d.mtime = strtol(l + 4, &end, 10);
+        if (*end != ' ') {clear(); return;}
+        d.path = end + 1;
+        d.valid = d.mtime != -1 && d.mtime == dir_mtime(d.path);
+        d.scanned = d.valid;
+        dirs_.push_back(d);
+      } else if (strncmp(l, "module ", 7) == 0 && !dirs_.empty()) {
+        dirs_.back().files.push_back(l + 7);
+      } else if (strncmp(l, "dict-dir ", 9) == 0) {
+        dict_dirs_.push_back(l + 9);
+      } else if (strncmp(l, "dict ", 5) == 0) {
+        // the fields are separated by tabs
+        char * f[7];
+        f[0] = l + 5;
+        for (unsigned i = 1; i != 7; ++i) {
+          f[i] = strchr(f[i-1], '\t');
+          if (!f[i]) {clear(); return;}
+          *f[i]++ = '\0';
+        }
+        dicts_.push_back(Dict());
+        Dict & d = dicts_.back();
+        d.direct    = f[0][0] == '1';
+        d.name      = f[1];
+        d.code      = f[2];
+        d.variety   = f[3];
+        d.size_str  = f[4];
+        d.module    = f[5];
+        d.info_file = f[6];
+      } else {
+        clear(); 
+        return;
+      }
+    }
+    // the index may be in the middle of being written
+    if (!complete) clear();
+  }
+
+  const Vector<String> & DictIndex::module_files(ParmString dir)
+  {
+    DirModules & d = find(dir);
+    if (d.scanned) return d.files;
+    d.files.clear();
+    d.scanned = true;
+    Dir dh(opendir(dir));
+    if (dh == 0) return d.files;
+    struct dirent * entry;
+    while ( (entry = readdir(dh)) != 0) {
+      const char * name = entry->d_name;
+      unsigned s = strlen(name);
+      if (s > 5 && strcmp(name + s - 5, ".asmi") == 0)
+        d.files.push_back(name);
+    }
+    return d.files;
+  }
+
+  const Vector<DictIndex::Dict> * DictIndex::dicts(const StringList & dirs,
+                                                   const DictExtList & exts)
+  {
+    String key;
+    get_exts_key(exts, key);
+    if (key != exts_) return 0;
+    StringListEnumeration els = dirs.elements_obj();
+    const char * dir;
+    unsigned i = 0;
+    for (; (dir = els.next()) != 0; ++i) {
+      if (i == dict_dirs_.size() || dict_dirs_[i] != dir) return 0;
+      Vector<DirModules>::const_iterator j = dirs_.begin();
+      while (j != dirs_.end() && j->path != dir) ++j;
+      if (j == dirs_.end() || !j->valid) return 0;
+    }
+    if (i != dict_dirs_.size()) return 0;
+    return &dicts_;
+  }
+
+  PosibErr<void> DictIndex::write(ParmString file, 
+                                  const StringList & dict_dirs,
+                                  const DictExtList & exts,
+                                  const DictInfoNode * dicts)
+  {
+    String key;
+    get_exts_key(exts, key);
+    String data = DICT_INDEX_HEADER;
+    data += key;
+    data += '\n';
+    bool ok = true;
+    time_t now = time(0);
+    for (Vector<DirModules>::const_iterator i = dirs_.begin(); i != dirs_.end(); ++i) {
+      if (strchr(i->path.str(), '\n')) ok = false;
+      // a file added within the same second would not change the
+      // modification time, so a directory changed that recently is
+      // always read again
+      data.printf("dir %ld %s\n", 
+                  i->mtime >= now - 1 ? -1L : (long)i->mtime, i->path.str());
+      for (Vector<String>::const_iterator j = i->files.begin(); 
+           j != i->files.end(); ++j) 
+      {
+        if (strchr(j->str(), '\n')) ok = false;
+        data += "module ";
+        data += *j;
+        data += '\n';
+      }
+    }
+    StringListEnumeration els = dict_dirs.elements_obj();
+    const char * dir;
+    while ( (dir = els.next()) != 0) {
+      if (strchr(dir, '\n')) ok = false;
+      data += "dict-dir ";
+      data += dir;
+      data += '\n';
+    }
+    for (const DictInfoNode * n = dicts; n; n = n->next) {
+      if (!n->in_dir) continue;
+      const char * f[6] = {n->name.str(), n->code.str(), n->variety.str(), 
+                           n->size_str.str(), n->c_struct.module->name, 
+                           n->info_file.str()};
+      data += "dict ";
+      data += n->direct ? '1' : '0';
+      for (unsigned i = 0; i != 6; ++i) {
+        if (strpbrk(f[i], "\t\n")) ok = false;
+        data += '\t';
+        data += f[i];
+      }
+      data += '\n';
+    }
+    data += "end\n";
+    if (!ok)
+      return make_err(bad_file_format, file, 
+                      _("a path or name contains a tab or newline"));
+    // The index is replaced with a new file, so that a reader never
+    // sees it partly written.  Since that changes the modification
+    // time of the directory it is in, the index has a directory of
+    // its own, rather than being in the dict-dir, which is in the
+    // index.  The directory is created by write_dict_index.
+    if (!replace_file(file, data.str(), data.size()))
+      return make_err(cant_write_file, file);
+    return no_err;
+  }
+
+  static void get_dict_index_file(Config * c, String & file)
+  {
+    file = c->retrieve("dict-dir");
+    file += "/aspell-index/aspell-dicts.idx";
   }
 
   PosibErr<void> MDInfoListAll::fill(Config * c, 
-                                     StringList & dirs)
+                                     StringList & dirs,
+                                     bool use_index)
   {
     PosibErr<void> err;
 
     err = fill_dict_aliases(c);
     if (err.has_err()) goto RETURN_ERROR;
 
+    if (use_index && c->retrieve_bool("dict-index")) {
+      String index_file;
+      get_dict_index_file(c, index_file);
+      dict_index.read(index_file);
+    }
+
     for_dirs = dirs;
     err = module_info_list.fill(*this, c);
     if (err.has_err()) goto RETURN_ERROR;
@@ -529,6 +860,8 @@ namespace acommon {
     err = dict_info_list.fill(*this, c);
     if (err.has_err()) goto RETURN_ERROR;
 
+    if (use_index)
+      dict_index.clear();
     return err;
 
   RETURN_ERROR:
@@ -536,6 +869,25 @@ namespace acommon {
     return err;
   }
 
+  PosibErr<void> write_dict_index(Config * c)
+  {
+    String index_file;
+    get_dict_index_file(c, index_file);
+    String index_dir(index_file.str(), index_file.rfind('/'));
+    if (!make_index_dir(index_dir))
+      return make_err(cant_write_file, index_file);
+    StringList dirs;
+    get_data_dirs(c, dirs);
+    MDInfoListAll list_all;
+    RET_ON_ERR(list_all.fill(c, dirs, false));
+    PosibErr<void> err = list_all.dict_index.write(index_file, 
+                                                   list_all.dict_dirs,
+                                                   list_all.dict_exts,
+                                                   list_all.dict_info_list.head_);
+    list_all.clear();
+    return err;
+  }
+
   void MDInfoListAll::fill_helper_lists(const StringList & def_dirs)
   {
     dict_dirs = def_dirs;
@@ -88,6 +88,7 @@ namespace acommon {
 			     const char * name,
 			     unsigned int name_size,
 			     const ModuleInfo *);
+    bool fill_from_index(MDInfoListAll &);
   public: // but don't use
     unsigned int size_;
     DictInfoNode * head_;
@@ -97,6 +98,9 @@ namespace acommon {
 
   const StringMap * get_dict_aliases(Config *);
 
+  // writes the index of the dictionaries in the dict-dir, see info.cpp
+  PosibErr<void> write_dict_index(Config *);
+
   class ModuleInfoEnumeration {
   public:
     typedef const ModuleInfo * Value;
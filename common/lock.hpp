@@ -21,6 +21,7 @@
 
 #ifdef USE_POSIX_MUTEX
 #  include <pthread.h>
+#  include <sched.h>
 #endif
 
 namespace acommon {
@@ -33,12 +34,45 @@ namespace acommon {
   private:
     Mutex(const Mutex &);
     void operator=(const Mutex &);
+    friend class Cond;
   public:
     Mutex() {pthread_mutex_init(&l_, 0);}
     ~Mutex() {pthread_mutex_destroy(&l_);}
     void lock() {pthread_mutex_lock(&l_);}
     void unlock() {pthread_mutex_unlock(&l_);}
   };
+
+  class Cond {
+    pthread_cond_t c_;
+  private:
+    Cond(const Cond &);
+    void operator=(const Cond &);
+  public:
+    Cond() {pthread_cond_init(&c_, 0);}
+    ~Cond() {pthread_cond_destroy(&c_);}
+    // the mutex must be locked by the caller
+    void wait(Mutex * l) {pthread_cond_wait(&c_, &l->l_);}
+    void broadcast() {pthread_cond_broadcast(&c_);}
+  };
+
+  // Atomic operations on integers and pointers, these use the GCC
+  // builtins which are also provided by Clang and other compilers.
+  // "atomic_add" returns the new value and "atomic_cas" stores "n" in
+  // "v" only if it equals "expected", otherwise "expected" is set to
+  // the current value.
+
+  template <typename T> inline T atomic_load(const T & v) 
+    {return __atomic_load_n(&v, __ATOMIC_ACQUIRE);}
+  template <typename T> inline void atomic_store(T & v, T n) 
+    {__atomic_store_n(&v, n, __ATOMIC_RELEASE);}
+  template <typename T> inline T atomic_add(T & v, T n) 
+    {return __atomic_add_fetch(&v, n, __ATOMIC_SEQ_CST);}
+  template <typename T> inline bool atomic_cas(T & v, T & expected, T n)
+    {return __atomic_compare_exchange_n(&v, &expected, n, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);}
+  inline void atomic_fence() {__atomic_thread_fence(__ATOMIC_SEQ_CST);}
+  inline void thread_yield() {sched_yield();}
+
 #else
   class Mutex {
   private:
@@ -50,6 +84,27 @@ namespace acommon {
     void lock() {}
     void unlock() {}
   };
+
+  class Cond {
+  private:
+    Cond(const Cond &);
+    void operator=(const Cond &);
+  public:
+    Cond() {}
+    ~Cond() {}
+    void wait(Mutex *) {}
+    void broadcast() {}
+  };
+
+  template <typename T> inline T atomic_load(const T & v) {return v;}
+  template <typename T> inline void atomic_store(T & v, T n) {v = n;}
+  template <typename T> inline T atomic_add(T & v, T n) {return v += n;}
+  template <typename T> inline bool atomic_cas(T & v, T & expected, T n) {
+    if (v != expected) {expected = v; return false;}
+    v = n; return true;
+  }
+  inline void atomic_fence() {}
+  inline void thread_yield() {}
 #endif
 
   class Lock {
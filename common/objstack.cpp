@@ -31,7 +31,7 @@ ObjStack::~ObjStack()
   trim();
 }
 
-size_t ObjStack::calc_size()
+size_t ObjStack::calc_size() const
 {
   size_t size = 0;
   for (Node * p = first; p; p = p->next)
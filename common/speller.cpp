@@ -8,11 +8,16 @@
 #include "convert.hpp"
 #include "clone_ptr-t.hpp"
 #include "config.hpp"
+#include "filter.hpp"
 
 namespace acommon {
 
-  Speller::Speller(SpellerLtHandle h) : lt_handle_(h) {}
+  Speller::Speller(SpellerLtHandle h) 
+    : lt_handle_(h), filter_cache_(new FilterCache) {}
 
-  Speller::~Speller() {}
+  Speller::~Speller() 
+  {
+    delete filter_cache_;
+  }
 }
 
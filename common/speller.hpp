@@ -32,6 +32,7 @@ namespace acommon {
   class Convert;
   class Tokenizer;
   class Filter;
+  class FilterCache;
   class DocumentChecker;
 
   struct CheckInfo {
@@ -60,6 +61,9 @@ namespace acommon {
     String temp_str_1;
     ClonePtr<Convert> to_internal_;
     ClonePtr<Convert> from_internal_;
+    // filters set up for other filter options, used by reload_filters
+    // and the document checkers
+    FilterCache * filter_cache_;
   protected:
     CopyPtr<Config> config_;
     Speller(SpellerLtHandle h);
@@ -80,6 +84,16 @@ namespace acommon {
     // should be called only after this class is setup
     virtual void setup_tokenizer(Tokenizer *) = 0;
 
+    // checks "num" words at once, which unlike the methods below are
+    // in the external encoding, setting bit i of "out" if words[i] is
+    // correct and returning the number of words which are not.
+    // lens[i] is the size of words[i] in bytes, or -1 if it is null
+    // terminated, as for aspell_speller_check.  The results are always
+    // the same as checking each word on its own.
+    virtual PosibErr<unsigned> check_batch(const char * const * words, 
+                                           const int * lens, unsigned num,
+                                           unsigned char * out) = 0;
+
     ////////////////////////////////////////////////////////////////
     // 
     // Strings from this point on are expected to be in the 
@@ -114,6 +128,18 @@ namespace acommon {
     virtual PosibErr<void> store_replacement(MutableString, 
 					     MutableString) = 0;
 
+    // pins, or unpins, the language data and dictionaries used in the
+    // global cache so that they stay loaded when no longer used
+    virtual void pin_cache_data(bool) = 0;
+
+    // returns a new speller, set up the same way, which shares all the
+    // data it can with this one, the encoder and decoder filters are
+    // not set up, use clone_speller instead.  If "word_lists" is
+    // given the options in it which name the personal and replacement
+    // word lists are used instead of the ones of this speller, see
+    // new_overlay_speller
+    virtual PosibErr<Speller *> clone(const Config * word_lists = 0) const = 0;
+
     virtual ~Speller();
 
   };
@@ -121,11 +147,30 @@ namespace acommon {
 
   // This function is current a hack to reload the filters in the
   // speller class.  I hope to eventually find a better way.
+  // The filters are kept in the speller's filter cache so switching
+  // back to an earlier mode does not set them up again.
   PosibErr<void> reload_filters(Speller * m);
 
 
   PosibErr<Speller *> new_speller(Config * c);
 
+  // creates a new speller as if new_speller was called with a copy of
+  // the speller's config, but much faster, as everything which is
+  // not specific to a single speller is shared
+  PosibErr<Speller *> clone_speller(const Speller * m);
+
+  // creates a speller which shares everything with "base" except for
+  // its session, personal and replacement word lists, which are named
+  // by the options in "c" (all other options in "c" are ignored).  The
+  // memory used by the new speller is mostly that of its own words,
+  // which it checks before those of the main dictionaries.
+  PosibErr<Speller *> new_overlay_speller(const Speller * base, const Config * c);
+
+  // loads everything needed by a speller for the given config into
+  // the global caches, if "pin" is true it is also pinned otherwise
+  // anything pinned is unpinned
+  PosibErr<void> preload_cache(Config * c, bool pin);
+
 }
 
 #endif
@@ -0,0 +1,183 @@
+/* This file is part of The New Aspell and is distributed under the
+ * GNU LGPL license version 2.0 or 2.1.  You should have received a copy
+ * of the LGPL license along with this library if you did not you can
+ * find it at http://www.gnu.org/.
+*/
+
+/* Times aspell_speller_check and, when using the GNU C library,
+ * counts the number of heap allocations made per check.  After the
+ * first pass over the words (which fills any caches and grows any
+ * scratch buffers) this should be zero.  If the environment variable
+ * CHECK_BENCH_BATCH is set the words are checked in batches of that
+ * size using aspell_speller_check_batch instead, after first making
+ * sure that gives the same results as aspell_speller_check, word by
+ * word.  For that check every other word is given a length of -1. */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "aspell.h"
+
+#ifdef __GLIBC__
+
+extern void * __libc_malloc(size_t);
+extern void * __libc_calloc(size_t, size_t);
+extern void * __libc_realloc(void *, size_t);
+
+static unsigned long num_allocs = 0;
+
+void * malloc(size_t size)
+{
+  ++num_allocs;
+  return __libc_malloc(size);
+}
+
+void * calloc(size_t num, size_t size)
+{
+  ++num_allocs;
+  return __libc_calloc(num, size);
+}
+
+void * realloc(void * ptr, size_t size)
+{
+  ++num_allocs;
+  return __libc_realloc(ptr, size);
+}
+
+#define HAVE_ALLOC_COUNT
+
+#endif
+
+int main(int argc, const char *argv[])
+{
+  AspellCanHaveError * ret;
+  AspellSpeller * speller;
+  AspellConfig * config;
+  FILE * in;
+  char * buf;
+  long buf_size;
+  const char * * words;
+  int * lens;
+  int num = 0, i, j, pass, passes = 10, misspelled = 0;
+  int batch = 0;
+  unsigned char * bitmap = 0;
+  int * lens_or_nul = 0;
+  char * p;
+  clock_t start, finish;
+  double secs;
+  unsigned long allocs = 0;
+
+  if (argc < 3) {
+    printf("Usage: %s <language> <word-file> [<passes> [<encoding>]]\n", argv[0]);
+    return 1;
+  }
+  if (argc > 3)
+    passes = atoi(argv[3]);
+  if (getenv("CHECK_BENCH_BATCH"))
+    batch = atoi(getenv("CHECK_BENCH_BATCH"));
+
+  in = fopen(argv[2], "rb");
+  if (!in) {
+    printf("Error: Can't open %s\n", argv[2]);
+    return 1;
+  }
+  fseek(in, 0, SEEK_END);
+  buf_size = ftell(in);
+  fseek(in, 0, SEEK_SET);
+  buf = (char *)malloc(buf_size + 1);
+  buf_size = fread(buf, 1, buf_size, in);
+  buf[buf_size] = '\0';
+  fclose(in);
+
+  words = (const char * *)malloc(sizeof(char *) * (buf_size / 2 + 1));
+  lens  = (int *)malloc(sizeof(int) * (buf_size / 2 + 1));
+  for (p = buf; *p; ) {
+    char * e = strchr(p, '\n');
+    if (!e) e = p + strlen(p);
+    if (e != p) {
+      words[num] = p;
+      lens[num] = e - p;
+      ++num;
+    }
+    if (!*e) break;
+    *e = '\0';
+    p = e + 1;
+  }
+
+  config = new_aspell_config();
+  aspell_config_replace(config, "lang", argv[1]);
+  if (argc > 4)
+    aspell_config_replace(config, "encoding", argv[4]);
+  ret = new_aspell_speller(config);
+  delete_aspell_config(config);
+  if (aspell_error(ret) != 0) {
+    printf("Error: %s\n", aspell_error_message(ret));
+    delete_aspell_can_have_error(ret);
+    return 2;
+  }
+  speller = to_aspell_speller(ret);
+
+  /* the first pass is not timed */
+  for (i = 0; i != num; ++i)
+    misspelled += aspell_speller_check(speller, words[i], lens[i]) == 0;
+
+  if (batch > 0) {
+    bitmap = (unsigned char *)malloc((batch + 7) / 8);
+    /* the words are null terminated so a length of -1 can be used */
+    lens_or_nul = (int *)malloc(sizeof(int) * (num + 1));
+    for (i = 0; i != num; ++i)
+      lens_or_nul[i] = i % 2 ? -1 : lens[i];
+    for (i = 0; i < num; i += batch) {
+      int n = num - i < batch ? num - i : batch;
+      aspell_speller_check_batch(speller, words + i, lens_or_nul + i, n, bitmap);
+      for (j = 0; j != n; ++j) {
+        int res = (bitmap[j/8] >> (j%8)) & 1;
+        if (res != aspell_speller_check(speller, words[i+j], lens[i+j])) {
+          printf("Error: batch result differs for \"%s\"\n", words[i+j]);
+          return 3;
+        }
+      }
+    }
+  }
+
+#ifdef HAVE_ALLOC_COUNT
+  num_allocs = 0;
+#endif
+  start = clock();
+  for (pass = 0; pass != passes; ++pass) {
+    if (batch > 0) {
+      for (i = 0; i < num; i += batch)
+        aspell_speller_check_batch(speller, words + i, lens + i,
+                                   num - i < batch ? num - i : batch, bitmap);
+    } else {
+      for (i = 0; i != num; ++i)
+        aspell_speller_check(speller, words[i], lens[i]);
+    }
+  }
+  finish = clock();
+#ifdef HAVE_ALLOC_COUNT
+  allocs = num_allocs;
+#endif
+
+  secs = (finish - start) / (double)CLOCKS_PER_SEC;
+  printf("words: %d (%d misspelled)\n", num, misspelled);
+  printf("checks: %ld\n", (long)num * passes);
+  printf("time: %f s (%.1f ns per check)\n",
+         secs, secs * 1e9 / ((double)num * passes));
+#ifdef HAVE_ALLOC_COUNT
+  printf("allocations per check: %f\n", allocs / ((double)num * passes));
+#else
+  printf("allocations per check: unknown\n");
+#endif
+
+  delete_aspell_speller(speller);
+  free(words);
+  free(lens);
+  free(bitmap);
+  free(lens_or_nul);
+  free(buf);
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+/* This file is part of The New Aspell and is distributed under the
+ * GNU LGPL license version 2.0 or 2.1.  You should have received a copy
+ * of the LGPL license along with this library if you did not you can
+ * find it at http://www.gnu.org/.
+*/
+
+/* Compares the time it takes to create (and delete) a speller with
+ * new_aspell_speller to the time it takes with aspell_speller_clone.
+ * The spellers are checked against each other with the words given
+ * on the command line. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "aspell.h"
+
+static double elapsed(clock_t start)
+{
+  return (clock() - start) / (double)CLOCKS_PER_SEC;
+}
+
+static AspellSpeller * check_ret(AspellCanHaveError * ret)
+{
+  if (aspell_error(ret) != 0) {
+    printf("Error: %s\n", aspell_error_message(ret));
+    delete_aspell_can_have_error(ret);
+    exit(2);
+  }
+  return to_aspell_speller(ret);
+}
+
+int main(int argc, const char *argv[])
+{
+  AspellConfig * config;
+  AspellSpeller * speller, * other;
+  int i, j, num = 1000;
+  clock_t start;
+  double new_secs, clone_secs;
+
+  if (argc < 2) {
+    printf("Usage: %s <language> [<num> [<word> ...]]\n", argv[0]);
+    return 1;
+  }
+  if (argc > 2)
+    num = atoi(argv[2]);
+
+  config = new_aspell_config();
+  aspell_config_replace(config, "lang", argv[1]);
+  speller = check_ret(new_aspell_speller(config));
+
+  start = clock();
+  for (i = 0; i != num; ++i)
+    delete_aspell_speller(check_ret(new_aspell_speller(config)));
+  new_secs = elapsed(start);
+
+  start = clock();
+  for (i = 0; i != num; ++i)
+    delete_aspell_speller(check_ret(aspell_speller_clone(speller)));
+  clone_secs = elapsed(start);
+
+  other = check_ret(aspell_speller_clone(speller));
+  for (j = 3; j < argc; ++j) {
+    if (aspell_speller_check(speller, argv[j], -1)
+        != aspell_speller_check(other, argv[j], -1)) {
+      printf("Error: clone gives a different result for \"%s\"\n", argv[j]);
+      return 3;
+    }
+  }
+  delete_aspell_speller(other);
+
+  printf("new_aspell_speller:   %.1f us per speller\n", new_secs * 1e6 / num);
+  printf("aspell_speller_clone: %.1f us per speller\n", clone_secs * 1e6 / num);
+
+  delete_aspell_speller(speller);
+  delete_aspell_config(config);
+
+  return 0;
+}
@@ -398,6 +398,12 @@ namespace acommon {
 
       while ( (entry = dels->next()) != 0) {
 
+        // the list is sorted by code, so only the entries whose code
+        // starts with the language need to be ranked
+        int cmp = strncmp(entry->code, lang.str(), lang.size());
+        if (cmp < 0) continue;
+        if (cmp > 0) break;
+
         b_code  .cur = entry->code;
         b_module.cur = entry->module->name;
 
@@ -462,13 +468,11 @@ namespace acommon {
 
   PosibErr<void> reload_filters(Speller * m) 
   {
-    m->to_internal_->filter.clear();
-    m->from_internal_->filter.clear();
     // Add enocder and decoder filters if any
     RET_ON_ERR(setup_filter(m->to_internal_->filter, m->config(), 
-			    true, false, false));
+                            m->filter_cache_, true, false, false));
     RET_ON_ERR(setup_filter(m->from_internal_->filter, m->config(), 
-			    false, false, true));
+                            m->filter_cache_, false, false, true));
     return no_err;
   }
 
@@ -485,10 +489,40 @@ namespace acommon {
     return m.release();
   }
 
+  PosibErr<Speller *> clone_speller(const Speller * m0)
+  {
+    RET_ON_ERR_SET(m0->clone(), Speller *, m1);
+    StackPtr<Speller> m(m1);
+    RET_ON_ERR(reload_filters(m));
+    return m.release();
+  }
+
+  PosibErr<Speller *> new_overlay_speller(const Speller * base, const Config * c)
+  {
+    RET_ON_ERR_SET(base->clone(c), Speller *, m1);
+    StackPtr<Speller> m(m1);
+    RET_ON_ERR(reload_filters(m));
+    return m.release();
+  }
+
   void delete_speller(Speller * m) 
   {
     SpellerLtHandle h = ((Speller *)(m))->lt_handle();
     delete m;
     if (h != 0) free_lt_handle(h);
   }
+
+  PosibErr<void> preload_cache(Config * c, bool pin)
+  {
+    RET_ON_ERR_SET(new_speller(c), Speller *, m);
+    m->pin_cache_data(pin);
+    delete_speller(m);
+    return no_err;
+  }
+
+  extern "C" CanHaveError * aspell_preload_cache(Config * c, int pin)
+  {
+    PosibErr<void> ret = preload_cache(c, pin);
+    return new CanHaveError(ret.release_err());
+  }
 }
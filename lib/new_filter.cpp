@@ -209,6 +209,74 @@ namespace acommon
     return no_err;
   }
 
+  // returns the module with the options of the filter "name", or
+  // null if there is none
+  static const ConfigModule * filter_module(Config * config, ParmStr name)
+  {
+#ifdef HAVE_LIBDL
+    PosibErr<const ConfigModule *> pe = get_dynamic_filter(config, name);
+    if (pe.has_err()) {pe.ignore_err(); return 0;}
+    return pe.data;
+#else
+    for (const ConfigModule * cur = config->filter_modules.pbegin();
+         cur != config->filter_modules.pend();
+         ++cur)
+    {
+      if (strcmp(cur->name, name) == 0) return cur;
+    }
+    return 0;
+#endif
+  }
+
+  // Sets "key" to a string which identifies the filters setup_filter
+  // would set up, that is the kinds of filters used, the list of
+  // filters and the values of all of their options.
+  static void filter_key(Config * config, 
+                         bool use_decoder, bool use_filter, bool use_encoder,
+                         String & key)
+  {
+    key.clear();
+    key += use_decoder ? 'd' : '-';
+    key += use_filter  ? 'f' : '-';
+    key += use_encoder ? 'e' : '-';
+    StringList sl;
+    config->retrieve_list("filter", &sl);
+    StringListEnumeration els = sl.elements_obj();
+    const char * filter_name;
+    while ((filter_name = els.next()) != 0) {
+      key += '\0';
+      key += filter_name;
+      const ConfigModule * m = filter_module(config, filter_name);
+      if (!m) continue;
+      for (const KeyInfo * i = m->begin; i != m->end; ++i) {
+        PosibErr<String> value = config->retrieve_any(i->name);
+        if (value.has_err()) {value.ignore_err(); continue;}
+        key += '\0';
+        key += i->name;
+        key += '=';
+        key += value.data;
+      }
+    }
+  }
+
+  PosibErr<void> setup_filter(Filter & filter, Config * config, 
+                              FilterCache * cache,
+			      bool use_decoder, bool use_filter, bool use_encoder)
+  {
+    String key;
+    filter_key(config, use_decoder, use_filter, use_encoder, key);
+    if (filter.key != key) {
+      cache->put(filter);
+      if (!cache->get(key, filter)) {
+        RET_ON_ERR(setup_filter(filter, config, 
+                                use_decoder, use_filter, use_encoder));
+        filter.key = key;
+      }
+    }
+    filter.reset();
+    return no_err;
+  }
+
   //////////////////////////////////////////////////////////////////////////
   //
   // get filter
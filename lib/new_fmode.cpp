@@ -11,6 +11,9 @@
 #  include <regex.h>
 #endif
 
+#include <algorithm>
+#include <time.h>
+
 #include "stack_ptr.hpp"
 #include "cache-t.hpp"
 #include "string.hpp"
@@ -27,6 +30,7 @@
 #include "strtonum.hpp"
 #include "asc_ctype.hpp"
 #include "iostream.hpp"
+#include "bin_data.hpp"
 
 #include "gettext.h"
 
@@ -39,7 +43,6 @@ namespace acommon {
       MagicString(const String & mode) : mode_(mode), fileExtensions() {}
       MagicString(const String & magic, const String & mode)
         : magic_(magic), mode_(mode) {} 
-      bool matchFile(FILE * in, const String & ext);
       static PosibErr<bool> testMagic(FILE * seekIn, String & magic, const String & mode);
       void addExtension(const String & ext) { fileExtensions.push_back(ext); }
       bool hasExtension(const String & ext);
@@ -53,6 +56,7 @@ namespace acommon {
       }
       const String & magic() const { return magic_; }
       const String & magicMode() const { return mode_; }
+      const Vector<String> & getExtensions() const { return fileExtensions; }
       ~MagicString() {}
     private:
       String magic_;
@@ -63,13 +67,16 @@ namespace acommon {
     FilterMode(const String & name);
     PosibErr<bool> addModeExtension(const String & ext, String toMagic);
     PosibErr<bool> remModeExtension(const String & ext, String toMagic);
-    bool lockFileToMode(const String & fileName,FILE * in = NULL);
     const String & modeName() const;
     void setDescription(const String & desc) {desc_ = desc;}
     const String & getDescription() const {return desc_;}
+    const Vector<MagicString> & getMagicKeys() const {return magicKeys;}
     PosibErr<void> expand(Config * config);
     PosibErr<void> build(FStream &, int line = 1, 
                          const char * fname = "mode file");
+    // for the mode index, see write_mode_index
+    void write(BinDataOut &) const;
+    void read(BinDataIn &);
 
     ~FilterMode();
   private:
@@ -97,6 +104,28 @@ namespace acommon {
     bool cache_key_eq(const String & okey) const {
       return key == okey;
     }
+    // must be called once all modes are added
+    void build_ext_table();
+    // returns the first mode which has one of the extensions of
+    // "filename", or 0 if there is none
+    const FilterMode * find_mode(ParmString filename) const;
+  private:
+    // the extensions of all modes, sorted by extension and then mode
+    // so that the first entry for an extension is the mode used
+    struct ExtMode {
+      const char * ext;
+      unsigned mode;
+    };
+    struct ExtModeLess {
+      bool operator() (const ExtMode & x, const ExtMode & y) const {
+        int cmp = strcmp(x.ext, y.ext);
+        return cmp < 0 || (cmp == 0 && x.mode < y.mode);
+      }
+      bool operator() (const ExtMode & x, const char * y) const {
+        return strcmp(x.ext, y) < 0;
+      }
+    };
+    Vector<ExtMode> ext_table_;
   };
 
   class ModeNotifierImpl : public Notifier
@@ -207,58 +236,6 @@ namespace acommon {
     return false;
   }
 
-  bool FilterMode::lockFileToMode(const String & fileName,FILE * in) {
-
-    Vector<unsigned int> extStart;
-    int first_point = fileName.size();
-
-    while ( first_point > 0 ) {
-      while (    ( --first_point >= 0 )
-              && ( fileName[first_point] != '.' ) ) {
-      }
-      if (    ( first_point >= 0 )
-           && ( fileName[first_point] == '.' ) ) {
-        extStart.push_back(first_point + 1);
-      }
-    }
-    if ( extStart.size() < 1 )  {
-      return false;
-    }
-
-    bool closeFile = false;
-
-    if ( in == NULL ) {
-      in = fopen(fileName.str(),"rb");
-      closeFile= true;
-    }
-    for ( Vector<unsigned int>::iterator extSIt = extStart.begin() ;
-          extSIt != extStart.end() ; extSIt ++ ) {
-    
-      String ext(fileName);
-
-      ext.erase(0,*extSIt);
-      for ( Vector<MagicString>::iterator it = magicKeys.begin() ;
-            it != magicKeys.end() ; it++ ) {
-        PosibErr<bool> magicMatch = it->matchFile(in,ext);
-        if (    magicMatch 
-             || magicMatch.has_err() ) {
-          if ( closeFile ) {
-            fclose ( in );
-          }
-          if ( magicMatch.has_err() ) {
-            magicMatch.ignore_err();
-            return false;
-          }
-          return true;
-        }
-      }
-    }
-    if ( closeFile ) {
-      fclose(in);
-    }
-    return false;
-  }
-
   const String & FilterMode::modeName() const {
     return name_;
   }
@@ -288,30 +265,6 @@ namespace acommon {
   }
 
 
-  bool FilterMode::MagicString::matchFile(FILE * in,const String & ext) {
-
-    Vector<String>::iterator extIt;
-
-    for ( extIt = fileExtensions.begin() ; 
-          extIt != fileExtensions.end() ; extIt ++ ) {
-      if ( *extIt == ext ) {
-        break;
-      }
-    }
-    if ( extIt == fileExtensions.end() ) {
-      return false;
-    }
-
-    PosibErr<bool> pe = testMagic(in,magic_,mode_);
-
-    if ( pe.has_err() ) {
-      pe.ignore_err();
-      return false;
-    }
-    return true;
-  }
-
-
   PosibErr<bool> FilterMode::MagicString::testMagic(FILE * seekIn,String & magic, const String & mode) {
 
 #ifdef USE_POSIX_REGEX
@@ -480,20 +433,96 @@ namespace acommon {
     return no_err;
   }
 
+  void FilterMode::write(BinDataOut & out) const {
+
+    out.put_str(name_);
+    out.put_str(desc_);
+    out.put_str(file_);
+    out.put(magicKeys.size());
+    for ( Vector<MagicString>::const_iterator it = magicKeys.begin() ;
+          it != magicKeys.end() ; it++ ) {
+      out.put_str(it->magic());
+      out.put(it->getExtensions().size());
+      for ( Vector<String>::const_iterator extIt = it->getExtensions().begin() ;
+            extIt != it->getExtensions().end() ; extIt++ ) {
+        out.put_str(*extIt);
+      }
+    }
+    out.put(expansion.size());
+    for ( Vector<KeyValue>::const_iterator it = expansion.begin() ;
+          it != expansion.end() ; it++ ) {
+      out.put_str(it->key);
+      out.put_str(it->value);
+    }
+  }
+
+  void FilterMode::read(BinDataIn & in) {
+
+    name_ = in.get_str();
+    desc_ = in.get_str();
+    file_ = in.get_str();
+    unsigned int num = in.get_count(2 * sizeof(unsigned int) + 1);
+    for ( unsigned int i = 0 ; i != num ; i++ ) {
+      magicKeys.push_back(MagicString(in.get_str(), name_));
+      unsigned int numExt = in.get_count(sizeof(unsigned int) + 1);
+      for ( unsigned int j = 0 ; j != numExt ; j++ ) {
+        magicKeys.back().addExtension(in.get_str());
+      }
+    }
+    num = in.get_count(2 * (sizeof(unsigned int) + 1));
+    for ( unsigned int i = 0 ; i != num ; i++ ) {
+      String key = in.get_str();
+      expansion.push_back(KeyValue(key, in.get_str()));
+    }
+  }
+
+  void FilterModeList::build_ext_table() 
+  {
+    ext_table_.clear();
+    for (unsigned i = 0; i != size(); ++i) {
+      const Vector<FilterMode::MagicString> & keys = (*this)[i].getMagicKeys();
+      for (unsigned j = 0; j != keys.size(); ++j) {
+        const Vector<String> & exts = keys[j].getExtensions();
+        for (unsigned k = 0; k != exts.size(); ++k) {
+          ExtMode em = {exts[k].str(), i};
+          ext_table_.push_back(em);
+        }
+      }
+    }
+    std::sort(ext_table_.begin(), ext_table_.end(), ExtModeLess());
+  }
+
+  // The magic keys are only checked when the mode files are read.  A
+  // file matches a key if it has one of its extensions whether or not
+  // its contents match, so the contents are not looked at here.
+  const FilterMode * FilterModeList::find_mode(ParmString filename) const
+  {
+    unsigned best = size();
+    const char * begin = filename.str();
+    const char * p = begin + filename.size();
+    // every part after a '.' is tried as an extension
+    while (p != begin) {
+      --p;
+      if (*p != '.') continue;
+      Vector<ExtMode>::const_iterator i 
+        = std::lower_bound(ext_table_.begin(), ext_table_.end(), p + 1, 
+                           ExtModeLess());
+      if (i != ext_table_.end() && strcmp(i->ext, p + 1) == 0 && i->mode < best)
+        best = i->mode;
+    }
+    return best < size() ? &(*this)[best] : 0;
+  }
+
   static GlobalCache<FilterModeList> filter_modes_cache("filter_modes");
 
-  PosibErr<void> set_mode_from_extension (Config * config, ParmString filename, FILE * in) 
+  PosibErr<void> set_mode_from_extension (Config * config, ParmString filename) 
   {
     RET_ON_ERR_SET(static_cast<ModeNotifierImpl *>(config->filter_mode_notifier)
                    ->get_filter_modes(), FilterModeList *, fm);
 
-    for ( FilterModeList::iterator it = fm->begin(); it != fm->end(); it++ ) 
-    {
-      if ( it->lockFileToMode(filename,in) ) {
-        RET_ON_ERR(config->replace("mode", it->modeName().str()));
-        break;
-      }
-    }
+    const FilterMode * mode = fm->find_mode(filename);
+    if (mode)
+      RET_ON_ERR(config->replace("mode", mode->modeName().str()));
     return no_err;
   }
 
@@ -539,14 +568,131 @@ namespace acommon {
     return no_err;
   }
 
-  PosibErr<FilterModeList *> FilterModeList::get_new(const String & key,
-                                                     const Config *) 
+  //
+  // The mode files can be kept in an index, so that they do not need
+  // to be read, and their magic keys checked, every time Aspell
+  // starts.  The index is only written by write_mode_index, which is
+  // used by "aspell build-index".  As the modes found depend on the
+  // filter path there is one index for each filter path, named after
+  // a hash of it, in the "aspell-index" directory of the dict-dir.
+  // The index records the filter path, and the modification times of
+  // the directories in it and of the mode files read, and is only
+  // used if none changed.
+  //
+
+  static const char * const MODE_INDEX_MAGIC = "aspell mode index";
+  static const unsigned int MODE_INDEX_VERSION = 1;
+  static const unsigned int MODE_INDEX_BYTE_ORDER = 0x01020304;
+
+  static void get_source_info(ParmString name, unsigned int & size, 
+                              unsigned int & mtime)
   {
+    time_t t;
+    long s;
+    if (!get_file_info(name, t, s)) {t = 0; s = -1;}
+    size = s;
+    mtime = t;
+  }
 
-    StackPtr<FilterModeList> filter_modes(new FilterModeList);
-    filter_modes->key = key;
+  static void get_mode_index_file(const Config * config, ParmString key,
+                                  String & file)
+  {
+    // FNV-1a
+    unsigned int h = 2166136261u;
+    for (const char * s = key; *s; ++s)
+      h = (h ^ (unsigned char)*s) * 16777619u;
+    file = config->retrieve("dict-dir");
+    file.printf("/aspell-index/aspell-modes-%08x.idx", h);
+  }
+
+  // returns false if the index is out of date or otherwise unusable
+  static bool read_mode_index(ParmString file, FilterModeList & modes)
+  {
+    FStream f;
+    if (f.open(file, "r").get_err()) return false;
+    f.seek(0, SEEK_END);
+    String data;
+    data.resize(f.tell());
+    f.seek(0);
+    if (!f.read(data.data(), data.size())) return false;
+    BinDataIn in(data.data(), data.data() + data.size());
+
+    if (strcmp(in.get_str(), MODE_INDEX_MAGIC) != 0
+        || in.get() != MODE_INDEX_VERSION
+        || in.get() != MODE_INDEX_BYTE_ORDER
+        || strcmp(in.get_str(), PACKAGE_VERSION) != 0
+        || modes.key != in.get_str())
+      return false;
+
+    unsigned int num = in.get_count(3 * sizeof(unsigned int) + 1);
+    for (unsigned int i = 0; i != num; ++i) {
+      const char * name = in.get_str();
+      unsigned int size = in.get();
+      unsigned int mtime = in.get();
+      unsigned int cur_size, cur_mtime;
+      get_source_info(name, cur_size, cur_mtime);
+      if (in.bad() || cur_size != size || cur_mtime != mtime)
+        return false;
+    }
+
+    num = in.get_count(5 * sizeof(unsigned int) + 3);
+    for (unsigned int i = 0; i != num; ++i) {
+      modes.push_back(FilterMode(""));
+      modes.back().read(in);
+    }
+    if (in.bad() || !in.at_end()) {
+      modes.clear();
+      return false;
+    }
+    return true;
+  }
+
+  // "sources" are the directories and the mode files which were read
+  static PosibErr<void> write_mode_index(ParmString file,
+                                         const FilterModeList & modes,
+                                         const Vector<String> & sources)
+  {
+    BinDataOut out;
+    out.put_str(MODE_INDEX_MAGIC);
+    out.put(MODE_INDEX_VERSION);
+    out.put(MODE_INDEX_BYTE_ORDER);
+    out.put_str(PACKAGE_VERSION);
+    out.put_str(modes.key);
+
+    time_t now = time(0);
+    out.put(sources.size());
+    for (unsigned i = 0; i != sources.size(); ++i) {
+      unsigned int size, mtime;
+      get_source_info(sources[i], size, mtime);
+      // a change within the same second would not change the
+      // modification time, so do not trust a time that recent, the
+      // index will not be used until it is written again
+      if ((time_t)mtime >= now - 1) mtime = (unsigned int)-1;
+      out.put_str(sources[i]);
+      out.put(size);
+      out.put(mtime);
+    }
+
+    out.put(modes.size());
+    for (unsigned i = 0; i != modes.size(); ++i)
+      modes[i].write(out);
+
+    if (!replace_file(file, out.data().data(), out.data().size()))
+      return make_err(cant_write_file, file);
+    return no_err;
+  }
+
+  // reads the mode files in the directories of "modes.key", "sources"
+  // is set to the directories and the mode files which were read
+  static PosibErr<void> read_mode_files(FilterModeList & modes,
+                                        Vector<String> & sources)
+  {
     StringList mode_path;
-    separate_list(key, mode_path);
+    separate_list(modes.key, mode_path);
+    StringListEnumeration dirs = mode_path.elements_obj();
+    const char * dir;
+    while ((dir = dirs.next()) != NULL)
+      sources.push_back(dir);
     
     PathBrowser els(mode_path, ".amf");
 
@@ -569,15 +715,15 @@ namespace acommon {
       possMode.erase(0,pathPos);
       to_lower(possMode.mstr());
 
-      Vector<FilterMode>::iterator fmIt = filter_modes->begin();
+      Vector<FilterMode>::iterator fmIt = modes.begin();
 
-      for ( fmIt = filter_modes->begin() ; 
-            fmIt != filter_modes->end() ; fmIt++ ) {
+      for ( fmIt = modes.begin() ; 
+            fmIt != modes.end() ; fmIt++ ) {
         if ( (*fmIt).modeName() == possMode ) {
           break;
         }
       }
-      if ( fmIt != filter_modes->end() ) {
+      if ( fmIt != modes.end() ) {
         continue;
       }
 
@@ -737,11 +883,59 @@ namespace acommon {
       
       RET_ON_ERR(collect.build(toParse,dp.line_num,possModeFile.str()));
 
-      filter_modes->push_back(collect);
+      modes.push_back(collect);
+      sources.push_back(possModeFile);
     }
+    return no_err;
+  }
+
+  PosibErr<FilterModeList *> FilterModeList::get_new(const String & key,
+                                                     const Config * config) 
+  {
+
+    StackPtr<FilterModeList> filter_modes(new FilterModeList);
+    filter_modes->key = key;
+
+    if (config->retrieve_bool("mode-index")) {
+      String index_file;
+      get_mode_index_file(config, key, index_file);
+      if (read_mode_index(index_file, *filter_modes)) {
+        filter_modes->build_ext_table();
+        return filter_modes.release();
+      }
+    }
+
+    Vector<String> sources;
+    RET_ON_ERR(read_mode_files(*filter_modes, sources));
+    filter_modes->build_ext_table();
     return filter_modes.release();
   }
 
+  PosibErr<void> write_mode_index(Config * config)
+  {
+    String filter_path;
+    StringList filter_path_lst;
+    config->retrieve_list("filter-path", &filter_path_lst);
+    combine_list(filter_path, filter_path_lst);
+
+    // As with the dictionary index, see DictIndex::write in info.cpp,
+    // the file is replaced with a new one in a directory of its own,
+    // which is not in the filter path.  It is created before the mode
+    // files are read since that modifies the dict-dir, which usually
+    // is in the filter path.
+    String index_file;
+    get_mode_index_file(config, filter_path, index_file);
+    String index_dir(index_file.str(), index_file.rfind('/'));
+    if (!make_index_dir(index_dir))
+      return make_err(cant_write_file, index_file);
+
+    FilterModeList modes;
+    modes.key = filter_path;
+    Vector<String> sources;
+    RET_ON_ERR(read_mode_files(modes, sources));
+    return write_mode_index(index_file, modes, sources);
+  }
+
   void activate_filter_modes(Config *config) 
   {
     config->add_notifier(new ModeNotifierImpl(config));
@@ -29,6 +29,7 @@ namespace {
   
   class ContextFilter : public IndividualFilter {
     filterstate state;
+    filterstate initial_state;
     Vector<String> opening;
     Vector<String> closing;
     int correspond;
@@ -39,6 +40,8 @@ namespace {
     ContextFilter(void);
     virtual void reset(void);
     void process(FilterChar *& start,FilterChar *& stop);
+    bool save_state(String & st) const;
+    void restore_state(ParmStr st);
     virtual PosibErr<bool> setup(Config * config);
     virtual ~ContextFilter();
   };
@@ -47,7 +50,7 @@ namespace {
   : opening(),
     closing()
   {
-    state=hidden;
+    state=initial_state=hidden;
     correspond=-1;
     opening.resize(3);
     opening[0]="\"";
@@ -77,7 +80,7 @@ namespace {
     }
 
     if (config->retrieve_bool("f-context-visible-first")) {
-      state=visible;
+      state=initial_state=visible;
     }
 
     config->retrieve_list("f-context-delimiters", &delimiters);
@@ -251,9 +254,20 @@ namespace {
   }
         
   void ContextFilter::reset(void) {
-    opening.resize(0);
-    closing.resize(0);
-    state=hidden;
+    state=initial_state;
+    correspond=-1;
+  }
+
+  bool ContextFilter::save_state(String & st) const {
+    save_filter_state(st, state);
+    save_filter_state(st, correspond);
+    return true;
+  }
+
+  void ContextFilter::restore_state(ParmStr st) {
+    FilterStateReader in(st);
+    in.get(state);
+    in.get(correspond);
   }
 
   ContextFilter::~ContextFilter() {
@@ -58,6 +58,8 @@ namespace {
     PosibErr<bool> setup(Config *);
     void reset();
     void process(FilterChar * &, FilterChar * &);
+    bool save_state(String &) const;
+    void restore_state(ParmStr);
   };
 
   PosibErr<bool> EmailFilter::setup(Config * opts) 
@@ -78,6 +80,22 @@ namespace {
     n = 0;
   }
 
+  bool EmailFilter::save_state(String & state) const
+  {
+    save_filter_state(state, prev_newline);
+    save_filter_state(state, in_quote);
+    save_filter_state(state, n);
+    return true;
+  }
+
+  void EmailFilter::restore_state(ParmStr state)
+  {
+    FilterStateReader in(state);
+    in.get(prev_newline);
+    in.get(in_quote);
+    in.get(n);
+  }
+
   void EmailFilter::process(FilterChar * & str, FilterChar * & end)
   {
     FilterChar * line_begin = str;
@@ -80,6 +80,8 @@ namespace {
     PosibErr<bool> setup(Config *);
     void reset();
     void process(FilterChar * &, FilterChar * &);
+    bool save_state(String &) const;
+    void restore_state(ParmStr);
   };
 
   PosibErr<bool> NroffFilter::setup(Config * opts) 
@@ -99,6 +101,30 @@ namespace {
     skip_chars = 0;
   }
 
+  bool NroffFilter::save_state(String & st) const
+  {
+    save_filter_state(st, state);
+    save_filter_state(st, newline);
+    save_filter_state(st, skip_chars);
+    save_filter_state(st, req_name[0]);
+    save_filter_state(st, req_name[1]);
+    save_filter_state(st, pos);
+    save_filter_state(st, in_request);
+    return true;
+  }
+
+  void NroffFilter::restore_state(ParmStr st)
+  {
+    FilterStateReader in(st);
+    in.get(state);
+    in.get(newline);
+    in.get(skip_chars);
+    in.get(req_name[0]);
+    in.get(req_name[1]);
+    in.get(pos);
+    in.get(in_request);
+  }
+
   bool NroffFilter::process_char(FilterChar::Chr c)
   {
     if (skip_chars)
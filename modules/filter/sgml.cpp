@@ -102,7 +102,8 @@ namespace {
     };
     
     ScanState in_what;
-	     // which quote char is quoting this attrib value.	
+	     // which quote char is quoting this attrib value.
+	
     FilterChar::Chr  quote_val;   
 	    // one char prior to this one. For escape handling and such.
     FilterChar::Chr  lookbehind;   
@@ -129,6 +130,8 @@ namespace {
     PosibErr<bool> setup(Config *);
     void reset();
     void process(FilterChar * &, FilterChar * &);
+    bool save_state(String &) const;
+    void restore_state(ParmStr);
   };
 
   PosibErr<bool> SgmlFilter::setup(Config * opts) 
@@ -149,6 +152,47 @@ namespace {
     quote_val = lookbehind = '\0';
     skipall = 0;
     include_attrib = false;
+    tag_name.clear();
+    attrib_name.clear();
+  }
+
+  // The parts of the state that can no longer effect the output are
+  // not saved so that the state is more likely to converge after an
+  // edit.  The tag and attribute names are always saved as a state
+  // saved in the middle of a tag must not pick up the names from
+  // wherever the filter was before it is restored.
+
+  bool SgmlFilter::save_state(String & state) const
+  {
+    save_filter_state(state, in_what);
+    save_filter_state(state, lookbehind);
+    save_filter_state(state, skipall);
+    if (skipall)
+      save_filter_state(state, tag_endskip);
+    save_filter_state(state, tag_name);
+    save_filter_state(state, attrib_name);
+    if (in_what == S_quoted || in_what == S_mdq)
+      save_filter_state(state, quote_val);
+    if (in_what == S_value || in_what == S_quoted)
+      save_filter_state(state, include_attrib);
+    return true;
+  }
+
+  void SgmlFilter::restore_state(ParmStr state)
+  {
+    FilterStateReader in(state);
+    reset();
+    in.get(in_what);
+    in.get(lookbehind);
+    in.get(skipall);
+    if (skipall)
+      in.get(tag_endskip);
+    in.get(tag_name);
+    in.get(attrib_name);
+    if (in_what == S_quoted || in_what == S_mdq)
+      in.get(quote_val);
+    if (in_what == S_value || in_what == S_quoted)
+      in.get(include_attrib);
   }
 
   // yes this should be inlines, it is only called once
@@ -418,6 +462,8 @@ namespace {
     PosibErr<bool> setup(Config *);
     void reset() {}
     void process(FilterChar * &, FilterChar * &);
+    bool save_state(String &) const {return true;}
+    void restore_state(ParmStr) {}
   };
 
   PosibErr<bool> SgmlDecoder::setup(Config *) 
@@ -65,6 +65,8 @@ namespace {
     PosibErr<bool> setup(Config *);
     void reset();
     void process(FilterChar * &, FilterChar * &);
+    bool save_state(String &) const;
+    void restore_state(ParmStr);
   };
 
   //
@@ -108,6 +110,51 @@ namespace {
     push_command(Parm);
   }
 
+  // "do_check" points into the value of the command in "commands" (or
+  // to a literal) so only what is left of it is saved, the pointer is
+  // then found again when the state is restored.
+
+  bool TexFilter::save_state(String & state) const
+  {
+    save_filter_state(state, in_comment);
+    save_filter_state(state, prev_backslash);
+    save_filter_state(state, static_cast<unsigned>(stack.size()));
+    for (unsigned i = 0; i != stack.size(); ++i) {
+      save_filter_state(state, stack[i].in_what);
+      save_filter_state(state, stack[i].name);
+      save_filter_state(state, String(stack[i].do_check));
+    }
+    return true;
+  }
+
+  void TexFilter::restore_state(ParmStr state)
+  {
+    FilterStateReader in(state);
+    unsigned size = 0;
+    String do_check;
+    in.get(in_comment);
+    in.get(prev_backslash);
+    in.get(size);
+    stack.resize(0);
+    for (unsigned i = 0; i != size; ++i) {
+      push_command(Parm);
+      Command & cmd = stack.back();
+      in.get(cmd.in_what);
+      in.get(cmd.name);
+      in.get(do_check);
+      const char * c = commands.lookup(cmd.name.c_str());
+      unsigned len = c ? strlen(c) : 0;
+      if (c && do_check.size() <= len 
+          && strcmp(c + len - do_check.size(), do_check.str()) == 0)
+        cmd.do_check = c + len - do_check.size();
+      else if (do_check == "P")
+        cmd.do_check = "P";
+      else
+        cmd.do_check = "";
+    }
+    if (stack.empty()) push_command(Parm);
+  }
+
 #  define top stack.back()
 
   // yes this should be inlined, it is only called once
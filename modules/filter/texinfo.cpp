@@ -49,6 +49,8 @@ namespace {
     PosibErr<bool> setup(Config *);
     void reset();
     void process(FilterChar * &, FilterChar * &);
+    bool save_state(String &) const;
+    void restore_state(ParmStr);
   };
 
   //
@@ -86,6 +88,53 @@ namespace {
     table_stack.push_back(Table(""));
   }
 
+  bool TexInfoFilter::save_state(String & state) const
+  {
+    save_filter_state(state, last_command);
+    save_filter_state(state, env_command);
+    save_filter_state(state, env_ignore);
+    save_filter_state(state, ignore);
+    save_filter_state(state, in_line_command);
+    save_filter_state(state, seen_input);
+    save_filter_state(state, static_cast<unsigned>(stack.size()));
+    for (unsigned i = 0; i != stack.size(); ++i)
+      save_filter_state(state, stack[i].ignore);
+    save_filter_state(state, static_cast<unsigned>(table_stack.size()));
+    for (unsigned i = 0; i != table_stack.size(); ++i) {
+      save_filter_state(state, table_stack[i].name);
+      save_filter_state(state, table_stack[i].ignore_item);
+    }
+    return true;
+  }
+
+  void TexInfoFilter::restore_state(ParmStr state)
+  {
+    FilterStateReader in(state);
+    unsigned size = 0;
+    in.get(last_command);
+    in.get(env_command);
+    in.get(env_ignore);
+    in.get(ignore);
+    in.get(in_line_command);
+    in.get(seen_input);
+    in.get(size);
+    stack.clear();
+    for (unsigned i = 0; i != size; ++i) {
+      stack.push_back(Command());
+      in.get(stack.back().ignore);
+    }
+    if (stack.empty()) stack.push_back(Command());
+    size = 0;
+    in.get(size);
+    table_stack.clear();
+    for (unsigned i = 0; i != size; ++i) {
+      table_stack.push_back(Table(""));
+      in.get(table_stack.back().name);
+      in.get(table_stack.back().ignore_item);
+    }
+    if (table_stack.empty()) table_stack.push_back(Table(""));
+  }
+
   void TexInfoFilter::process(FilterChar * & str, FilterChar * & stop)
   {
     FilterChar * cur = str;
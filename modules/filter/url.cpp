@@ -16,6 +16,8 @@ namespace {
     PosibErr<bool> setup(Config *);
     void reset() {}
     void process(FilterChar * &, FilterChar * &);
+    bool save_state(String &) const {return true;}
+    void restore_state(ParmStr) {}
   };
 
   PosibErr<bool> UrlFilter::setup(Config *) 
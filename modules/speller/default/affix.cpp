@@ -56,6 +56,7 @@
 #include "vararray.hpp"
 #include "lsort.hpp"
 #include "hash-t.hpp"
+#include "lang_bundle.hpp"
 
 #include "gettext.h"
 
@@ -90,6 +91,10 @@ struct AffEntry
   const Conds *  conds;
   //unsigned int numconds;
   //char         conds[SETSIZE];
+  byte           word_conds; // number of conditions that fall on the
+                             // word rather than on the strip string
+  bool           strip_ok;   // true if the strip string meets the
+                             // remaining conditions
 };
 
 // A Prefix Entry
@@ -97,13 +102,15 @@ struct AffEntry
 struct PfxEntry : public AffEntry
 {
   PfxEntry * next;
-  PfxEntry * next_eq;
-  PfxEntry * next_ne;
   PfxEntry * flag_next;
   PfxEntry() {}
 
+  void prep_conds();
+  inline bool root_matches(ParmString) const;
+  inline unsigned make_root(ParmString, char *) const;
   bool check(const LookupInfo &, const AffixMgr * pmyMgr,
-             ParmString, CheckInfo &, GuessInfo *, bool cross = true) const;
+             ParmString root, size_t root_hash, 
+             CheckInfo &, GuessInfo *, bool cross = true) const;
 
   inline bool          allow_cross() const { return ((xpflg & XPRODUCT) != 0); }
   inline byte flag() const { return achar;  }
@@ -119,14 +126,15 @@ struct SfxEntry : public AffEntry
   const char * rappnd; // this is set in AffixMgr::build_sfxlist
   
   SfxEntry *   next;
-  SfxEntry *   next_eq;
-  SfxEntry *   next_ne;
   SfxEntry *   flag_next;
 
   SfxEntry() {}
 
-  bool check(const LookupInfo &, ParmString, CheckInfo &, GuessInfo *,
-             int optflags, AffEntry * ppfx);
+  void prep_conds();
+  inline bool root_matches(ParmString) const;
+  inline unsigned make_root(ParmString, char *) const;
+  bool check(const LookupInfo &, ParmString root, size_t root_hash,
+             CheckInfo &, GuessInfo *, int optflags, AffEntry * ppfx) const;
 
   inline bool          allow_cross() const { return ((xpflg & XPRODUCT) != 0); }
   inline byte flag() const { return achar;  }
@@ -140,27 +148,6 @@ struct SfxEntry : public AffEntry
 // Utility functions declarations
 //
 
-/* return 1 if s1 is subset of s2 */
-static bool isSubset(const char * s1, const char * s2)
-{
-  while( *s1 && (*s1 == *s2) ) {
-    s1++;
-    s2++;
-  }
-  return (*s1 == '\0');
-}
-
-// return 1 if s1 (reversed) is a leading subset of end of s2
-static bool isRevSubset(const char * s1, const char * end_of_s2, int len)
-{
-  while( (len > 0) && *s1 && (*s1 == *end_of_s2) ) {
-    s1++;
-    end_of_s2--;
-    len --;
-  }
-  return (*s1 == '\0');
-}
-
 template <class T>
 struct AffixLess
 {
@@ -236,7 +223,7 @@ static int normalize_cond_str(char * str)
 }
 
 static void encodeit(CondsLookup &, ObjStack &, 
-                     AffEntry * ptr, char * cs);
+                     AffEntry * ptr, const char * cs);
 
 //////////////////////////////////////////////////////////////////////
 //
@@ -247,6 +234,12 @@ PosibErr<void> AffixMgr::setup(ParmString affpath, Conv & iconv)
 {
   // register hash manager and load affix data from aff file
   //cpdmin = 3;  // default value
+  return parse_file(affpath, iconv);
+}
+
+AffixMgr::AffixMgr(const Language * l) 
+  : lang(l), data_buf(1024*16) 
+{
   max_strip_ = 0;
   for (int i=0; i < SETSIZE; i++) {
     pStart[i] = NULL;
@@ -255,14 +248,17 @@ PosibErr<void> AffixMgr::setup(ParmString affpath, Conv & iconv)
     sFlag[i] = NULL;
     max_strip_f[i] = 0;
   }
-  return parse_file(affpath, iconv);
 }
 
-AffixMgr::AffixMgr(const Language * l) 
-  : lang(l), data_buf(1024*16) {}
-
 AffixMgr::~AffixMgr() {}
 
+size_t AffixMgr::memory_used() const
+{
+  return sizeof(*this) + data_buf.calc_size()
+    + (pfx_trie.size() + sfx_trie.size()) * sizeof(AffixNode)
+    + (pfx_trie_entries.size() + sfx_trie_entries.size()) * sizeof(void *);
+}
+
 static inline void max_(int & lhs, int rhs) 
 {
   if (lhs < rhs) lhs = rhs;
@@ -427,33 +423,11 @@ PosibErr<void> AffixMgr::parse_file(const char * affpath, Conv & iconv)
   }
   afflst.close();
 
-  // now we can speed up performance greatly taking advantage of the 
-  // relationship between the affixes and the idea of "subsets".
-
-  // View each prefix as a potential leading subset of another and view
-  // each suffix (reversed) as a potential trailing subset of another.
-
-  // To illustrate this relationship if we know the prefix "ab" is
-  // found in the word to examine, only prefixes that "ab" is a
-  // leading subset of need be examined.  Furthermore is "ab" is not
-  // present then none of the prefixes that "ab" is is a subset need
-  // be examined.
-
-  // The same argument goes for suffix string that are reversed.
-
-  // Then to top this off why not examine the first char of the word
-  // to quickly limit the set of prefixes to examine (i.e. the
-  // prefixes to examine must be leading supersets of the first
-  // character of the word (if they exist)
- 
-  // To take advantage of this "subset" relationship, we need to add
-  // two links from entry.  One to take next if the current prefix
-  // is found (call it nexteq) and one to take next if the current
-  // prefix is not found (call it nextne).
-
-  // Since we have built ordered lists, all that remains is to
-  // properly initialize the nextne and nexteq pointers that relate
-  // them
+  // now we can speed up performance greatly by building a trie of
+  // the prefix strings and one of the reversed suffix strings.  When
+  // checking a word the tries are walked from the start (or end) of
+  // the word so only the entries whose affix string is actually
+  // present in the word are ever examined.
 
   process_pfx_order();
   process_sfx_order();
@@ -492,6 +466,19 @@ PosibErr<void> AffixMgr::build_pfxlist(PfxEntry* pfxptr)
   return no_err;
 }
 
+static const char * reverse_appnd(ObjStack & buf, const SfxEntry * e)
+{
+  char * tmp = (char *)buf.alloc(e->appndl + 1);
+
+  // reverse the string
+  char * dest = tmp + e->appndl;
+  *dest-- = 0;
+  const char * src = e->appnd;
+  for (; dest >= tmp; --dest, ++src)
+    *dest = *src;
+  return tmp;
+}
+
 // we want to be able to quickly access suffix information
 // both by suffix flag, and sorted by the reverse of the
 // suffix string itself; so we need to set up two indexes
@@ -500,15 +487,7 @@ PosibErr<void> AffixMgr::build_sfxlist(SfxEntry* sfxptr)
 {
   SfxEntry * ptr;
   SfxEntry * ep = sfxptr;
-  char * tmp = (char *)data_buf.alloc(sfxptr->appndl + 1);
-  sfxptr->rappnd = tmp;
-
-  // reverse the string
-  char * dest = tmp + sfxptr->appndl;
-  *dest-- = 0;
-  const char * src = sfxptr->appnd;
-  for (; dest >= tmp; --dest, ++src)
-    *dest = *src;
+  sfxptr->rappnd = reverse_appnd(data_buf, sfxptr);
 
   /* get the right starting point */
   const char * key = ep->key();
@@ -530,108 +509,219 @@ PosibErr<void> AffixMgr::build_sfxlist(SfxEntry* sfxptr)
 
 
 
-// initialize the PfxEntry links NextEQ and NextNE to speed searching
-PosibErr<void> AffixMgr::process_pfx_order()
+// builds a node of the affix trie from the entries in [i, end) which
+// are sorted by key and all share the first "depth" chars of the key
+template <class T>
+static void build_trie_node(Vector<AffixNode> & nodes, Vector<T *> & entries,
+                            unsigned n, T * const * i, T * const * end,
+                            unsigned depth)
 {
-  PfxEntry* ptr;
-
-  // loop through each prefix list starting point
-  for (int i=1; i < SETSIZE; i++) {
-
-    ptr = pStart[i];
-
-    if (ptr && ptr->next)
-      ptr = pStart[i] = sort(ptr, AffixLess<PfxEntry>());
+  // the entries which end at this node sort first
+  nodes[n].entries = entries.size();
+  for (; i != end && (*i)->key()[depth] == '\0'; ++i)
+    entries.push_back(*i);
+  nodes[n].num_entries = entries.size() - nodes[n].entries;
+
+  // create one child for each distinct next char, the children
+  // need to be consecutive so they are added before any of their
+  // own children are
+  nodes[n].children = nodes.size();
+  nodes[n].num_children = 0;
+  for (T * const * j = i; j != end;) {
+    byte c = (*j)->key()[depth];
+    AffixNode child = {c, 0, 0, 0, 0};
+    nodes.push_back(child);
+    nodes[n].num_children++;
+    while (j != end && (byte)(*j)->key()[depth] == c) ++j;
+  }
 
-    // look through the remainder of the list
-    //  and find next entry with affix that 
-    // the current one is not a subset of
-    // mark that as destination for NextNE
-    // use next in list that you are a subset
-    // of as NextEQ
+  unsigned child = nodes[n].children;
+  while (i != end) {
+    byte c = (*i)->key()[depth];
+    T * const * j = i;
+    while (j != end && (byte)(*j)->key()[depth] == c) ++j;
+    build_trie_node(nodes, entries, child++, i, j, depth + 1);
+    i = j;
+  }
+}
 
-    for (; ptr != NULL; ptr = ptr->next) {
+// builds the affix trie from the lists in "start", all the lists
+// except the one for 0 length affixes must already be sorted
+template <class T>
+static void build_trie(Vector<AffixNode> & nodes, Vector<T *> & entries,
+                       T * const * start)
+{
+  Vector<T *> sorted;
+  for (int i = 0; i < SETSIZE; i++)
+    for (T * ptr = start[i]; ptr != NULL; ptr = ptr->next)
+      sorted.push_back(ptr);
+  nodes.clear();
+  entries.clear();
+  AffixNode root = {0, 0, 0, 0, 0};
+  nodes.push_back(root);
+  build_trie_node(nodes, entries, 0, 
+                  sorted.pbegin(), sorted.pbegin() + sorted.size(), 0);
+}
 
-      PfxEntry * nptr = ptr->next;
-      for (; nptr != NULL; nptr = nptr->next) {
-        if (! isSubset( ptr->key() , nptr->key() )) break;
-      }
-      ptr->next_ne = nptr;
-      ptr->next_eq = NULL;
-      if ((ptr->next) && isSubset(ptr->key() , 
-                                  (ptr->next)->key())) 
-        ptr->next_eq = ptr->next;
-    }
+static inline const AffixNode * trie_child(const AffixNode * nodes,
+                                           const AffixNode * n, byte c)
+{
+  const AffixNode * i = nodes + n->children;
+  const AffixNode * end = i + n->num_children;
+  while (i != end && i->ch < c) ++i;
+  return i != end && i->ch == c ? i : 0;
+}
 
-    // now clean up by adding smart search termination strings
-    // if you are already a superset of the previous prefix
-    // but not a subset of the next, search can end here
-    // so set NextNE properly
-
-    ptr = pStart[i];
-    for (; ptr != NULL; ptr = ptr->next) {
-      PfxEntry * nptr = ptr->next;
-      PfxEntry * mptr = NULL;
-      for (; nptr != NULL; nptr = nptr->next) {
-        if (! isSubset(ptr->key(),nptr->key())) break;
-        mptr = nptr;
-      }
-      if (mptr) mptr->next_ne = NULL;
-    }
+// sort the prefix lists and build the prefix trie
+PosibErr<void> AffixMgr::process_pfx_order()
+{
+  for (int i=0; i < SETSIZE; i++) {
+    if (i != 0 && pStart[i] && pStart[i]->next)
+      pStart[i] = sort(pStart[i], AffixLess<PfxEntry>());
+    for (PfxEntry * ptr = pStart[i]; ptr != NULL; ptr = ptr->next)
+      ptr->prep_conds();
   }
+  build_trie(pfx_trie, pfx_trie_entries, pStart);
   return no_err;
 }
 
-
-
-// initialize the SfxEntry links NextEQ and NextNE to speed searching
+// sort the suffix lists and build the suffix trie
 PosibErr<void> AffixMgr::process_sfx_order()
 {
-  SfxEntry* ptr;
+  for (int i=0; i < SETSIZE; i++) {
+    if (i != 0 && sStart[i] && sStart[i]->next)
+      sStart[i] = sort(sStart[i], AffixLess<SfxEntry>());
+    for (SfxEntry * ptr = sStart[i]; ptr != NULL; ptr = ptr->next)
+      ptr->prep_conds();
+  }
+  build_trie(sfx_trie, sfx_trie_entries, sStart);
+  return no_err;
+}
 
-  // loop through each prefix list starting point
-  for (int i=1; i < SETSIZE; i++) {
+//////////////////////////////////////////////////////////////////////
+//
+// Precompiled language bundles
+//
 
-    ptr = sStart[i];
+// Each entry is written out once, in the order of the pStart (or
+// sStart) lists, followed by the order of the entries in each of
+// the start and flag lists as indexes.  This way the lists can be
+// linked up again exactly as they were without needing to sort them.
 
-    if (ptr && ptr->next)
-      ptr = sStart[i] = sort(ptr, AffixLess<SfxEntry>());
+typedef hash_map<unsigned long, unsigned> EntryIndex;
 
-    // look through the remainder of the list
-    //  and find next entry with affix that 
-    // the current one is not a subset of
-    // mark that as destination for NextNE
-    // use next in list that you are a subset
-    // of as NextEQ
+template <class T>
+static void write_lists(LangBundleOut & out, T * const * lists, 
+                        T * T::* link, EntryIndex & index)
+{
+  for (int i = 0; i < SETSIZE; i++) {
+    unsigned n = 0;
+    for (const T * p = lists[i]; p != NULL; p = p->*link) ++n;
+    out.put(n);
+    for (const T * p = lists[i]; p != NULL; p = p->*link)
+      out.put(index.find((unsigned long)p)->second);
+  }
+}
 
-    for (; ptr != NULL; ptr = ptr->next) {
-      SfxEntry * nptr = ptr->next;
-      for (; nptr != NULL; nptr = nptr->next) {
-        if (! isSubset(ptr->key(),nptr->key())) break;
-      }
-      ptr->next_ne = nptr;
-      ptr->next_eq = NULL;
-      if ((ptr->next) && isSubset(ptr->key(),(ptr->next)->key())) 
-        ptr->next_eq = ptr->next;
+template <class T>
+static void write_entries(LangBundleOut & out, 
+                          T * const * start, T * const * flag)
+{
+  EntryIndex index;
+  unsigned num = 0;
+  for (int i = 0; i < SETSIZE; i++)
+    for (const T * p = start[i]; p != NULL; p = p->next)
+      index[(unsigned long)p] = num++;
+  out.put(num);
+  for (int i = 0; i < SETSIZE; i++) {
+    for (const T * p = start[i]; p != NULL; p = p->next) {
+      byte b[2] = {(byte)p->achar, p->xpflg};
+      out.put(b, 2);
+      out.put_str(ParmString(p->strip, p->stripl));
+      out.put_str(ParmString(p->appnd, p->appndl));
+      out.put_str(p->conds->str);
+    }
+  }
+  write_lists(out, start, &T::next, index);
+  write_lists(out, flag, &T::flag_next, index);
+}
+
+template <class T>
+static void read_lists(LangBundleIn & in, T * * lists, T * T::* link,
+                       const Vector<T *> & entries)
+{
+  for (int i = 0; i < SETSIZE; i++) {
+    unsigned n = in.get_count(sizeof(unsigned));
+    T * * prev = &lists[i];
+    for (unsigned j = 0; j != n; ++j) {
+      unsigned idx = in.get();
+      if (idx >= entries.size()) {in.set_bad(); break;}
+      *prev = entries[idx];
+      prev = &(entries[idx]->*link);
     }
+    *prev = NULL;
+  }
+}
 
+template <class T>
+static void read_entries(LangBundleIn & in, ObjStack & buf, 
+                         CondsLookup & conds_lookup, 
+                         int & max_strip, int * max_strip_f,
+                         T * * start, T * * flag, Vector<T *> & entries)
+{
+  unsigned num = in.get_count(2 + 3 * (sizeof(unsigned) + 1));
+  entries.resize(num);
+  for (unsigned i = 0; i != num; ++i) {
+    T * e = (T *) buf.alloc_bottom(sizeof(T));
+    new (e) T;
+    byte b[2];
+    in.get(b, 2);
+    e->achar = b[0];
+    e->xpflg = b[1];
+    unsigned size;
+    const char * s = in.get_str(&size);
+    e->strip  = size != 0 ? buf.dup(ParmString(s, size)) : "";
+    e->stripl = size;
+    max_(max_strip, size);
+    max_(max_strip_f[b[0]], size);
+    s = in.get_str(&size);
+    e->appnd  = size != 0 ? buf.dup(ParmString(s, size)) : "";
+    e->appndl = size;
+    encodeit(conds_lookup, buf, e, in.get_str());
+    entries[i] = e;
+  }
+  read_lists(in, start, &T::next, entries);
+  read_lists(in, flag, &T::flag_next, entries);
+}
 
-    // now clean up by adding smart search termination strings:
-    // if you are already a superset of the previous suffix
-    // but not a subset of the next, search can end here
-    // so set NextNE properly
+void AffixMgr::write_bundle(LangBundleOut & out) const
+{
+  out.put_str(affix_file);
+  write_entries(out, pStart, pFlag);
+  write_entries(out, sStart, sFlag);
+}
 
-    ptr = sStart[i];
-    for (; ptr != NULL; ptr = ptr->next) {
-      SfxEntry * nptr = ptr->next;
-      SfxEntry * mptr = NULL;
-      for (; nptr != NULL; nptr = nptr->next) {
-        if (! isSubset(ptr->key(),nptr->key())) break;
-        mptr = nptr;
-      }
-      if (mptr) mptr->next_ne = NULL;
-    }
+PosibErr<void> AffixMgr::setup(LangBundleIn & in)
+{
+  CondsLookup conds_lookup;
+  affix_file = data_buf.dup(in.get_str());
+  Vector<PfxEntry *> pfx_entries;
+  read_entries(in, data_buf, conds_lookup, max_strip_, max_strip_f, 
+               pStart, pFlag, pfx_entries);
+  Vector<SfxEntry *> sfx_entries;
+  read_entries(in, data_buf, conds_lookup, max_strip_, max_strip_f, 
+               sStart, sFlag, sfx_entries);
+  if (in.bad())
+    return make_err(bad_file_format, affix_file);
+
+  for (unsigned i = 0; i != pfx_entries.size(); ++i)
+    pfx_entries[i]->prep_conds();
+  for (unsigned i = 0; i != sfx_entries.size(); ++i) {
+    sfx_entries[i]->rappnd = reverse_appnd(data_buf, sfx_entries[i]);
+    sfx_entries[i]->prep_conds();
   }
+  build_trie(pfx_trie, pfx_trie_entries, pStart);
+  build_trie(sfx_trie, sfx_trie_entries, sStart);
   return no_err;
 }
 
@@ -641,7 +731,7 @@ PosibErr<void> AffixMgr::process_sfx_order()
 // in much more detail
 
 static void encodeit(CondsLookup & l, ObjStack & buf, 
-                     AffEntry * ptr, char * cs)
+                     AffEntry * ptr, const char * cs)
 {
   byte c;
   int i, j, k;
@@ -681,7 +771,7 @@ static void encodeit(CondsLookup & l, ObjStack & buf,
 
   i = 0;
   while (i < nc) {
-    c = *((byte *)(cs + i));
+    c = *((const byte *)(cs + i));
 
     // start group indicator
     if (c == '[') {
@@ -755,30 +845,93 @@ static void encodeit(CondsLookup & l, ObjStack & buf,
 }
 
 
+// The roots of the affix entries that match a word are not looked up
+// one at a time.  Instead they are collected in batches of this size
+// so that the dictionary lookups can be started (prefetched) for all
+// of them before any are actually checked.
+
+static const unsigned AFFIX_BATCH = 8;
+
+// Storage for a batch of roots, "stride" apart, and their clean
+// hashes.  The roots of words too long for the fixed buffer are
+// instead checked one at a time using a buffer on the heap.
+
+struct RootBatch {
+  unsigned stride;
+  unsigned size;
+  char * roots;
+  size_t hash[AFFIX_BATCH];
+  char fixed[AFFIX_BATCH * (MAXWORDLEN + 1)];
+  String heap;
+  RootBatch(unsigned s) : stride(s) {
+    if (stride <= MAXWORDLEN + 1) {
+      size = AFFIX_BATCH;
+      roots = fixed;
+    } else {
+      size = 1;
+      heap.resize(stride);
+      roots = heap.data();
+    }
+  }
+  char * operator[](unsigned i) const {return roots + i * stride;}
+};
+
+// Computes the clean hash of each root and, if there is more than
+// one, prefetches them.  The hashes are then reused by the lookups.
+static inline void prefetch_roots(const LookupInfo & linf,
+                                  RootBatch & roots,
+                                  const unsigned * len, unsigned n)
+{
+  for (unsigned i = 0; i != n; ++i) {
+    ParmString root(roots[i], len[i]);
+    roots.hash[i] = linf.clean_hash(root);
+    if (n > 1) linf.prefetch(root, roots.hash[i]);
+  }
+}
+
 // check word for prefixes
 bool AffixMgr::prefix_check (const LookupInfo & linf, ParmString word, 
                              CheckInfo & ci, GuessInfo * gi, bool cross) const
 {
- 
-  // first handle the special case of 0 length prefixes
-  PfxEntry * pe = pStart[0];
-  while (pe) {
-    if (pe->check(linf,this,word,ci,gi)) return true;
-    pe = pe->next;
-  }
-  
-  // now handle the general case
-  byte sp = *reinterpret_cast<const byte *>(word.str());
-  PfxEntry * pptr = pStart[sp];
-
-  while (pptr) {
-    if (isSubset(pptr->key(),word)) {
-      if (pptr->check(linf,this,word,ci,gi,cross)) return true;
-      pptr = pptr->next_eq;
-    } else {
-      pptr = pptr->next_ne;
+  RootBatch roots(word.size() + max_strip_ + 1);
+  const PfxEntry * batch[AFFIX_BATCH];
+  unsigned len[AFFIX_BATCH];
+  bool batch_cross[AFFIX_BATCH];
+  unsigned n = 0;
+
+  const AffixNode * nodes = pfx_trie.pbegin();
+  const AffixNode * node = nodes;
+  const byte * w = (const byte *)word.str();
+  const byte * w_end = w + word.size();
+
+  // walk down the trie, every entry found along the way is a prefix
+  // of the word, the first node holds the 0 length prefixes which
+  // are always allowed to be combined with a suffix
+  for (;;) {
+    for (PfxEntry * const * i = pfx_trie_entries.pbegin() + node->entries,
+           * const * end = i + node->num_entries;
+         i != end; ++i)
+    {
+      if (!(*i)->root_matches(word)) continue;
+      batch[n] = *i;
+      batch_cross[n] = node == nodes || cross;
+      len[n] = (*i)->make_root(word, roots[n]);
+      if (++n < roots.size) continue;
+      prefetch_roots(linf, roots, len, n);
+      for (unsigned j = 0; j != n; ++j)
+        if (batch[j]->check(linf, this, ParmString(roots[j], len[j]), 
+                            roots.hash[j], ci, gi, batch_cross[j])) 
+          return true;
+      n = 0;
     }
+    if (w == w_end || !(node = trie_child(nodes, node, *w++))) break;
   }
+
+  prefetch_roots(linf, roots, len, n);
+  for (unsigned j = 0; j != n; ++j)
+    if (batch[j]->check(linf, this, ParmString(roots[j], len[j]), 
+                        roots.hash[j], ci, gi, batch_cross[j])) 
+      return true;
     
   return false;
 }
@@ -789,26 +942,46 @@ bool AffixMgr::suffix_check (const LookupInfo & linf, ParmString word,
                              CheckInfo & ci, GuessInfo * gi,
                              int sfxopts, AffEntry * ppfx) const
 {
-
-  // first handle the special case of 0 length suffixes
-  SfxEntry * se = sStart[0];
-  while (se) {
-    if (se->check(linf, word, ci, gi, sfxopts, ppfx)) return true;
-    se = se->next;
-  }
-  
-  // now handle the general case
-  byte sp = *((const byte *)(word + word.size() - 1));
-  SfxEntry * sptr = sStart[sp];
-
-  while (sptr) {
-    if (isRevSubset(sptr->key(), word + word.size() - 1, word.size())) {
-      if (sptr->check(linf, word, ci, gi, sfxopts, ppfx)) return true;
-      sptr = sptr->next_eq;
-    } else {
-      sptr = sptr->next_ne;
+  RootBatch roots(word.size() + max_strip_ + 1);
+  const SfxEntry * batch[AFFIX_BATCH];
+  unsigned len[AFFIX_BATCH];
+  unsigned n = 0;
+
+  const AffixNode * nodes = sfx_trie.pbegin();
+  const AffixNode * node = nodes;
+  const byte * w_begin = (const byte *)word.str();
+  const byte * w = w_begin + word.size();
+
+  // walk down the trie from the end of the word, every entry found
+  // along the way is a suffix of the word, starting with the 0
+  // length suffixes
+  for (;;) {
+    for (SfxEntry * const * i = sfx_trie_entries.pbegin() + node->entries,
+           * const * end = i + node->num_entries;
+         i != end; ++i)
+    {
+      // if this suffix is being cross checked with a prefix
+      // but it does not support cross products skip it
+      if ((sfxopts & XPRODUCT) != 0 && !(*i)->allow_cross()) continue;
+      if (!(*i)->root_matches(word)) continue;
+      batch[n] = *i;
+      len[n] = (*i)->make_root(word, roots[n]);
+      if (++n < roots.size) continue;
+      prefetch_roots(linf, roots, len, n);
+      for (unsigned j = 0; j != n; ++j)
+        if (batch[j]->check(linf, ParmString(roots[j], len[j]), 
+                            roots.hash[j], ci, gi, sfxopts, ppfx)) 
+          return true;
+      n = 0;
     }
+    if (w == w_begin || !(node = trie_child(nodes, node, *--w))) break;
   }
+
+  prefetch_roots(linf, roots, len, n);
+  for (unsigned j = 0; j != n; ++j)
+    if (batch[j]->check(linf, ParmString(roots[j], len[j]), 
+                        roots.hash[j], ci, gi, sfxopts, ppfx)) 
+      return true;
     
   return false;
 }
@@ -821,18 +994,23 @@ bool AffixMgr::affix_check(const LookupInfo & linf, ParmString word,
   CasePattern cp = lang->LangImpl::case_pattern(word);
   ParmString pword = word;
   ParmString sword = word;
-  CharVector lower;
+  char lower_buf[MAXWORDLEN + 1];
+  String long_lower;
+  char * lower = lower_buf;
+  if ((cp == FirstUpper || cp == AllUpper) && word.size() > MAXWORDLEN) {
+    long_lower.resize(word.size() + 1);
+    lower = long_lower.data();
+  }
   if (cp == FirstUpper) {
-    lower.append(word, word.size() + 1);
+    memcpy(lower, word, word.size() + 1);
     lower[0] = lang->to_lower(word[0]);
-    pword = ParmString(lower.data(), lower.size() - 1);
+    pword = ParmString(lower, word.size());
   } else if (cp == AllUpper) {
-    lower.resize(word.size() + 1);
     unsigned int i = 0;
     for (; i != word.size(); ++i)
       lower[i] = lang->to_lower(word[i]);
     lower[i] = '\0';
-    pword = ParmString(lower.data(), lower.size() - 1);
+    pword = ParmString(lower, word.size());
     sword = pword;
   }
 
@@ -975,15 +1153,15 @@ CheckAffixRes AffixMgr::check_affix(ParmString word, char aff) const
 // LookupInfo
 //
 
-int LookupInfo::lookup (ParmString word, const SensitiveCompare * c, 
-                        char achar, 
+int LookupInfo::lookup (ParmString word, size_t clean_hash,
+                        const SensitiveCompare * c, char achar, 
                         WordEntry & o, GuessInfo * gi) const
 {
   SpellerImpl::WS::const_iterator i = begin;
   const char * g = 0;
   if (mode == Word) {
     do {
-      (*i)->lookup(word, c, o);
+      (*i)->hashed_lookup(word, clean_hash, c, o);
       for (;!o.at_end(); o.adv()) {
         if (TESTAFF(o.aff, achar))
           return 1;
@@ -994,7 +1172,7 @@ int LookupInfo::lookup (ParmString word, const SensitiveCompare * c,
     } while (i != end);
   } else if (mode == Clean) {
     do {
-      (*i)->clean_lookup(word, o);
+      (*i)->hashed_clean_lookup(word, clean_hash, o);
       for (;!o.at_end(); o.adv()) {
         if (TESTAFF(o.aff, achar))
           return 1;
@@ -1057,111 +1235,119 @@ SimpleString PfxEntry::add(SimpleString word, ObjStack & buf) const
   return SimpleString();
 }
 
-// check if this prefix entry matches 
-bool PfxEntry::check(const LookupInfo & linf, const AffixMgr * pmyMgr,
-                     ParmString word,
-                     CheckInfo & ci, GuessInfo * gi, bool cross) const
+// works out which of the conditions can be tested against the word
+// directly when checking, see root_matches
+void PfxEntry::prep_conds()
 {
-  unsigned int		cond;	// condition number being examined
-  unsigned              tmpl;   // length of tmpword
-  WordEntry             wordinfo;     // hash entry of root word or NULL
-  byte *	cp;		
-  VARARRAYM(char, tmpword, word.size()+stripl+1, MAXWORDLEN+1);
-
-  // on entry prefix is 0 length or already matches the beginning of the word.
-  // So if the remaining root word has positive length
-  // and if there are enough chars in root word and added back strip chars
-  // to meet the number of characters conditions, then test it
-
-  tmpl = word.size() - appndl;
-
-  if ((tmpl > 0) &&  (tmpl + stripl >= conds->num)) {
-
-    // generate new root word by removing prefix and adding
-    // back any characters that would have been stripped
-
-    if (stripl) strcpy (tmpword, strip);
-    strcpy ((tmpword + stripl), (word + appndl));
+  unsigned n = stripl < conds->num ? stripl : conds->num;
+  word_conds = conds->num - n;
+  strip_ok = true;
+  for (unsigned cond = 0; cond < n; cond++) {
+    if ((conds->get((byte)strip[cond]) & (1 << cond)) == 0)
+      strip_ok = false;
+  }
+}
 
-    // now make sure all of the conditions on characters
-    // are met.  Please see the appendix at the end of
-    // this file for more info on exactly what is being
-    // tested
+// On entry the prefix is 0 length or already matches the beginning
+// of the word.  Returns true if the remaining root word has positive
+// length and, once any stripped chars are added back, meets all the
+// conditions.  Please see the appendix at the end of this file for
+// more info on exactly what is being tested.  The conditions that
+// fall on the strip string are tested in prep_conds so only the ones
+// that fall on the word itself need to be tested here, which avoids
+// building the root for most entries.
 
-    cp = (byte *)tmpword;
-    for (cond = 0;  cond < conds->num;  cond++) {
-      if ((conds->get(*cp++) & (1 << cond)) == 0) break;
-    }
+inline bool PfxEntry::root_matches(ParmString word) const
+{
+  unsigned tmpl = word.size() - appndl;
+  if (tmpl == 0 || tmpl < word_conds || !strip_ok) return false;
+  const byte * cp = (const byte *)word.str() + appndl;
+  for (unsigned cond = 0; cond < word_conds; cond++) {
+    if ((conds->get(*cp++) & (1 << (cond + stripl))) == 0) return false;
+  }
+  return true;
+}
 
-    // if all conditions are met then check if resulting
-    // root word in the dictionary
+// generate the root word by removing the prefix and adding back
+// any characters that would have been stripped, returns the length
+inline unsigned PfxEntry::make_root(ParmString word, char * root) const
+{
+  unsigned tmpl = word.size() - appndl;
+  memcpy(root, strip, stripl);
+  memcpy(root + stripl, word + appndl, tmpl);
+  root[stripl + tmpl] = '\0';
+  return stripl + tmpl;
+}
 
-    if (cond >= conds->num) {
-      CheckInfo * lci = 0;
-      CheckInfo * guess = 0;
-      tmpl += stripl;
+// check if the root of this prefix entry is in the dictionary,
+// assumes root_matches is true
+bool PfxEntry::check(const LookupInfo & linf, const AffixMgr * pmyMgr,
+                     ParmString root, size_t root_hash,
+                     CheckInfo & ci, GuessInfo * gi, bool cross) const
+{
+  WordEntry             wordinfo;     // hash entry of root word or NULL
+  CheckInfo * lci = 0;
+  CheckInfo * guess = 0;
 
-      int res = linf.lookup(tmpword, &linf.sp->s_cmp_end, achar, wordinfo, gi);
+  int res = linf.lookup(root, root_hash, &linf.sp->s_cmp_end, achar, 
+                        wordinfo, gi);
 
-      if (res == 1) {
+  if (res == 1) {
 
-        lci = &ci;
-        lci->word = wordinfo.word;
-        goto quit;
+    lci = &ci;
+    lci->word = wordinfo.word;
+    goto quit;
         
-      } else if (res == -1) {
+  } else if (res == -1) {
 
-        guess = gi->head;
+    guess = gi->head;
 
-      }
+  }
       
-      // prefix matched but no root word was found 
-      // if XPRODUCT is allowed, try again but now 
-      // cross checked combined with a suffix
+  // prefix matched but no root word was found 
+  // if XPRODUCT is allowed, try again but now 
+  // cross checked combined with a suffix
       
-      if (gi)
-        lci = gi->head;
+  if (gi)
+    lci = gi->head;
       
-      if (cross && xpflg & XPRODUCT) {
-        if (pmyMgr->suffix_check(linf, ParmString(tmpword, tmpl), 
-                                 ci, gi,
-                                 XPRODUCT, (AffEntry *)this)) {
-          lci = &ci;
+  if (cross && xpflg & XPRODUCT) {
+    if (pmyMgr->suffix_check(linf, root, 
+                             ci, gi,
+                             XPRODUCT, (AffEntry *)this)) {
+      lci = &ci;
           
-        } else if (gi) {
+    } else if (gi) {
           
-          CheckInfo * stop = lci;
-          for (lci = gi->head; 
-               lci != stop; 
-               lci = const_cast<CheckInfo *>(lci->next)) 
-          {
-            lci->pre_flag = achar;
-            lci->pre_strip_len = stripl;
-            lci->pre_add_len = appndl;
-            lci->pre_add = appnd;
-          }
-          
-        } else {
-          
-          lci = 0;
-          
-        }
-      }
-    
-      if (guess)
-        lci = guess;
-      
-    quit:
-      if (lci) {
+      CheckInfo * stop = lci;
+      for (lci = gi->head; 
+           lci != stop; 
+           lci = const_cast<CheckInfo *>(lci->next)) 
+      {
         lci->pre_flag = achar;
         lci->pre_strip_len = stripl;
         lci->pre_add_len = appndl;
         lci->pre_add = appnd;
       }
-      if (lci == &ci) return true;
+          
+    } else {
+          
+      lci = 0;
+          
     }
   }
-  return false;
+    
+  if (guess)
+    lci = guess;
+      
+quit:
+  if (lci) {
+    lci->pre_flag = achar;
+    lci->pre_strip_len = stripl;
+    lci->pre_add_len = appndl;
+    lci->pre_add = appnd;
+  }
+  return lci == &ci;
 }
 
 bool SfxEntry::applicable(SimpleString word) const
@@ -1204,86 +1390,80 @@ SimpleString SfxEntry::add(SimpleString word, ObjStack & buf,
   return SimpleString();
 }
 
-// see if this suffix is present in the word 
-bool SfxEntry::check(const LookupInfo & linf, ParmString word,
-                     CheckInfo & ci, GuessInfo * gi,
-                     int optflags, AffEntry* ppfx)
+// works out which of the conditions can be tested against the word
+// directly when checking, see root_matches
+void SfxEntry::prep_conds()
 {
-  unsigned              tmpl;		 // length of tmpword 
-  int			cond;		 // condition beng examined
-  WordEntry             wordinfo;        // hash entry pointer
-  byte *	cp;
-  VARARRAYM(char, tmpword, word.size()+stripl+1, MAXWORDLEN+1);
-  PfxEntry* ep = (PfxEntry *) ppfx;
-
-  // if this suffix is being cross checked with a prefix
-  // but it does not support cross products skip it
-
-  if ((optflags & XPRODUCT) != 0 &&  (xpflg & XPRODUCT) == 0)
-    return false;
-
-  // upon entry suffix is 0 length or already matches the end of the word.
-  // So if the remaining root word has positive length
-  // and if there are enough chars in root word and added back strip chars
-  // to meet the number of characters conditions, then test it
-
-  tmpl = word.size() - appndl;
-
-  if ((tmpl > 0)  &&  (tmpl + stripl >= conds->num)) {
-
-    // generate new root word by removing suffix and adding
-    // back any characters that would have been stripped or
-    // or null terminating the shorter string
+  unsigned n = stripl < conds->num ? stripl : conds->num;
+  word_conds = conds->num - n;
+  strip_ok = true;
+  const byte * cp = (const byte *)strip + stripl - n;
+  for (unsigned cond = word_conds; cond < conds->num; cond++) {
+    if ((conds->get(*cp++) & (1 << cond)) == 0)
+      strip_ok = false;
+  }
+}
 
-    strcpy (tmpword, word);
-    cp = (byte *)(tmpword + tmpl);
-    if (stripl) {
-      strcpy ((char *)cp, strip);
-      tmpl += stripl;
-      cp = (byte *)(tmpword + tmpl);
-    } else *cp = '\0';
+// On entry the suffix is 0 length or already matches the end of the
+// word.  Returns true if the remaining root word has positive length
+// and, once any stripped chars are added back, meets all the
+// conditions.  See PfxEntry::root_matches.
 
-    // now make sure all of the conditions on characters
-    // are met.  Please see the appendix at the end of
-    // this file for more info on exactly what is being
-    // tested
+inline bool SfxEntry::root_matches(ParmString word) const
+{
+  unsigned tmpl = word.size() - appndl;
+  if (tmpl == 0 || tmpl < word_conds || !strip_ok) return false;
+  const byte * cp = (const byte *)word.str() + tmpl - word_conds;
+  for (unsigned cond = 0; cond < word_conds; cond++) {
+    if ((conds->get(*cp++) & (1 << cond)) == 0) return false;
+  }
+  return true;
+}
 
-    for (cond = conds->num;  --cond >= 0; ) {
-      if ((conds->get(*--cp) & (1 << cond)) == 0) break;
-    }
+// generate the root word by removing the suffix and adding back
+// any characters that would have been stripped, returns the length
+inline unsigned SfxEntry::make_root(ParmString word, char * root) const
+{
+  unsigned tmpl = word.size() - appndl;
+  memcpy(root, word, tmpl);
+  memcpy(root + tmpl, strip, stripl);
+  root[tmpl + stripl] = '\0';
+  return tmpl + stripl;
+}
 
-    // if all conditions are met then check if resulting
-    // root word in the dictionary
+// check if the root of this suffix entry is in the dictionary,
+// assumes root_matches is true
+bool SfxEntry::check(const LookupInfo & linf, ParmString root, 
+                     size_t root_hash, CheckInfo & ci, GuessInfo * gi,
+                     int optflags, AffEntry* ppfx) const
+{
+  WordEntry             wordinfo;        // hash entry pointer
+  PfxEntry* ep = (PfxEntry *) ppfx;
+  CheckInfo * lci = 0;
 
-    if (cond < 0) {
-      CheckInfo * lci = 0;
-      tmpl += stripl;
-      const SensitiveCompare * cmp = 
-        optflags & XPRODUCT ? &linf.sp->s_cmp_middle : &linf.sp->s_cmp_begin;
-      int res = linf.lookup(tmpword, cmp, achar, wordinfo, gi);
-      if (res == 1
-          && ((optflags & XPRODUCT) == 0 || TESTAFF(wordinfo.aff, ep->achar)))
-      {
-        lci = &ci;
-        lci->word = wordinfo.word;
-      } else if (res == 1 && gi) {
-        lci = gi->add();
-        lci->word = wordinfo.word;
-      } else if (res == -1) { // gi must be defined
-        lci = gi->head;
-      }
+  const SensitiveCompare * cmp = 
+    optflags & XPRODUCT ? &linf.sp->s_cmp_middle : &linf.sp->s_cmp_begin;
+  int res = linf.lookup(root, root_hash, cmp, achar, wordinfo, gi);
+  if (res == 1
+      && ((optflags & XPRODUCT) == 0 || TESTAFF(wordinfo.aff, ep->achar)))
+  {
+    lci = &ci;
+    lci->word = wordinfo.word;
+  } else if (res == 1 && gi) {
+    lci = gi->add();
+    lci->word = wordinfo.word;
+  } else if (res == -1) { // gi must be defined
+    lci = gi->head;
+  }
 
-      if (lci) {
-        lci->suf_flag = achar;
-        lci->suf_strip_len = stripl;
-        lci->suf_add_len = appndl;
-        lci->suf_add = appnd;
-      }
-      
-      if (lci == &ci) return true;
-    }
+  if (lci) {
+    lci->suf_flag = achar;
+    lci->suf_strip_len = stripl;
+    lci->suf_add_len = appndl;
+    lci->suf_add = appnd;
   }
-  return false;
+      
+  return lci == &ci;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -1314,6 +1494,23 @@ PosibErr<AffixMgr *> new_affix_mgr(ParmString name,
     return affix;
   }
 }
+
+PosibErr<AffixMgr *> new_affix_mgr(ParmString name, 
+                                   LangBundleIn & in,
+                                   const Language * lang)
+{
+  if (name == "none")
+    return 0;
+  AffixMgr * affix;
+  affix = new AffixMgr(lang);
+  PosibErrBase pe = affix->setup(in);
+  if (pe.has_err()) {
+    delete affix;
+    return pe;
+  } else {
+    return affix;
+  }
+}
 }
 
 /**************************************************************************
@@ -18,6 +18,7 @@
 #include "simple_string.hpp"
 #include "char_vector.hpp"
 #include "objstack.hpp"
+#include "vector.hpp"
 
 #define SETSIZE         256
 #define MAXAFFIXES      256
@@ -39,6 +40,8 @@ namespace aspeller {
   using namespace acommon;
 
   class Language;
+  class LangBundleIn;
+  class LangBundleOut;
 
   class SpellerImpl;
   using acommon::CheckInfo;
@@ -58,6 +61,18 @@ namespace aspeller {
 
   enum CheckAffixRes {InvalidAffix, InapplicableAffix, ValidAffix};
 
+  // A node in the trie of affix strings (reversed for suffixes) used
+  // by prefix_check and suffix_check.  The children of a node are
+  // stored consecutively and sorted by character.
+  struct AffixNode
+  {
+    unsigned char ch;
+    unsigned short num_children;
+    unsigned children;    // index of the first child
+    unsigned entries;     // index of the first entry that ends here
+    unsigned num_entries;
+  };
+
   class AffixMgr
   {
     const Language * lang;
@@ -76,6 +91,11 @@ namespace aspeller {
 
     ObjStack data_buf;
 
+    Vector<AffixNode>  pfx_trie;
+    Vector<PfxEntry *> pfx_trie_entries;
+    Vector<AffixNode>  sfx_trie;
+    Vector<SfxEntry *> sfx_trie_entries;
+
     const char * affix_file;
 
   public:
@@ -85,8 +105,14 @@ namespace aspeller {
 
     unsigned int max_strip() const {return max_strip_;}
 
+    size_t memory_used() const;
+
     PosibErr<void> setup(ParmString affpath, Conv &);
 
+    // set up from, or save to, a precompiled language bundle
+    PosibErr<void> setup(LangBundleIn &);
+    void write_bundle(LangBundleOut &) const;
+
     bool affix_check(const LookupInfo &, ParmString, CheckInfo &, GuessInfo *) const;
     bool prefix_check(const LookupInfo &, ParmString, CheckInfo &, GuessInfo *, 
                       bool cross = true) const;
@@ -124,6 +150,10 @@ namespace aspeller {
   PosibErr<AffixMgr *> new_affix_mgr(ParmString name, 
                                      Conv &,
                                      const Language * lang);
+
+  PosibErr<AffixMgr *> new_affix_mgr(ParmString name, 
+                                     LangBundleIn &,
+                                     const Language * lang);
 }
 
 #endif
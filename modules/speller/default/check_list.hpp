@@ -9,6 +9,7 @@
 
 #include "objstack.hpp"
 #include "speller.hpp"
+#include "vector.hpp"
 
 namespace aspeller {
 
@@ -21,10 +22,28 @@ namespace aspeller {
 
   struct GuessInfo
   {
+    // words for which guesses still need to be computed
+    struct Pending {
+      const char * word;
+      Pending * next;
+    };
     int num;
     CheckInfo * head;
-    GuessInfo() : num(0), head(0) {}
-    void reset() { buf.reset(); num = 0; head = 0; }
+    Pending * pending;
+    Pending * * pending_end;
+    GuessInfo() : num(0), head(0), pending(0), pending_end(&pending) {}
+    ~GuessInfo() {free_long_strs();}
+    void reset() { 
+      buf.reset(); free_long_strs(); num = 0; head = 0; 
+      pending = 0; pending_end = &pending;
+    }
+    void defer(ParmString word) {
+      Pending * p = (Pending *)buf.alloc_bottom(sizeof(Pending));
+      p->word = dup(word);
+      p->next = 0;
+      *pending_end = p;
+      pending_end = &p->next;
+    }
     CheckInfo * add() {
       num++;
       CheckInfo * tmp = (CheckInfo *)buf.alloc_top(sizeof(CheckInfo), 
@@ -36,9 +55,24 @@ namespace aspeller {
       return head;
     }
     void * alloc(unsigned s) {return buf.alloc_bottom(s);}
-    char * dup(ParmString str) {return buf.dup(str);}
+    char * dup(ParmString str) {
+      if (str.size() < max_buf_str) return buf.dup(str);
+      char * s = (char *)malloc(str.size() + 1);
+      memcpy(s, str.str(), str.size() + 1);
+      long_strs.push_back(s);
+      return s;
+    }
   private:
     ObjStack buf;
+    // strings which may not fit in a chunk of buf are allocated
+    // separately
+    static const unsigned max_buf_str = 256;
+    Vector<char *> long_strs;
+    void free_long_strs() {
+      for (unsigned i = 0; i != long_strs.size(); ++i)
+        free(long_strs[i]);
+      long_strs.clear();
+    }
   };
 
 
@@ -105,6 +105,17 @@ namespace aspeller {
     return no_err;
   }
 
+  void Dictionary::setup_empty_like(const Dictionary & other, Config & config)
+  {
+    assert(basic_type == other.basic_type);
+    lang_.copy(other.lang_);
+    file_name_ = other.file_name_;
+    *id_ = *other.id_;
+    id_->ptr = this;
+    id_->file_name = file_name_.name;
+    set_lang_hook(config);
+  }
+
   void Dictionary::FileName::copy(const FileName & other) 
   {
     const_cast<String &      >(path) = other.path;
@@ -180,6 +191,7 @@ namespace aspeller {
   PosibErr<void> Dictionary::add_repl(ParmString mis, ParmString cor) 
   {
     if (!invisible_soundslike) {
+      RET_ON_ERR(lang()->setup_suggest());
       VARARRAY(char, sl, mis.size() + 1);
       lang()->LangImpl::to_soundslike(sl, mis.str(), mis.size());
       return add_repl(mis, cor, sl);
@@ -191,6 +203,7 @@ namespace aspeller {
   PosibErr<void> Dictionary::add(ParmString w) 
   {
     if (!invisible_soundslike) {
+      RET_ON_ERR(lang()->setup_suggest());
       VARARRAY(char, sl, w.size() + 1);
       lang()->LangImpl::to_soundslike(sl, w.str(), w.size());
       return add(w, sl);
@@ -418,8 +431,11 @@ namespace aspeller {
     Lock dict_cache_lock(NULL);
 
     if (actual_type == DT_ReadOnly) { // try to get it from the cache
-      dict_cache_lock.set(&dict_cache.lock); 
-      res = dict_cache.find(id);
+      res = dict_cache.lookup(id);
+      if (!res) {
+        dict_cache_lock.set(&dict_cache.lock); 
+        res = dict_cache.find(id);
+      }
     }
 
     if (!res) {
@@ -445,15 +461,10 @@ namespace aspeller {
       RET_ON_ERR(w->load(true_file_name, config, new_dicts, speller));
 
       if (actual_type == DT_ReadOnly)
-        dict_cache.add(w);
+        dict_cache.add(w, id);
       
       res = w.release();
 
-    } else { // actual_type == DT_ReadOnly implied, and hence the lock
-             // is already acquired
-
-      res->copy_no_lock();
-      
     }
 
     dict_cache_lock.release();
@@ -84,6 +84,10 @@ namespace aspeller {
     const Id & id() {return *id_;}
     PosibErr<void> check_lang(ParmString lang);
     PosibErr<void> set_check_lang(ParmString lang, Config &);
+    // sets up an empty dictionary with the same language and file
+    // name as "other", which must be of the same type, without
+    // reading anything or changing the config
+    void setup_empty_like(const Dictionary & other, Config &);
     const LangImpl * lang() const {return lang_;};
     const Language * language() const {return lang_;};
     const char * lang_name() const;
@@ -97,6 +101,7 @@ namespace aspeller {
     bool compare(const Dictionary &);
 
     const char * file_name() const {return file_name_.path.c_str();}
+    const char * cache_desc() const {return file_name();}
     // returns any additional dictionaries that are also used
     virtual PosibErr<void> load(ParmString, Config &, DictList * = 0, 
                                 SpellerImpl * = 0);
@@ -135,6 +140,23 @@ namespace aspeller {
     
     virtual bool clean_lookup(ParmString, WordEntry &) const;
 
+    // a hint that "word" is about to be looked up (with either
+    // hashed_lookup or hashed_clean_lookup), the default is to do
+    // nothing.  "clean_hash" is the InsensitiveHash<size_t> of the
+    // word, it is computed once by the caller for all the
+    // dictionaries.
+    virtual void prefetch(ParmString, size_t) const {}
+
+    // the same as lookup and clean_lookup but given the clean_hash of
+    // the word, the default ignores it
+    virtual bool hashed_lookup(ParmString word, size_t, 
+                               const SensitiveCompare * c, 
+                               WordEntry & o) const 
+      {return lookup(word, c, o);}
+    virtual bool hashed_clean_lookup(ParmString word, size_t, 
+                                     WordEntry & o) const 
+      {return clean_lookup(word, o);}
+
     virtual bool soundslike_lookup(const WordEntry &, WordEntry &) const;
     virtual bool soundslike_lookup(ParmString, WordEntry & o) const;
 
@@ -208,6 +230,19 @@ namespace aspeller {
   
   PosibErr<void> create_default_readonly_dict(StringEnumeration * els,
                                               Config & config);
+
+  // A compiled copy of a word list used in place of the list itself.
+  // "source" identifies the contents of the list the copy was made
+  // from, the copy is only loaded if it matches.  create_word_list_cache
+  // takes ownership of "els".
+  PosibErr<Dictionary *> load_word_list_cache(ParmString file,
+                                              ParmString source,
+                                              Config &);
+  PosibErr<void> create_word_list_cache(ParmString file,
+                                        ParmString source,
+                                        StringEnumeration * els,
+                                        const Language &,
+                                        const Config &);
   
   // implemented in multi_ws.cc
   MultiDict * new_default_multi_dict();
@@ -5,6 +5,8 @@
 
 #include <sys/stat.h>
 
+#include "hash_fun.hpp"
+
 namespace aspeller {
   
   class Dict::Id {
@@ -24,6 +26,17 @@ namespace aspeller {
     return *id_ == o;
   }
 
+  // must agree with operator== when "ptr" is null, which it is for
+  // cache lookups
+  inline unsigned long cache_key_hash(const Dict::Id & id)
+  {
+#ifdef USE_FILE_INO
+    return (unsigned long)id.ino ^ ((unsigned long)id.dev << 16);
+#else
+    return id.file_name ? hash<const char *>()(id.file_name) : 0;
+#endif
+  }
+
 }
 
 #endif
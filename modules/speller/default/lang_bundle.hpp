@@ -0,0 +1,31 @@
+// This file is part of The New Aspell and is distributed under the
+// GNU LGPL license version 2.0 or 2.1.  You should have received a copy
+// of the LGPL license along with this library if you did not you can
+// find it at http://www.gnu.org/.
+
+#ifndef ASPELLER_LANG_BUNDLE__HPP
+#define ASPELLER_LANG_BUNDLE__HPP
+
+#include "bin_data.hpp"
+
+using namespace acommon;
+
+namespace aspeller {
+
+  // A precompiled language bundle (created with "aspell compile-lang")
+  // holds the fully set up language data so that Language::setup does
+  // not need to parse the text files it came from.  It is written in
+  // the format of bin_data.hpp.
+
+  static const unsigned int LANG_BUNDLE_VERSION = 1;
+
+  class LangBundleOut : public BinDataOut {};
+
+  class LangBundleIn : public BinDataIn {
+  public:
+    LangBundleIn(const char * b, const char * e) : BinDataIn(b, e) {}
+  };
+
+}
+
+#endif
@@ -19,11 +19,16 @@
 #include "cache-t.hpp"
 #include "getdata.hpp"
 #include "file_util.hpp"
+#include "lang_bundle.hpp"
 
 #ifdef ENABLE_NLS
 #  include <langinfo.h>
 #endif
 
+#ifdef HAVE_MMAP
+#  include <sys/mman.h>
+#endif
+
 #include "gettext.h"
 
 namespace aspeller {
@@ -78,7 +83,8 @@ namespace aspeller {
 
   static GlobalCache<Language> language_cache("language");
 
-  PosibErr<void> Language::setup(const String & lang, const Config * config)
+  PosibErr<void> Language::setup(const String & lang, const Config * config,
+                                 bool use_bundle)
   {
     //
     // get_lang_info
@@ -115,7 +121,176 @@ namespace aspeller {
     charmap_       = charset_;
     data_encoding_ = fix_encoding_str(data.retrieve("data-encoding"), buf);
 
+    sources_.push_back(path);
+
+    DataPair d;
+
+    //
+    // use the precompiled bundle if there is an up to date one
+    //
+
+    bool from_bundle = false;
+    if (use_bundle) {
+      String bundle = dir_ + lang + ".bundle";
+      if (file_exists(bundle)) {
+        PosibErr<bool> pe = read_bundle(bundle, *config);
+        from_bundle = pe.get_err() == 0 && pe.data;
+      }
+    }
+
+    if (!from_bundle)
+      RET_ON_ERR(read_charset(dir1, dir2));
+
+    //
+    // set up conversions
+    //
+    {
+#ifdef ENABLE_NLS
+      const char * tmp = 0;
+      tmp = bind_textdomain_codeset("aspell", 0);
+#ifdef HAVE_LANGINFO_CODESET
+      if (!tmp) tmp = nl_langinfo(CODESET);
+#endif
+      if (ascii_encoding(*config, tmp)) tmp = 0;
+      if (tmp)
+        RET_ON_ERR(mesg_conv_.setup(*config, charmap_, fix_encoding_str(tmp, buf), NormTo));
+      else 
+#endif
+        RET_ON_ERR(mesg_conv_.setup(*config, charmap_, data_encoding_, NormTo));
+      // no need to check for errors here since we know charmap_ is a
+      // supported encoding
+      to_utf8_.setup(*config, charmap_, "utf-8", NormTo);
+      from_utf8_.setup(*config, "utf-8", charmap_, NormFrom);
+    }
+
+    if (from_bundle)
+      return no_err;
+    
+    Conv iconv;
+    RET_ON_ERR(iconv.setup(*config, data_encoding_, charmap_, NormFrom));
+    data_conv_.setup(*config, data_encoding_, charmap_, NormFrom);
+
+    //
+    // set up special
+    //
+
+    init(data.retrieve("special"), d, buf);
+    while (split(d)) {
+      char c = iconv(d.key)[0];
+      split(d);
+      special_[to_uchar(c)] = 
+        SpecialChar (d.key[0] == '*',d.key[1] == '*', d.key[2] == '*');
+    }
+
+    //
+    // prep phonetic code
+    //
+
+    {
+      PosibErr<Soundslike *> pe = new_soundslike(data.retrieve("soundslike"),
+                                                 iconv,
+                                               this);
+      if (pe.has_err()) return pe;
+      soundslike_.reset(pe.data);
+    }
+
+    have_soundslike_ = strcmp(soundslike_->name(), "none") != 0;
+
+    if (strcmp(soundslike_->name(), "phonet") == 0)
+      sources_.push_back(dir_ + name_ + "_phonet.dat");
+
+    //
+    // prep affix code
+    //
+    {
+      PosibErr<AffixMgr *> pe = new_affix_mgr(data.retrieve("affix"), iconv, this);
+      if (pe.has_err()) return pe;
+      affix_.reset(pe.data);
+    }
+
+    if (affix_)
+      sources_.push_back(dir_ + name_ + "_affix.dat");
+
+    //
+    // find the repl table (if any), it is read in setup_suggest
+    //
+
+    String repl = data.retrieve("repl-table");
+    have_repl_ = false;
+    if (repl != "none") {
+      find_file(repl_file_, dir1, dir2, repl, "_repl", ".dat");
+      sources_.push_back(repl_file_);
+    }
+    return no_err;
+  }
+
+  PosibErr<void> Language::setup_suggest() const
+  {
+    if (atomic_load(suggest_ready_)) return no_err;
+    LOCK(&suggest_lock_);
+    if (suggest_ready_) return no_err;
+    Language * self = const_cast<Language *>(this);
+    RET_ON_ERR(soundslike_->load());
+    self->soundslike_chars_ = soundslike_->soundslike_chars();
+    RET_ON_ERR(self->read_repl());
+    atomic_store(self->suggest_ready_, true);
+    return no_err;
+  }
+
+  PosibErr<void> Language::read_repl()
+  {
+    if (repl_file_.empty()) return no_err;
+
+    ConvP iconv(data_conv_);
+    String buf;
     DataPair d;
+    FStream REPL;
+    RET_ON_ERR(REPL.open(repl_file_, "r"));
+
+    repls_.clear();
+    size_t num_repl = 0;
+    while (getdata_pair(REPL, d, buf)) {
+      ::to_lower(d.key);
+      if (d.key == "rep") {
+        num_repl = atoi(d.value); // FIXME make this more robust
+        break;
+      }
+    }
+
+    if (num_repl > 0)
+      have_repl_ = true;
+
+    for (size_t i = 0; i != num_repl; ++i) {
+      bool res = getdata_pair(REPL, d, buf);
+      assert(res); // FIXME
+      ::to_lower(d.key);
+      assert(d.key == "rep"); // FIXME
+      split(d);
+      SuggestRepl rep;
+      rep.substr = buf_.dup(iconv(d.key));
+      if (check_if_valid(*this, rep.substr).get_err()) 
+        continue; // FIXME: This should probably be an error, but
+                  // this may cause problems with compatibility with
+                  // Myspell as these entries may make sense for
+                  // Myspell (but obviously not for Aspell)
+      to_clean((char *)rep.substr, rep.substr);
+      rep.repl   = buf_.dup(iconv(d.value));
+      if (check_if_valid(*this, rep.repl).get_err()) 
+        continue; // FIXME: Ditto
+      to_clean((char *)rep.repl, rep.repl);
+      if (strcmp(rep.substr, rep.repl) == 0 || rep.substr[0] == '\0')
+        continue; // FIXME: Ditto
+      repls_.push_back(rep);
+    }
+
+    return no_err;
+  }
+
+  PosibErr<void> Language::read_charset(const String & dir1, 
+                                        const String & dir2)
+  {
+    Config & data = *lang_config_;
+    String buf;
 
     //
     // read header of cset data file
@@ -125,6 +300,7 @@ namespace aspeller {
     String char_data_name;
     find_file(char_data_name,dir1,dir2,charset_,".cset");
     RET_ON_ERR(char_data.open(char_data_name, "r"));
+    sources_.push_back(char_data_name);
     
     String temp;
     char * p;
@@ -216,118 +392,245 @@ namespace aspeller {
         data_encoding_ = charmap_;
       }
     }
-      
-    //
-    // set up conversions
-    //
-    {
-#ifdef ENABLE_NLS
-      const char * tmp = 0;
-      tmp = bind_textdomain_codeset("aspell", 0);
-#ifdef HAVE_LANGINFO_CODESET
-      if (!tmp) tmp = nl_langinfo(CODESET);
+
+    return no_err;
+  }
+
+  //
+  // precompiled language bundles, see lang_bundle.hpp
+  //
+
+  static const char * const LANG_BUNDLE_MAGIC = "aspell language bundle";
+  static const unsigned int LANG_BUNDLE_BYTE_ORDER = 0x01020304;
+
+  // the options which change how the data files are converted
+  static void get_bundle_conv_key(const Config & config, String & key)
+  {
+    key.clear();
+    key.printf("normalize=%d norm-required=%d norm-strict=%d",
+               config.retrieve_bool("normalize").data,
+               config.retrieve_bool("norm-required").data,
+               config.retrieve_bool("norm-strict").data);
+  }
+
+  // the contents of a file, mapped into memory when possible
+  class BundleFile {
+    char * begin_;
+    long   size_;
+    bool   mapped_;
+    String buf_;
+    BundleFile(const BundleFile &);
+    void operator=(const BundleFile &);
+  public:
+    BundleFile() : begin_(0), size_(0), mapped_(false) {}
+    ~BundleFile() {
+#ifdef HAVE_MMAP
+      if (mapped_) munmap(begin_, size_);
 #endif
-      if (ascii_encoding(*config, tmp)) tmp = 0;
-      if (tmp)
-        RET_ON_ERR(mesg_conv_.setup(*config, charmap_, fix_encoding_str(tmp, buf), NormTo));
-      else 
+    }
+    const char * begin() const {return begin_;}
+    const char * end() const {return begin_ + size_;}
+    PosibErr<void> open(ParmString file) {
+      FStream f;
+      RET_ON_ERR(f.open(file, "r"));
+      f.seek(0, SEEK_END);
+      size_ = f.tell();
+      f.seek(0);
+#ifdef HAVE_MMAP
+      void * block = mmap(NULL, size_, PROT_READ, MAP_SHARED, f.file_no(), 0);
+      if (block != MAP_FAILED) {
+        begin_ = static_cast<char *>(block);
+        mapped_ = true;
+        return no_err;
+      }
 #endif
-        RET_ON_ERR(mesg_conv_.setup(*config, charmap_, data_encoding_, NormTo));
-      // no need to check for errors here since we know charmap_ is a
-      // supported encoding
-      to_utf8_.setup(*config, charmap_, "utf-8", NormTo);
-      from_utf8_.setup(*config, "utf-8", charmap_, NormFrom);
+      buf_.resize(size_);
+      begin_ = buf_.data();
+      if (!f.read(begin_, size_))
+        return make_err(cant_read_file, file);
+      return no_err;
     }
-    
-    Conv iconv;
-    RET_ON_ERR(iconv.setup(*config, data_encoding_, charmap_, NormFrom));
+  };
 
-    //
-    // set up special
-    //
+  PosibErr<void> Language::write_bundle(ParmString file, 
+                                        const Config & config) const
+  {
+    RET_ON_ERR(setup_suggest());
+
+    LangBundleOut out;
+    out.put_str(LANG_BUNDLE_MAGIC);
+    out.put(LANG_BUNDLE_VERSION);
+    out.put(LANG_BUNDLE_BYTE_ORDER);
+
+    String key;
+    get_bundle_conv_key(config, key);
+    out.put_str(key);
+
+    out.put(sources_.size());
+    for (unsigned i = 0; i != sources_.size(); ++i) {
+      time_t mtime;
+      long size;
+      if (!get_file_info(sources_[i], mtime, size))
+        return make_err(cant_read_file, sources_[i]);
+      out.put_str(sources_[i]);
+      out.put(size);
+      out.put(mtime);
+    }
 
-    init(data.retrieve("special"), d, buf);
-    while (split(d)) {
-      char c = iconv(d.key)[0];
-      split(d);
-      special_[to_uchar(c)] = 
-        SpecialChar (d.key[0] == '*',d.key[1] == '*', d.key[2] == '*');
+    out.put_str(charmap_);
+    out.put_str(data_encoding_);
+
+    char bytes[256];
+    for (unsigned i = 0; i != 256; ++i)
+      out.put(to_uni_[i]);
+    for (unsigned i = 0; i != 256; ++i)
+      bytes[i] = char_type_[i];
+    out.put(bytes, 256);
+    for (unsigned i = 0; i != 256; ++i)
+      bytes[i] = char_info_[i];
+    out.put(bytes, 256);
+    out.put(to_lower_, 256);
+    out.put(to_upper_, 256);
+    out.put(to_title_, 256);
+    out.put(to_stripped_, 256);
+    out.put(to_plain_, 256);
+    out.put(to_clean_, 256);
+    out.put(de_accent_, 256);
+    out.put(sl_first_, 256);
+    out.put(sl_rest_, 256);
+    for (unsigned i = 0; i != 256; ++i) {
+      char s[3] = {special_[i].begin, special_[i].middle, special_[i].end};
+      out.put(s, 3);
     }
+    out.put(store_as_);
 
-    //
-    // prep phonetic code
-    //
+    RET_ON_ERR(soundslike_->write_bundle(out));
+    if (affix_)
+      affix_->write_bundle(out);
 
-    {
-      PosibErr<Soundslike *> pe = new_soundslike(data.retrieve("soundslike"),
-                                                 iconv,
-                                               this);
-      if (pe.has_err()) return pe;
-      soundslike_.reset(pe.data);
+    out.put(have_repl_);
+    out.put(repls_.size());
+    for (unsigned i = 0; i != repls_.size(); ++i) {
+      out.put_str(repls_[i].substr);
+      out.put_str(repls_[i].repl);
     }
-    soundslike_chars_ = soundslike_->soundslike_chars();
 
-    have_soundslike_ = strcmp(soundslike_->name(), "none") != 0;
+    String tmp = file;
+    tmp += ".new";
+    FStream f;
+    RET_ON_ERR(f.open(tmp, "w"));
+    f.write(out.data().data(), out.data().size());
+    f.close();
+    if (!rename_file(tmp, file))
+      return make_err(cant_write_file, file);
+    return no_err;
+  }
 
-    //
-    // prep affix code
-    //
+  // returns false if the bundle is out of date or otherwise unusable
+  PosibErr<bool> Language::read_bundle(ParmString file, const Config & config)
+  {
+    BundleFile data;
+    RET_ON_ERR(data.open(file));
+    LangBundleIn in(data.begin(), data.end());
+
+    if (strcmp(in.get_str(), LANG_BUNDLE_MAGIC) != 0
+        || in.get() != LANG_BUNDLE_VERSION
+        || in.get() != LANG_BUNDLE_BYTE_ORDER)
+      return false;
+
+    String key;
+    get_bundle_conv_key(config, key);
+    if (key != in.get_str()) return false;
+
+    // the first source is always the ".dat" file
+    unsigned num = in.get_count(3 * sizeof(unsigned) + 1);
+    if (num == 0) return false;
+    for (unsigned i = 0; i != num; ++i) {
+      const char * name = in.get_str();
+      unsigned size = in.get();
+      unsigned mtime = in.get();
+      time_t cur_mtime;
+      long cur_size;
+      if (i == 0 && sources_[0] != name) return false;
+      if (!get_file_info(name, cur_mtime, cur_size) 
+          || (unsigned)cur_size != size || (unsigned)cur_mtime != mtime)
+        return false;
+    }
+
+    String charmap = in.get_str();
+    String data_encoding = in.get_str();
+
+    char bytes[256];
+    for (unsigned i = 0; i != 256; ++i)
+      to_uni_[i] = in.get();
+    in.get(bytes, 256);
+    for (unsigned i = 0; i != 256; ++i)
+      char_type_[i] = static_cast<CharType>(bytes[i]);
+    in.get(bytes, 256);
+    for (unsigned i = 0; i != 256; ++i)
+      char_info_[i] = to_uchar(bytes[i]);
+    in.get(to_lower_, 256);
+    in.get(to_upper_, 256);
+    in.get(to_title_, 256);
+    in.get(to_stripped_, 256);
+    in.get(to_plain_, 256);
+    in.get(to_clean_, 256);
+    in.get(de_accent_, 256);
+    in.get(sl_first_, 256);
+    in.get(sl_rest_, 256);
+    SpecialChar special[256];
+    for (unsigned i = 0; i != 256; ++i) {
+      char s[3];
+      in.get(s, 3);
+      special[i] = SpecialChar(s[0], s[1], s[2]);
+    }
+    store_as_ = in.get() == Lower ? Lower : Stripped;
+
+    if (in.bad()) return false;
+
+    StackPtr<Soundslike> soundslike;
     {
-      PosibErr<AffixMgr *> pe = new_affix_mgr(data.retrieve("affix"), iconv, this);
+      PosibErr<Soundslike *> pe = new_soundslike(lang_config_->retrieve("soundslike"),
+                                                 in, this);
       if (pe.has_err()) return pe;
-      affix_.reset(pe.data);
+      soundslike.reset(pe.data);
     }
 
-    //
-    // fill repl tables (if any)
-    //
+    StackPtr<AffixMgr> affix;
+    {
+      PosibErr<AffixMgr *> pe = new_affix_mgr(lang_config_->retrieve("affix"), 
+                                              in, this);
+      if (pe.has_err()) return pe;
+      affix.reset(pe.data);
+    }
 
-    String repl = data.retrieve("repl-table");
-    have_repl_ = false;
-    if (repl != "none") {
+    bool have_repl = in.get();
+    Vector<SuggestRepl> repls(in.get_count(2 * (sizeof(unsigned) + 1)));
+    for (unsigned i = 0; i != repls.size(); ++i) {
+      repls[i].substr = buf_.dup(in.get_str());
+      repls[i].repl   = buf_.dup(in.get_str());
+    }
 
-      String repl_file;
-      FStream REPL;
-      find_file(repl_file, dir1, dir2, repl, "_repl", ".dat");
-      RET_ON_ERR(REPL.open(repl_file, "r"));
-      
-      size_t num_repl = 0;
-      while (getdata_pair(REPL, d, buf)) {
-        ::to_lower(d.key);
-        if (d.key == "rep") {
-          num_repl = atoi(d.value); // FIXME make this more robust
-          break;
-        }
-      }
+    if (in.bad() || !in.at_end()) return false;
 
-      if (num_repl > 0)
-        have_repl_ = true;
-
-      for (size_t i = 0; i != num_repl; ++i) {
-        bool res = getdata_pair(REPL, d, buf);
-        assert(res); // FIXME
-        ::to_lower(d.key);
-        assert(d.key == "rep"); // FIXME
-        split(d);
-        SuggestRepl rep;
-        rep.substr = buf_.dup(iconv(d.key));
-        if (check_if_valid(*this, rep.substr).get_err()) 
-          continue; // FIXME: This should probably be an error, but
-                    // this may cause problems with compatibility with
-                    // Myspell as these entries may make sense for
-                    // Myspell (but obviously not for Aspell)
-        to_clean((char *)rep.substr, rep.substr);
-        rep.repl   = buf_.dup(iconv(d.value));
-        if (check_if_valid(*this, rep.repl).get_err()) 
-          continue; // FIXME: Ditto
-        to_clean((char *)rep.repl, rep.repl);
-        if (strcmp(rep.substr, rep.repl) == 0 || rep.substr[0] == '\0')
-          continue; // FIXME: Ditto
-        repls_.push_back(rep);
-      }
+    charmap_ = charmap;
+    data_encoding_ = data_encoding;
+    for (unsigned i = 0; i != 256; ++i)
+      special_[i] = special[i];
+    clean_chars_ = get_clean_chars(*this);
+    soundslike_.reset(soundslike.release());
+    soundslike_chars_ = soundslike_->soundslike_chars();
+    suggest_ready_ = true;
+    have_soundslike_ = strcmp(soundslike_->name(), "none") != 0;
+    affix_.reset(affix.release());
+    have_repl_ = have_repl;
+    repls_.swap(repls);
+    return true;
+  }
 
-    }
-    return no_err;
+  size_t Language::memory_used() const
+  {
+    return sizeof(*this) + (affix_ ? affix_->memory_used() : 0);
   }
 
   void Language::set_lang_defaults(Config & config) const
@@ -592,6 +895,24 @@ namespace aspeller {
       return get_cache_data(&language_cache, &config, lang);
   }
 
+  PosibErr<String> compile_language(const Config & config0, ParmStr lang0)
+  {
+    // resolve the language the same way as when it is loaded, so that
+    // "en_US" is compiled from "en.dat" if there is no "en_US.dat"
+    StackPtr<Config> config(config0.clone());
+    if (lang0)
+      RET_ON_ERR(config->replace("lang", lang0));
+    String lang = find_language(*config) 
+      ? config->retrieve("actual-lang") : config->retrieve("lang");
+    Language l;
+    RET_ON_ERR(l.setup(lang, config, false));
+    String file = l.data_dir();
+    file += lang;
+    file += ".bundle";
+    RET_ON_ERR(l.write_bundle(file, *config));
+    return file;
+  }
+
   PosibErr<void> open_affix_file(const Config & c, FStream & f)
   {
     String lang = c.retrieve("lang");
@@ -7,6 +7,7 @@
 #include "cache.hpp"
 #include "config.hpp"
 #include "convert.hpp"
+#include "lock.hpp"
 #include "phonetic.hpp"
 #include "posib_err.hpp"
 #include "stack_ptr.hpp"
@@ -24,6 +25,8 @@ namespace acommon {
 
 namespace aspeller {
 
+  class LangBundleIn;
+
   struct SuggestRepl {
     const char * substr;
     const char * repl;
@@ -88,6 +91,7 @@ namespace aspeller {
     ConvObj  mesg_conv_;
     ConvObj  to_utf8_;
     ConvObj  from_utf8_;
+    ConvObj  data_conv_;
 
     unsigned char to_uchar(char c) const {return static_cast<unsigned char>(c);}
 
@@ -117,10 +121,24 @@ namespace aspeller {
 
     StringBuffer buf_;
     Vector<SuggestRepl> repls_;
+    String repl_file_;
+
+    // The soundslike rules and the replacement table are only needed
+    // for suggestions so they are not read until setup_suggest is
+    // first called.  "suggest_ready_" is only set while holding
+    // "suggest_lock_".
+    mutable Mutex suggest_lock_;
+    bool suggest_ready_;
+
+    Vector<String> sources_; // the files the language was set up from
 
     Language(const Language &);
     void operator=(const Language &);
 
+    PosibErr<void> read_charset(const String & dir1, const String & dir2);
+    PosibErr<bool> read_bundle(ParmString file, const Config & config);
+    PosibErr<void> read_repl();
+
   public: // but don't use
 
     char          sl_first_[256];
@@ -128,8 +146,15 @@ namespace aspeller {
 
   public:
 
-    Language() {}
-    PosibErr<void> setup(const String & lang, const Config * config);
+    Language() : suggest_ready_(false) {}
+    // if "use_bundle" is true and there is an up to date precompiled
+    // bundle for the language it is used instead of the data files
+    PosibErr<void> setup(const String & lang, const Config * config, 
+                         bool use_bundle = true);
+    PosibErr<void> write_bundle(ParmString file, const Config & config) const;
+    // reads the data only needed for suggestions, it is safe to call
+    // this more than once and from more than one thread
+    PosibErr<void> setup_suggest() const;
     void set_lang_defaults(Config & config) const;
 
     const char * data_dir() const {return dir_.c_str();}
@@ -140,6 +165,8 @@ namespace aspeller {
     const Convert * mesg_conv() const {return mesg_conv_.ptr;}
     const Convert * to_utf8() const {return to_utf8_.ptr;}
     const Convert * from_utf8() const {return from_utf8_.ptr;}
+    // from the encoding of the data files to the internal one
+    const Convert * data_conv() const {return data_conv_.ptr;}
 
     int to_uni(char c) const {return to_uni_[to_uchar(c)];}
 
@@ -278,6 +305,7 @@ namespace aspeller {
       else return soundslike_->to_soundslike(res,str,len);
     }
 
+    // only valid after setup_suggest
     const char * soundslike_chars() const {return soundslike_chars_.c_str();}
 
     //
@@ -306,6 +334,7 @@ namespace aspeller {
     // Repl
     //
 
+    // only valid after setup_suggest
     bool have_repl() const {return have_repl_;}
 
     SuggestReplEnumeration * repl() const {
@@ -347,6 +376,8 @@ namespace aspeller {
     }
 
     bool cache_key_eq(const String & l) const  {return name_ == l;}
+    const char * cache_desc() const {return name();}
+    size_t memory_used() const;
   };
 
   typedef Language LangImpl;
@@ -404,6 +435,27 @@ namespace aspeller {
     }
   };
 
+  template <typename HASH_INT = size_t>
+  struct CleanKey {
+    // a word and its InsensitiveHash, computed once so that the word
+    // can be looked up in a table which stores the hash (or part of
+    // it) of each entry, and only compared to the entries whose hash
+    // matches.  As the hash only multiplies and adds, the hash for a
+    // narrower HASH_INT is the truncation of the size_t one, so the
+    // size_t hash can be computed once for any table.
+    const Language * lang;
+    const char * str;
+    HASH_INT hash;
+    CleanKey(const Language * l, const char * s)
+      : lang(l), str(s), hash(InsensitiveHash<HASH_INT>(l)(s)) {}
+    CleanKey(const Language * l, const char * s, HASH_INT h)
+      : lang(l), str(s), hash(h) {}
+    bool operator== (const char * w) const
+    {
+      return InsensitiveCompare(lang)(str, w) == 0;
+    }
+  };
+
   struct SensitiveCompare {
     const Language * lang;
     bool case_insensitive;
@@ -471,6 +523,11 @@ namespace aspeller {
 
   PosibErr<Language *> new_language(const Config &, ParmStr lang = 0);
 
+  // sets up the language from its data files and saves it as a
+  // precompiled bundle next to its ".dat" file, returns the name of
+  // the bundle
+  PosibErr<String> compile_language(const Config &, ParmStr lang = 0);
+
   PosibErr<void> open_affix_file(const Config &, FStream & o);
 }
 
@@ -36,6 +36,7 @@
 #include "fstream.hpp"
 #include "getdata.hpp"
 #include "language.hpp"
+#include "lang_bundle.hpp"
 #include "objstack.hpp"
 #include "vararray.hpp"
 
@@ -73,6 +74,7 @@ namespace aspeller {
   };
 
   static void init_phonet_hash(PhonetParms & parms);
+  static void init_phonet_tables(PhonetParms & parms);
 
   // like strcpy but safe if the strings overlap
   //   but only if dest < src
@@ -82,8 +84,22 @@ namespace aspeller {
     *dest = '\0';
   }
   
+  PosibErr<String> phonet_version(const String & file)
+  {
+    String buf; DataPair dp;
+
+    FStream in;
+    RET_ON_ERR(in.open(file, "r"));
+
+    while (getdata_pair(in, dp, buf)) {
+      if (dp.key == "version")
+        return String(dp.value);
+    }
+    return make_err(bad_file_format, file, "You must specify a version string");
+  }
+
   PosibErr<PhonetParms *> new_phonet(const String & file, 
-                                     Conv & iconv,
+                                     ConvP & iconv,
                                      const Language * lang) 
   {
     String buf; DataPair dp;
@@ -144,20 +160,70 @@ namespace aspeller {
     *(r+1) = PhonetParms::rules_end;
     parms->rules = (const char * *)parms->data;
 
+    init_phonet_tables(*parms);
 
-    for (unsigned i = 0; i != 256; ++i) {
-      parms->to_clean[i] = (lang->char_type(i) > Language::NonLetter 
-                            ? (parms->remove_accents 
-                               ? lang->to_upper(lang->de_accent(i)) 
-                               : lang->to_upper(i))
-                            : 0);
+    return parms;
+  }
+
+  void write_phonet_bundle(LangBundleOut & out, const PhonetParms & parms)
+  {
+    out.put_str(parms.version);
+    char flags[3] = {parms.followup, parms.collapse_result, 
+                     parms.remove_accents};
+    out.put(flags, 3);
+    unsigned num = 0;
+    for (int i = 0; parms.rules[i] != PhonetParms::rules_end; i += 2)
+      ++num;
+    out.put(num);
+    for (int i = 0; parms.rules[i] != PhonetParms::rules_end; i += 2) {
+      out.put_str(parms.rules[i]);
+      out.put_str(parms.rules[i+1]);
     }
+  }
 
-    init_phonet_hash(*parms);
+  PosibErr<PhonetParms *> new_phonet(LangBundleIn & in,
+                                     const Language * lang)
+  {
+    PhonetParmsImpl * parms = new PhonetParmsImpl();
+
+    parms->lang = lang;
+
+    parms->version = in.get_str();
+    char flags[3];
+    in.get(flags, 3);
+    parms->followup        = flags[0];
+    parms->collapse_result = flags[1];
+    parms->remove_accents  = flags[2];
+
+    unsigned num = in.get_count(2 * (sizeof(unsigned) + 1));
+    parms->data = malloc(sizeof(char *) * (2 * num + 2));
+
+    const char * * r = (const char * *)parms->data;
+    for (unsigned i = 0; i != 2 * num; ++i, ++r)
+      *r = parms->strings.dup(in.get_str());
+    *(r  ) = PhonetParms::rules_end;
+    *(r+1) = PhonetParms::rules_end;
+    parms->rules = (const char * *)parms->data;
+
+    init_phonet_tables(*parms);
 
     return parms;
   }
 
+  static void init_phonet_tables(PhonetParms & parms)
+  {
+    const Language * lang = parms.lang;
+    for (unsigned i = 0; i != 256; ++i) {
+      parms.to_clean[i] = (lang->char_type(i) > Language::NonLetter 
+                           ? (parms.remove_accents 
+                              ? lang->to_upper(lang->de_accent(i)) 
+                              : lang->to_upper(i))
+                           : 0);
+    }
+
+    init_phonet_hash(parms);
+  }
+
   static void init_phonet_hash(PhonetParms & parms) 
   {
     int i, k;
@@ -25,11 +25,13 @@
 
 using namespace acommon;
 
-namespace acommon {struct Conv;}
+namespace acommon {struct ConvP;}
 
 namespace aspeller {
 
   class Language;
+  class LangBundleIn;
+  class LangBundleOut;
 
   struct PhonetParms {
     String version;
@@ -62,7 +64,15 @@ namespace aspeller {
 #endif
 
   PosibErr<PhonetParms *> new_phonet(const String & file, 
-                                     Conv & iconv,
+                                     ConvP & iconv,
+                                     const Language * lang);
+
+  // only reads the version string from a rules file
+  PosibErr<String> phonet_version(const String & file);
+
+  // for precompiled language bundles
+  void write_phonet_bundle(LangBundleOut &, const PhonetParms &);
+  PosibErr<PhonetParms *> new_phonet(LangBundleIn &,
                                      const Language * lang);
 
 }
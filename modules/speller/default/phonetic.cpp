@@ -3,10 +3,13 @@
 #include "language.hpp"
 #include "phonetic.hpp"
 #include "phonet.hpp"
+#include "lang_bundle.hpp"
 
+#include "convert.hpp"
 #include "file_util.hpp"
 #include "file_data_util.hpp"
 #include "clone_ptr-t.hpp"
+#include "lock.hpp"
 
 namespace aspeller {
   
@@ -23,6 +26,12 @@ namespace aspeller {
       memcpy(rest,  lang->sl_rest_, 256);
       return no_err;
     }
+
+    PosibErr<void> setup(LangBundleIn &) {
+      memcpy(first, lang->sl_first_, 256);
+      memcpy(rest,  lang->sl_rest_, 256);
+      return no_err;
+    }
     
     String soundslike_chars() const {
       bool chars_set[256] = {0};
@@ -77,6 +86,7 @@ namespace aspeller {
     NoSoundslike(const Language * l) : lang(l) {}
 
     PosibErr<void> setup(Conv &) {return no_err;}
+    PosibErr<void> setup(LangBundleIn &) {return no_err;}
     
     String soundslike_chars() const {
       return get_clean_chars(*lang);
@@ -102,6 +112,7 @@ namespace aspeller {
     StrippedSoundslike(const Language * l) : lang(l) {}
 
     PosibErr<void> setup(Conv &) {return no_err;}
+    PosibErr<void> setup(LangBundleIn &) {return no_err;}
     
     String soundslike_chars() const {
       return get_stripped_chars(*lang);
@@ -123,21 +134,59 @@ namespace aspeller {
   class PhonetSoundslike : public Soundslike {
 
     const Language * lang;
-    StackPtr<PhonetParms> phonet_parms;
+    // The rules are only read when they are first used, since only
+    // suggestions need them, until then only the version is known.
+    // "phonet_parms" is only set while holding "lock".
+    mutable Mutex lock;
+    mutable PhonetParms * phonet_parms;
+    String file;
+    String version_;
+
+    // returns null if the rules could not be read
+    const PhonetParms * parms() const {
+      const PhonetParms * p = atomic_load(phonet_parms);
+      if (p) return p;
+      load().ignore_err();
+      return atomic_load(phonet_parms);
+    }
     
   public:
 
-    PhonetSoundslike(const Language * l) : lang(l) {}
+    PhonetSoundslike(const Language * l) : lang(l), phonet_parms(0) {}
+    ~PhonetSoundslike() {delete phonet_parms;}
 
-    PosibErr<void> setup(Conv & iconv) {
-      String file;
+    PosibErr<void> setup(Conv &) {
       file += lang->data_dir();
       file += '/';
       file += lang->name();
       file += "_phonet.dat";
+      RET_ON_ERR_SET(phonet_version(file), String, v);
+      version_ = v;
+      return no_err;
+    }
+
+    PosibErr<void> setup(LangBundleIn & in) {
+      PosibErr<PhonetParms *> pe = new_phonet(in, lang);
+      if (pe.has_err()) return pe;
+      phonet_parms = pe;
+      version_ = phonet_parms->version;
+      return no_err;
+    }
+
+    PosibErr<void> load() const {
+      if (atomic_load(phonet_parms)) return no_err;
+      LOCK(&lock);
+      if (phonet_parms) return no_err;
+      ConvP iconv(lang->data_conv());
       PosibErr<PhonetParms *> pe = new_phonet(file, iconv, lang);
       if (pe.has_err()) return pe;
-      phonet_parms.reset(pe);
+      atomic_store(phonet_parms, pe.data);
+      return no_err;
+    }
+
+    PosibErr<void> write_bundle(LangBundleOut & out) const {
+      RET_ON_ERR(load());
+      write_phonet_bundle(out, *phonet_parms);
       return no_err;
     }
 
@@ -146,6 +195,8 @@ namespace aspeller {
     {
       bool chars_set[256] = {0};
       String     chars_list;
+      const PhonetParms * phonet_parms = parms();
+      if (!phonet_parms) return chars_list;
       for (const char * * i = phonet_parms->rules + 1; 
 	   *(i-1) != PhonetParms::rules_end;
 	   i += 2) 
@@ -163,9 +214,13 @@ namespace aspeller {
       return chars_list;
     }
     
+    // the rules should have been read with load() first, which
+    // reports any error; if they could not be read the result is empty
     char * to_soundslike(char * res, const char * str, int size) const 
     {
-      int new_size = phonet(str, res, size, *phonet_parms);
+      const PhonetParms * p = parms();
+      if (!p) {*res = '\0'; return res;}
+      int new_size = phonet(str, res, size, *p);
       return res + new_size;
     }
     
@@ -175,14 +230,13 @@ namespace aspeller {
     }
     const char * version() const 
     {
-      return phonet_parms->version.c_str();
+      return version_.c_str();
     }
   };
   
   
-  PosibErr<Soundslike *> new_soundslike(ParmString name, 
-                                        Conv & iconv,
-                                        const Language * lang)
+  static Soundslike * make_soundslike(ParmString name,
+                                      const Language * lang)
   {
     Soundslike * sl;
     if (name == "simple" || name == "generic") {
@@ -196,6 +250,14 @@ namespace aspeller {
     } else {
       abort(); // FIXME
     }
+    return sl;
+  }
+
+  PosibErr<Soundslike *> new_soundslike(ParmString name, 
+                                        Conv & iconv,
+                                        const Language * lang)
+  {
+    Soundslike * sl = make_soundslike(name, lang);
     PosibErrBase pe = sl->setup(iconv);
     if (pe.has_err()) {
       delete sl;
@@ -204,5 +266,19 @@ namespace aspeller {
       return sl;
     }
   }
+
+  PosibErr<Soundslike *> new_soundslike(ParmString name, 
+                                        LangBundleIn & in,
+                                        const Language * lang)
+  {
+    Soundslike * sl = make_soundslike(name, lang);
+    PosibErrBase pe = sl->setup(in);
+    if (pe.has_err()) {
+      delete sl;
+      return pe;
+    } else {
+      return sl;
+    }
+  }
 }
 
@@ -12,6 +12,8 @@ namespace acommon {struct Conv;}
 namespace aspeller {
 
   class Language;
+  class LangBundleIn;
+  class LangBundleOut;
 
   class Soundslike {
   public:
@@ -21,12 +23,24 @@ namespace aspeller {
     virtual const char * name() const = 0;
     virtual const char * version() const = 0;
     virtual PosibErr<void> setup(Conv &) = 0;
+    // loads any data which is only read when first needed, it is
+    // safe to call this from more than one thread
+    virtual PosibErr<void> load() const {return no_err;}
+    // set up from, or save to, a precompiled language bundle
+    virtual PosibErr<void> setup(LangBundleIn &) = 0;
+    virtual PosibErr<void> write_bundle(LangBundleOut &) const {
+      return no_err;
+    }
     virtual ~Soundslike() {}
   };
 
   PosibErr<Soundslike *> new_soundslike(ParmString name,
                                         Conv & conv,
                                         const Language * lang);
+
+  PosibErr<Soundslike *> new_soundslike(ParmString name,
+                                        LangBundleIn &,
+                                        const Language * lang);
 };
 
 #endif
@@ -37,7 +37,6 @@ using std::pair;
 
 #include "settings.h"
 
-#include "block_vector.hpp"
 #include "config.hpp"
 #include "data.hpp"
 #include "data_util.hpp"
@@ -197,23 +196,6 @@ namespace {
   class ReadOnlyDict : public Dictionary
   {
 
-  public: //but don't use
-
-    struct WordLookupParms {
-      const char * block_begin;
-      WordLookupParms() {}
-      typedef BlockVector<const u32int> Vector;
-      typedef u32int                    Value;
-      typedef const char *              Key;
-      static const bool is_multi = false;
-      Key key(Value v) const {return block_begin + v;}
-      InsensitiveHash<hash_int_t> hash;
-      InsensitiveEqual equal;
-      bool is_nonexistent(Value v) const {return v == u32int_max;}
-      void make_nonexistent(const Value & v) const {abort();}
-    };
-    typedef VectorHashTable<WordLookupParms> WordLookup;
-
   public: // but don't use
       
     char *           block;
@@ -222,9 +204,14 @@ namespace {
     u32int           mmaped_size;
     const Jump * jump1;
     const Jump * jump2;
-    WordLookup       word_lookup;
+    // the word hash table, laid out as a VectorHashTable of offsets
+    // into word_block, with u32int_max for empty buckets (see create())
+    const u32int *   word_buckets;
+    u32int           word_bucket_count;
+    u32int           word_count;
     const char *     word_block;
     const char *     first_word;
+    String           dict_name;
     
     ReadOnlyDict(const ReadOnlyDict&);
     ReadOnlyDict& operator= (const ReadOnlyDict&);
@@ -253,12 +240,32 @@ namespace {
     }
     
     PosibErr<void> load(ParmString, Config &, DictList *, SpellerImpl *);
+    size_t memory_used() const {
+      return sizeof(*this) + (mmaped_block ? mmaped_size : block_size);
+    }
     PosibErr<void> check_hash_fun() const;
     void low_level_dump() const;
 
-    bool lookup(ParmString word, const SensitiveCompare *, WordEntry &) const;
+    const char * find(ParmString word, hash_int_t hash) const;
+    const char * find(ParmString word) const {
+      return find(word, InsensitiveHash<hash_int_t>(lang())(word));
+    }
 
-    bool clean_lookup(ParmString, WordEntry &) const;
+    bool lookup(ParmString word, const SensitiveCompare * c, 
+                WordEntry & o) const {
+      return hashed_lookup(word, InsensitiveHash<hash_int_t>(lang())(word),
+                           c, o);
+    }
+    bool hashed_lookup(ParmString, size_t, const SensitiveCompare *, 
+                       WordEntry &) const;
+
+    bool clean_lookup(ParmString word, WordEntry & o) const {
+      return hashed_clean_lookup(word, 
+                                 InsensitiveHash<hash_int_t>(lang())(word), o);
+    }
+    bool hashed_clean_lookup(ParmString, size_t, WordEntry &) const;
+
+    void prefetch(ParmString word, size_t clean_hash) const;
 
     bool soundslike_lookup(const WordEntry &, WordEntry &) const;
     bool soundslike_lookup(ParmString, WordEntry &) const;
@@ -321,12 +328,12 @@ namespace {
       if (word_info) printf(" [WI: %d]", word_info);
       //if (flags & DUPLICATE_FLAG) printf(" [NEXT DUP]");
       const char * p = w;
-      WordLookup::const_iterator i = word_lookup.find(w);
+      const char * i = find(w);
       if (!next_dup) {
-        if (i == word_lookup.end())
+        if (!i)
           printf(" <BAD HASH>");
-        else if (word_block + *i != w) {
-          printf(" <BAD HASH, got %s>", word_block + *i);
+        else if (i != w) {
+          printf(" <BAD HASH, got %s>", i);
         }
         else 
           printf(" <hash ok>");
@@ -356,8 +363,7 @@ namespace {
           ++p;
         }
       clean_size_ok:
-        WordLookup::const_iterator i = word_lookup.find(w);
-        if (i == word_lookup.end() || word_block + *i != w)
+        if (find(w) != w)
           return make_err(bad_file_format, file_name(), 
                           _("Incompatible hash function."));
         else
@@ -372,11 +378,11 @@ namespace {
   }
 
   ReadOnlyDict::Size ReadOnlyDict::size() const {
-    return word_lookup.size();
+    return word_count;
   }
   
   bool ReadOnlyDict::empty() const {
-    return word_lookup.empty();
+    return word_count == 0;
   }
 
   static const char * const cur_check_word = "aspell default speller rowl 1.10";
@@ -443,6 +449,10 @@ namespace {
 
     word.resize(data_head.dict_name_size);
     f.read(word.data(), data_head.dict_name_size);
+    {
+      const char * e = (const char *)memchr(word.data(), '\0', word.size());
+      dict_name.assign(word.data(), e ? e - word.data() : word.size());
+    }
 
     word.resize(data_head.lang_name_size);
     f.read(word.data(), data_head.lang_name_size);
@@ -498,13 +508,10 @@ namespace {
     word_block = block + data_head.word_offset;
     first_word = word_block + data_head.first_word_offset;
 
-    word_lookup.parms().block_begin = word_block;
-    word_lookup.parms().hash .lang     = lang();
-    word_lookup.parms().equal.cmp.lang = lang();
-    const u32int * begin = reinterpret_cast<const u32int *>
+    word_buckets = reinterpret_cast<const u32int *>
       (block + data_head.hash_offset);
-    word_lookup.vector().set(begin, begin + data_head.word_buckets);
-    word_lookup.set_size(data_head.word_count);
+    word_bucket_count = data_head.word_buckets;
+    word_count = data_head.word_count;
     
     //low_level_dump();
     RET_ON_ERR(check_hash_fun());
@@ -539,13 +546,41 @@ namespace {
     prep_next(wi, w, c, orig);
   }
 
-  bool ReadOnlyDict::lookup(ParmString word, const SensitiveCompare * c,
-                            WordEntry & o) const 
+  //
+  // find returns the first word with the same clean form as "word",
+  // whose InsensitiveHash is "hash", probing the buckets in the same
+  // order as VectorHashTable::find.  The word is only converted to its
+  // clean form once, by the caller.
+  //
+
+  const char * ReadOnlyDict::find(ParmString word, hash_int_t hash) const
+  {
+    CleanKey<hash_int_t> key(lang(), word, hash);
+    unsigned i = hash % word_bucket_count;
+    unsigned step = 1 + hash % (word_bucket_count - 2);
+    for (;;) {
+      u32int w = word_buckets[i];
+      if (w == u32int_max) return 0;
+      if (key == word_block + w) return word_block + w;
+      i = (i + step) % word_bucket_count;
+    }
+  }
+
+  void ReadOnlyDict::prefetch(ParmString, size_t clean_hash) const
+  {
+#ifdef __GNUC__
+    unsigned i = static_cast<hash_int_t>(clean_hash) % word_bucket_count;
+    __builtin_prefetch(word_buckets + i);
+#endif
+  }
+
+  bool ReadOnlyDict::hashed_lookup(ParmString word, size_t clean_hash,
+                                   const SensitiveCompare * c,
+                                   WordEntry & o) const 
   {
     o.clear();
-    WordLookup::const_iterator i = word_lookup.find(word);
-    if (i == word_lookup.end()) return false;
-    const char * w = word_block + *i;
+    const char * w = find(word, clean_hash);
+    if (!w) return false;
     for (;;) {
       if ((*c)(word, w)) {
         convert(w,o);
@@ -701,12 +736,12 @@ namespace {
     if (!duplicate_flag(w)) wi->adv_ = 0;
   }
 
-  bool ReadOnlyDict::clean_lookup(ParmString sl, WordEntry & o) const
+  bool ReadOnlyDict::hashed_clean_lookup(ParmString sl, size_t clean_hash,
+                                         WordEntry & o) const
   {
     o.clear();
-    WordLookup::const_iterator i = word_lookup.find(sl);
-    if (i == word_lookup.end()) return false;
-    const char * w = word_block + *i;
+    const char * w = find(sl, clean_hash);
+    if (!w) return false;
     convert(w, o);
     if (duplicate_flag(w)) o.adv_ = clean_lookup_adv;
     return true;
@@ -830,7 +865,8 @@ namespace {
 
   PosibErr<void> create (StringEnumeration * els,
 			 const Language & lang,
-                         Config & config) 
+                         Config & config,
+                         const char * dict_name = 0) 
   {
     assert(sizeof(u16int) == 2);
     assert(sizeof(u32int) == 4);
@@ -862,6 +898,9 @@ namespace {
     else
       RET_ON_ERR(iconv.setup(config, lang.data_encoding(), lang.charmap(), NormFrom));
 
+    if (!invisible_soundslike)
+      RET_ON_ERR(lang.setup_suggest());
+
     String base = config.retrieve("master-path");
 
     DataHead data_head;
@@ -870,7 +909,7 @@ namespace {
 
     data_head.endian_check = 12345678;
 
-    data_head.dict_name_size = 1;
+    data_head.dict_name_size = dict_name ? strlen(dict_name) + 1 : 1;
     data_head.lang_name_size = strlen(lang.name()) + 1;
     data_head.soundslike_name_size    = strlen(lang.soundslike_name()) + 1;
     data_head.soundslike_version_size = strlen(lang.soundslike_version()) + 1;
@@ -1246,7 +1285,10 @@ namespace {
     // write data head to file
     out.seek(0);
     out.write(&data_head, sizeof(DataHead));
-    out.write(" ", 1);
+    if (dict_name)
+      out.write(dict_name, data_head.dict_name_size);
+    else
+      out.write(" ", 1);
     out.write(lang.name(), data_head.lang_name_size);
     out.write(lang.soundslike_name(), data_head.soundslike_name_size);
     out.write(lang.soundslike_version(), data_head.soundslike_version_size);
@@ -1268,5 +1310,47 @@ namespace aspeller {
     RET_ON_ERR(create(els,*lang,config));
     return no_err;
   }
+
+  PosibErr<Dictionary *> load_word_list_cache(ParmString file,
+                                              ParmString source,
+                                              Config & config)
+  {
+    StackPtr<ReadOnlyDict> dict(new ReadOnlyDict);
+    RET_ON_ERR(dict->load(file, config, 0, 0));
+    if (dict->dict_name != source)
+      return make_err(bad_file_format, file);
+    return dict.release();
+  }
+
+  PosibErr<void> create_word_list_cache(ParmString file,
+                                        ParmString source,
+                                        StringEnumeration * els,
+                                        const Language & lang,
+                                        const Config & config0)
+  {
+    // write to a temporary file, locked so that two processes creating
+    // the same cache at once do not write over each other
+    String tmp = file;
+    tmp += ".new";
+    FStream lock;
+    RET_ON_ERR(open_file_writelock(lock, tmp));
+    StackPtr<Config> config(config0.clone());
+    config->replace("master-path", tmp);
+    config->replace("encoding", lang.charmap());
+    config->replace("affix-compress", "false");
+    // store the soundslikes whenever a WritableDict would, so that the
+    // soundslike elements are the same
+    config->replace("invisible-soundslike", 
+                    lang.have_soundslike() ? "false" : "true");
+    config->replace("warn", "false");
+    PosibErr<void> pe = create(els, lang, *config, source);
+    if (pe.has_err()) {
+      remove_file(tmp);
+      return pe;
+    }
+    if (!rename_file(tmp, file))
+      return make_err(cant_write_file, file);
+    return no_err;
+  }
 }
 
@@ -51,16 +51,19 @@ namespace aspeller {
 
   PosibErr<void> SpellerImpl::add_to_personal(MutableString word) {
     if (!personal_) return no_err;
+    clear_check_cache();
     return personal_->add(word);
   }
   
   PosibErr<void> SpellerImpl::add_to_session(MutableString word) {
     if (!session_) return no_err;
+    clear_check_cache();
     return session_->add(word);
   }
 
   PosibErr<void> SpellerImpl::clear_session() {
     if (!session_) return no_err;
+    clear_check_cache();
     return session_->clear();
   }
 
@@ -70,12 +73,20 @@ namespace aspeller {
     return SpellerImpl::store_replacement(mis,cor,true);
   }
 
+  void SpellerImpl::pin_cache_data(bool pin)
+  {
+    lang_->pin(pin);
+    for (SpellerDict * i = dicts_; i; i = i->next)
+      i->dict->pin(pin);
+  }
+
   PosibErr<void> SpellerImpl::store_replacement(const String & mis, 
                                                 const String & cor, 
                                                 bool memory) 
   {
     if (ignore_repl) return no_err;
     if (!repl_) return no_err;
+    RET_ON_ERR(setup_suggest());
     String::size_type pos;
     StackPtr<StringEnumeration> sugels(intr_suggest_->suggest(mis.c_str()).elements());
     const char * first_word = sugels->next();
@@ -130,6 +141,7 @@ namespace aspeller {
 
   PosibErr<const WordList *> SpellerImpl::suggest(MutableString word) 
   {
+    RET_ON_ERR(setup_suggest());
     return &suggest_->suggest(word);
   }
 
@@ -157,12 +169,86 @@ namespace aspeller {
       res = lang_->affix()->affix_check(LookupInfo(this, LookupInfo::Word), word, ci, 0);
       if (res) return true;
     }
-    if (affix_info && gi) {
-      lang_->affix()->affix_check(LookupInfo(this, LookupInfo::Guess), word, ci, gi);
+    if (affix_info && affix_guesses && gi) {
+      gi->defer(word);
     }
     return false;
   }
 
+  void SpellerImpl::compute_guesses()
+  {
+    GuessInfo::Pending * p = guess_info.pending;
+    guess_info.pending = 0;
+    guess_info.pending_end = &guess_info.pending;
+    for (; p; p = p->next)
+      lang_->affix()->affix_check(LookupInfo(this, LookupInfo::Guess), 
+                                  p->word, check_inf[0], &guess_info);
+  }
+
+  //
+  // Only results which can be fully restored from the cache entry are
+  // kept: correct words that are not run-together, and misspelled
+  // words when run-together words are not allowed, as the only guesses
+  // then are for the word itself.  Words accepted because they are no
+  // longer than ignore-count are not kept either, as the word of their
+  // CheckInfo points into the caller's buffer rather than into a
+  // dictionary.
+  //
+
+  PosibErr<bool> SpellerImpl::check_cached(MutableString word)
+  {
+    unsigned run_together_limit 
+      = unconditional_run_together_ ? run_together_limit_ : 0;
+    unsigned size = word.size;
+    guess_info.reset();
+    if (size == 0 || size > CheckCacheEntry::MAX_SIZE)
+      return check(word.begin(), word.end(), false, run_together_limit,
+                   check_inf, &guess_info);
+
+    ++check_cache_lookups_;
+    unsigned h = 2166136261u;
+    for (unsigned i = 0; i != size; ++i)
+      h = (h ^ static_cast<unsigned char>(word[i])) * 16777619u;
+    CheckCacheEntry & e = check_cache_[h & (check_cache_.size() - 1)];
+    if (e.size == size && memcmp(e.word, word.begin(), size) == 0) {
+      ++check_cache_hits_;
+      check_inf[0] = e.ci;
+      if (!e.correct && affix_info && affix_guesses)
+        guess_info.defer(word);
+      return e.correct;
+    }
+
+    bool res = check(word.begin(), word.end(), false, run_together_limit,
+                     check_inf, &guess_info);
+    const char * ci_word = check_inf[0].word;
+    bool word_in_buf = ci_word >= word.begin() && ci_word <= word.end();
+    if (res ? !check_inf[0].compound && !word_in_buf 
+            : run_together_limit <= 1) {
+      e.size = size;
+      e.correct = res;
+      memcpy(e.word, word.begin(), size);
+      e.ci = check_inf[0];
+    }
+    return res;
+  }
+
+  void SpellerImpl::resize_check_cache(unsigned size)
+  {
+    unsigned n = 0;
+    if (size > 0)
+      for (n = 1; n < size; n *= 2);
+    check_cache_.resize(n);
+    clear_check_cache();
+  }
+
+  void SpellerImpl::clear_check_cache()
+  {
+    for (Vector<CheckCacheEntry>::iterator i = check_cache_.begin();
+         i != check_cache_.end();
+         ++i)
+      i->size = 0;
+  }
+
   inline bool SpellerImpl::check2(char * word, /* it WILL modify word */
                                   bool try_uppercase,
                                   CheckInfo & ci, GuessInfo * gi)
@@ -184,12 +270,15 @@ namespace aspeller {
                                     unsigned run_together_limit,
                                     CheckInfo * ci, GuessInfo * gi)
   {
-    assert(run_together_limit <= 8); // otherwise it will go above the 
-                                     // bounds of the word array
     clear_check_info(*ci);
     bool res = check2(word, try_uppercase, *ci, gi);
     if (res) return true;
     if (run_together_limit <= 1) return false;
+    if (run_together_dp_)
+      return check_run_together(word, word_end, try_uppercase, 
+                                run_together_limit, ci, gi);
+    assert(run_together_limit <= 8); // otherwise it will go above the 
+                                     // bounds of the word array
     enum {Yes, No, Unknown} is_title = try_uppercase ? Yes : Unknown;
     for (char * i = word + run_together_min_; 
          i <= word_end - run_together_min_;
@@ -212,12 +301,254 @@ namespace aspeller {
     return false;
   }
 
+  //
+  // The above recursive search can check the same remainder of a word
+  // over and over again, which takes exponential time in the worst
+  // case.  When run-together-dp is set check_run_together is used
+  // instead.  It remembers, for each remainder of the word, how it can
+  // be split and how many parts were allowed when it could not be, so
+  // that each remainder is only searched once for every limit on the
+  // number of parts.  Thus at most O(n^2) lookups are needed when the
+  // limit is large, and O(limit*n^2) otherwise.  The search keeps its
+  // own stack and the tables are kept in the speller, and as even
+  // O(n^2) lookups is too many for a very long word, words longer than
+  // RUN_TOGETHER_MAX_SIZE are never split.
+  //
+
+  static const unsigned RUN_TOGETHER_MAX_SIZE = 256;
+
+  struct RunTogetherState
+  {
+    char * word;
+    unsigned size;
+    unsigned min;
+    // all indexed by 2*start + title
+    unsigned * parts;  // the number of parts word+start was split
+                       // into, or 0 if not known
+    unsigned * end;    // where the first of those parts ends
+    unsigned * failed; // the largest number of parts word+start is
+                       // known not to be able to be split into
+    GuessInfo * gi;
+  };
+
+  // returns the number of parts the word can be split into without
+  // using more than "limit" parts, or 0 if it can't be
+  unsigned SpellerImpl::run_together_parts(RunTogetherState & st, 
+                                           bool title, unsigned limit)
+  {
+    Vector<RunTogetherFrame> & stack = run_together_stack_;
+    stack.clear();
+    RunTogetherFrame top = {0, title, limit, 0};
+    stack.push_back(top);
+    CheckInfo ci;
+    unsigned ret = 0;
+    bool returned = false; // true when "ret" is the result of the
+                           // frame just popped
+    while (!stack.empty()) {
+      RunTogetherFrame & f = stack.back();
+      unsigned idx = 2*f.start + f.title;
+      char * word = st.word + f.start;
+      if (returned) {
+        // word+f.next was just searched
+        returned = false;
+        if (ret != 0) {
+          st.end[idx] = f.next;
+          ret = st.parts[idx] = ret + 1;
+          stack.pop_back();
+          returned = true;
+          continue;
+        }
+        ++f.next;
+      } else {
+        unsigned max = (st.size - f.start) / st.min;
+        if (f.limit > max) f.limit = max;
+        if (st.parts[idx] != 0 && st.parts[idx] <= f.limit) {
+          ret = st.parts[idx];
+          stack.pop_back();
+          returned = true;
+          continue;
+        }
+        if (f.limit <= st.failed[idx]) {
+          ret = 0;
+          stack.pop_back();
+          returned = true;
+          continue;
+        }
+        // the entire word has already been checked by check()
+        if (f.start != 0) {
+          clear_check_info(ci);
+          if (check2(word, f.title, ci, 0)) {
+            st.end[idx] = st.size;
+            ret = st.parts[idx] = 1;
+            stack.pop_back();
+            returned = true;
+            continue;
+          }
+        }
+        f.next = f.start + st.min;
+      }
+      GuessInfo * gi = f.start == 0 ? st.gi : 0;
+      bool pushed = false;
+      for (; f.limit > 1 && f.next + st.min <= st.size; ++f.next) {
+        char t = st.word[f.next];
+        st.word[f.next] = '\0';
+        clear_check_info(ci);
+        bool res = check2(word, f.title, ci, gi);
+        bool next_title = f.title || (res && lang_->case_pattern(word) == FirstUpper);
+        st.word[f.next] = t;
+        if (!res) continue;
+        RunTogetherFrame next = {f.next, next_title, f.limit - 1, 0};
+        stack.push_back(next); // "f" is no longer valid
+        pushed = true;
+        break;
+      }
+      if (pushed) continue;
+      st.failed[idx] = f.limit;
+      ret = 0;
+      stack.pop_back();
+      returned = true;
+    }
+    return ret;
+  }
+
+  bool SpellerImpl::check_run_together(char * word, char * word_end, 
+                                       /* it WILL modify word */
+                                       bool try_uppercase,
+                                       unsigned run_together_limit,
+                                       CheckInfo * ci, GuessInfo * gi)
+  {
+    unsigned size = word_end - word;
+    if (size > RUN_TOGETHER_MAX_SIZE) return false;
+    run_together_parts_.assign(2*size + 2, 0);
+    run_together_end_.resize(2*size + 2);
+    run_together_failed_.assign(2*size + 2, 0);
+    unsigned * end = run_together_end_.data();
+    RunTogetherState st = {word, size, run_together_min_ ? run_together_min_ : 1,
+                           run_together_parts_.data(), end, 
+                           run_together_failed_.data(), gi};
+    unsigned num = run_together_parts(st, try_uppercase, run_together_limit);
+    if (num == 0) return false;
+
+    // now fill in the check info for each part, the parts after the
+    // first go in compound_inf which only ever grows
+    if (compound_inf.size() < num - 1) compound_inf.resize(num - 1);
+    unsigned start = 0;
+    bool title = try_uppercase;
+    for (unsigned k = 0;; ++k) {
+      CheckInfo * cur = k == 0 ? ci : &compound_inf[k - 1];
+      unsigned e = end[2*start + title];
+      clear_check_info(*cur);
+      if (e == size) {
+        check2(word + start, title, *cur, 0);
+        break;
+      }
+      char t = word[e];
+      word[e] = '\0';
+      check2(word + start, title, *cur, 0);
+      bool next_title = title || lang_->case_pattern(word + start) == FirstUpper;
+      word[e] = t;
+      cur->compound = true;
+      cur->next = &compound_inf[k];
+      start = e;
+      title = next_title;
+    }
+    return true;
+  }
+
+  //
+  // check_batch first converts all the words into batch_buf_ and then
+  // looks them up one dictionary at a time, so that only one hash
+  // table is being probed at once, prefetching the bucket of a word a
+  // few words ahead of the one being looked up.  This is the same
+  // lookup check_simple does.  Only the words not found in any of the
+  // dictionaries are then checked, one at a time, with
+  // check(MutableString), as if given to aspell_speller_check, so the
+  // affix and run-together code and the check cache are used in
+  // exactly the same way.
+  //
+
+  static const unsigned BATCH_PREFETCH = 8;
+
+  PosibErr<unsigned> SpellerImpl::check_batch(const char * const * words, 
+                                              const int * lens, unsigned num,
+                                              unsigned char * out)
+  {
+    batch_buf_.clear();
+    batch_pos_.resize(num + 1);
+    for (unsigned i = 0; i != num; ++i) {
+      batch_pos_[i] = batch_buf_.size();
+      to_internal_->convert(words[i], lens[i], batch_buf_);
+      batch_buf_.append('\0');
+    }
+    batch_pos_[num] = batch_buf_.size();
+    char * buf = batch_buf_.mstr();
+
+    memset(out, 0, (num + 7) / 8);
+    batch_miss_.clear();
+    batch_hash_.resize(num);
+    InsensitiveHash<size_t> clean_hash(&lang());
+    for (unsigned i = 0; i != num; ++i) {
+      unsigned size = batch_pos_[i+1] - batch_pos_[i] - 1;
+      if (size <= ignore_count) {
+        out[i/8] |= 1 << (i%8);
+      } else {
+        batch_miss_.push_back(i);
+        batch_hash_[i] = clean_hash(buf + batch_pos_[i]);
+      }
+    }
+
+    WordEntry we;
+    for (WS::const_iterator d = check_ws.begin(); 
+         d != check_ws.end() && !batch_miss_.empty(); 
+         ++d) 
+    {
+      unsigned n = batch_miss_.size();
+      for (unsigned j = 0; j != n && j != BATCH_PREFETCH; ++j) {
+        unsigned i = batch_miss_[j];
+        (*d)->prefetch(buf + batch_pos_[i], batch_hash_[i]);
+      }
+      unsigned left = 0;
+      for (unsigned j = 0; j != n; ++j) {
+        if (j + BATCH_PREFETCH < n) {
+          unsigned k = batch_miss_[j + BATCH_PREFETCH];
+          (*d)->prefetch(buf + batch_pos_[k], batch_hash_[k]);
+        }
+        unsigned i = batch_miss_[j];
+        if ((*d)->hashed_lookup(buf + batch_pos_[i], batch_hash_[i], 
+                                &s_cmp, we))
+          out[i/8] |= 1 << (i%8);
+        else
+          batch_miss_[left++] = i;
+      }
+      batch_miss_.resize(left);
+    }
+
+    unsigned misses = 0;
+    for (Vector<unsigned>::const_iterator j = batch_miss_.begin();
+         j != batch_miss_.end(); 
+         ++j)
+    {
+      unsigned i = *j;
+      MutableString w(buf + batch_pos_[i], 
+                      batch_pos_[i+1] - batch_pos_[i] - 1);
+      RET_ON_ERR_SET(check(w), bool, res);
+      if (res) out[i/8] |= 1 << (i%8);
+      else     ++misses;
+    }
+    // the check info and guesses of the words in a batch are not kept
+    clear_check_info(check_inf[0]);
+    guess_info.reset();
+    return misses;
+  }
+
   //////////////////////////////////////////////////////////////////////
   //
   // Word list managment methods
   //
   
   PosibErr<void> SpellerImpl::save_all_word_lists() {
+    // synchronizing may pick up changes made by others
+    clear_check_cache();
     SpellerDict * i = dicts_;
     for (; i; i = i->next) {
       if  (i->save_on_saveall)
@@ -372,6 +703,10 @@ namespace aspeller {
       m->s_cmp_end.case_insensitive = value;
       return no_err;
     }
+    static PosibErr<void> guess_affixes(SpellerImpl * m, bool value) {
+      m->affix_guesses = value;
+      return no_err;
+    }
     static PosibErr<void> ignore_repl(SpellerImpl * m, bool value) {
       
       m->ignore_repl = value;
@@ -383,6 +718,10 @@ namespace aspeller {
       abort(); return no_err;
     }
     static PosibErr<void> sug_mode(SpellerImpl * m, const char * mode) {
+      if (!m->suggest_) {
+        // nothing is set up yet so just check that the mode is valid
+        return check_suggest_mode(mode, m);
+      }
       RET_ON_ERR(m->suggest_->set_mode(mode));
       RET_ON_ERR(m->intr_suggest_->set_mode(mode));
       return no_err;
@@ -392,8 +731,14 @@ namespace aspeller {
       m->run_together = m->unconditional_run_together_;
       return no_err;
     }
+    static PosibErr<void> run_together_dp(SpellerImpl * m, bool value) {
+      m->run_together_dp_ = value;
+      if (!value && m->run_together_limit_ > 8)
+        m->config()->replace("run-together-limit", "8");
+      return no_err;
+    }
     static PosibErr<void> run_together_limit(SpellerImpl * m, int value) {
-      if (value > 8) {
+      if (value > 8 && !m->run_together_dp_) {
         m->config()->replace("run-together-limit", "8");
         // will loop back
       } else {
@@ -405,12 +750,17 @@ namespace aspeller {
       m->run_together_min_ = value;
       return no_err;
     }
+    static PosibErr<void> check_cache(SpellerImpl * m, int value) {
+      m->resize_check_cache(value > 0 ? value : 0);
+      return no_err;
+    }
     
   };
 
   static UpdateMember update_members[] = 
   {
-    {"ignore",         UpdateMember::Int,     UpdateMember::CN::ignore}
+    {"guess-affixes",  UpdateMember::Bool,    UpdateMember::CN::guess_affixes}
+    ,{"ignore",         UpdateMember::Int,     UpdateMember::CN::ignore}
     ,{"ignore-accents",UpdateMember::Bool,    UpdateMember::CN::ignore_accents}
     ,{"ignore-case",   UpdateMember::Bool,    UpdateMember::CN::ignore_case}
     ,{"ignore-repl",   UpdateMember::Bool,    UpdateMember::CN::ignore_repl}
@@ -425,6 +775,12 @@ namespace aspeller {
     ,{"run-together-min",  
         UpdateMember::Int,    
         UpdateMember::CN::run_together_min}
+    ,{"run-together-dp",  
+        UpdateMember::Bool,    
+        UpdateMember::CN::run_together_dp}
+    ,{"check-cache",  
+        UpdateMember::Int,    
+        UpdateMember::CN::check_cache}
   };
 
   template <typename T>
@@ -438,6 +794,9 @@ namespace aspeller {
     while (i != end) {
       if (strcmp(ki->name, i->name) == 0) {
         if (i->type == t) {
+          // all of the above, except for the suggestion options,
+          // may change the result of checking a word
+          m->clear_check_cache();
           RET_ON_ERR(i->fun.call(m, value));
           break;
         }
@@ -454,7 +813,9 @@ namespace aspeller {
 
   SpellerImpl::SpellerImpl() 
     : Speller(0) /* FIXME */, ignore_repl(true), 
-      dicts_(0), personal_(0), session_(0), repl_(0), main_(0)
+      dicts_(0), personal_(0), session_(0), repl_(0), main_(0),
+      check_cache_hits_(0), check_cache_lookups_(0), have_repl(false), 
+      overlay(false)
   {}
 
   inline PosibErr<void> add_dicts(SpellerImpl * sp, DictList & d)
@@ -473,7 +834,10 @@ namespace aspeller {
     config_.reset(c);
 
     ignore_repl = config_->retrieve_bool("ignore-repl");
+    affix_guesses = config_->retrieve_bool("guess-affixes");
     ignore_count = config_->retrieve_int("ignore");
+    int cache_size = config_->retrieve_int("check-cache");
+    resize_check_cache(cache_size > 0 ? cache_size : 0);
 
     DictList to_add;
     RET_ON_ERR(add_data_set(config_->retrieve("master-path"), *config_, &to_add, this));
@@ -504,9 +868,83 @@ namespace aspeller {
       RET_ON_ERR(add_dicts(this, to_add));
     }
 
-    bool use_other_dicts = config_->retrieve_bool("use-other-dicts");
+    if (config_->retrieve_bool("use-other-dicts"))
+      RET_ON_ERR(add_other_dicts());
+
+    const char * sys_enc = lang_->charmap();
+    String user_enc = config_->retrieve("encoding");
+    if (user_enc == "none") {
+      config_->replace("encoding", sys_enc);
+      user_enc = sys_enc;
+    }
+
+    RET_ON_ERR(setup_convert());
+
+    unconditional_run_together_ = config_->retrieve_bool("run-together");
+    run_together = unconditional_run_together_;
+    
+    run_together_dp_     = config_->retrieve_bool("run-together-dp");
+    run_together_limit_  = config_->retrieve_int("run-together-limit");
+    if (run_together_limit_ > 8 && !run_together_dp_) {
+      config_->replace("run-together-limit", "8");
+      run_together_limit_ = 8;
+    }
+    run_together_min_    = config_->retrieve_int("run-together-min");
+
+    config_->add_notifier(new ConfigNotifier(this));
+
+    config_->set_attached(true);
+
+    affix_info = lang_->affix();
+
+    setup_word_sets();
+
+    //
+    // Setup suggest
+    //
+
+    // the suggestion objects are not created until they are first
+    // needed, but make sure the mode is valid now
+    RET_ON_ERR(check_suggest_mode(config_->retrieve("sug-mode"), this));
+
+    return no_err;
+  }
+
+  PosibErr<void> SpellerImpl::setup_suggest()
+  {
+    if (suggest_) return no_err;
+    RET_ON_ERR(lang_->setup_suggest());
+    have_repl = lang_->have_repl();
+    PosibErr<Suggest *> pe;
+    pe = new_default_suggest(this);
+    if (pe.has_err()) return pe;
+    StackPtr<Suggest> sug(pe.data);
+    pe = new_default_suggest(this);
+    if (pe.has_err()) return pe;
+    intr_suggest_.reset(pe.data);
+    suggest_.reset(sug.release());
+    return no_err;
+  }
+
+  // adds the personal, session and replacement word lists if they
+  // have not already been added, when "from" is given any of its lists
+  // which are empty are set up in the same way without reading the
+  // files again
+  static bool same_value(const Config & a, const Config & b, const char * key)
+  {
+    return a.retrieve(key).data == b.retrieve(key).data;
+  }
 
-    if (use_other_dicts && !personal_)
+  PosibErr<void> SpellerImpl::add_other_dicts(const SpellerImpl * from)
+  {
+    if (!personal_ && from && from->personal_ && from->personal_->empty()
+        && same_value(*from->config_, *config_, "personal-path"))
+    {
+      Dictionary * temp = new_default_writable_dict();
+      temp->setup_empty_like(*from->personal_, *config_);
+      RET_ON_ERR(add_dict(new SpellerDict(temp, *config_, personal_id)));
+    }
+    else if (!personal_)
     {
       Dictionary * temp;
       temp = new_default_writable_dict();
@@ -518,15 +956,25 @@ namespace aspeller {
       RET_ON_ERR(add_dict(new SpellerDict(temp, *config_, personal_id)));
     }
     
-    if (use_other_dicts && !session_)
+    if (!session_)
     {
       Dictionary * temp;
       temp = new_default_writable_dict();
-      temp->set_check_lang(lang_name(), *config_);
+      if (from && from->session_)
+        temp->setup_empty_like(*from->session_, *config_);
+      else
+        temp->set_check_lang(lang_name(), *config_);
       RET_ON_ERR(add_dict(new SpellerDict(temp, *config_, session_id)));
     }
      
-    if (use_other_dicts && !repl_)
+    if (!repl_ && from && from->repl_ && from->repl_->empty()
+        && same_value(*from->config_, *config_, "repl-path"))
+    {
+      ReplacementDict * temp = new_default_replacement_dict();
+      temp->setup_empty_like(*from->repl_, *config_);
+      RET_ON_ERR(add_dict(new SpellerDict(temp, *config_, personal_repl_id)));
+    }
+    else if (!repl_)
     {
       ReplacementDict * temp = new_default_replacement_dict();
       PosibErrBase pe = temp->load(config_->retrieve("repl-path"),*config_);
@@ -536,42 +984,25 @@ namespace aspeller {
         return pe;
       RET_ON_ERR(add_dict(new SpellerDict(temp, *config_, personal_repl_id)));
     }
+    return no_err;
+  }
 
+  PosibErr<void> SpellerImpl::setup_convert()
+  {
     const char * sys_enc = lang_->charmap();
     String user_enc = config_->retrieve("encoding");
-    if (user_enc == "none") {
-      config_->replace("encoding", sys_enc);
-      user_enc = sys_enc;
-    }
-
     PosibErr<Convert *> conv;
-    conv = new_convert(*c, user_enc, sys_enc, NormFrom);
+    conv = new_convert(*config_, user_enc, sys_enc, NormFrom);
     if (conv.has_err()) return conv;
     to_internal_.reset(conv);
-    conv = new_convert(*c, sys_enc, user_enc, NormTo);
+    conv = new_convert(*config_, sys_enc, user_enc, NormTo);
     if (conv.has_err()) return conv;
     from_internal_.reset(conv);
+    return no_err;
+  }
 
-    unconditional_run_together_ = config_->retrieve_bool("run-together");
-    run_together = unconditional_run_together_;
-    
-    run_together_limit_  = config_->retrieve_int("run-together-limit");
-    if (run_together_limit_ > 8) {
-      config_->replace("run-together-limit", "8");
-      run_together_limit_ = 8;
-    }
-    run_together_min_    = config_->retrieve_int("run-together-min");
-
-    config_->add_notifier(new ConfigNotifier(this));
-
-    config_->set_attached(true);
-
-    affix_info = lang_->affix();
-
-    //
-    // setup word set lists
-    //
-
+  void SpellerImpl::setup_word_sets()
+  {
     typedef Vector<SpellerDict *> AllWS; AllWS all_ws;
     for (SpellerDict * i = dicts_; i; i = i->next) {
       if (i->dict->basic_type == Dict::basic_dict ||
@@ -610,27 +1041,100 @@ namespace aspeller {
         if (cur->dict->affix_compressed) suggest_affix_ws.push_back(cur->dict);
       }
     }
+    // An overlay speller checks its own word lists first.  They are
+    // usually small and reject most words with just a look at their
+    // filter.  Only check_ws is reordered.  A word is still correct if
+    // any dictionary has it, but when both the personal list and a
+    // main dictionary have it, the entry from the personal list is the
+    // one that is found.  The other lists keep the order above.
+    if (overlay) {
+      WS::iterator j = check_ws.begin();
+      for (WS::iterator i = check_ws.begin(); i != check_ws.end(); ++i) {
+        if (*i == personal_ || *i == session_) {
+          const Dict * d = *i;
+          for (WS::iterator k = i; k != j; --k) *k = *(k - 1);
+          *j++ = d;
+        }
+      }
+    }
     fast_scan   = suggest_ws.front()->fast_scan;
     fast_lookup = suggest_ws.front()->fast_lookup;
     have_soundslike = lang_->have_soundslike();
-    have_repl = lang_->have_repl();
     invisible_soundslike = suggest_ws.front()->invisible_soundslike;
     soundslike_root_only = suggest_ws.front()->soundslike_root_only;
     affix_compress = !affix_ws.empty();
+  }
 
-    //
-    // Setup suggest
-    //
+  // the options of an overlay speller which are taken from its own
+  // config rather than from the one it is created from
+  static const char * const word_list_keys[] = {
+    "home-dir", "personal", "personal-cache", "personal-journal",
+    "personal-path", "repl", "repl-path", "save-repl", 0
+  };
 
-    PosibErr<Suggest *> pe;
-    pe = new_default_suggest(this);
-    if (pe.has_err()) return pe;
-    suggest_.reset(pe.data);
-    pe = new_default_suggest(this);
-    if (pe.has_err()) return pe;
-    intr_suggest_.reset(pe.data);
+  PosibErr<Speller *> SpellerImpl::clone(const Config * word_lists) const
+  {
+    StackPtr<SpellerImpl> m(new SpellerImpl);
+    m->config_.reset(new Config(*config_));
+    if (word_lists) {
+      for (const char * const * k = word_list_keys; *k; ++k) {
+        if (!word_lists->have(*k)) continue;
+        RET_ON_ERR_SET(word_lists->retrieve(*k), String, val);
+        RET_ON_ERR(m->config_->replace(*k, val));
+      }
+    }
+    m->overlay = overlay || word_lists;
+
+    m->ignore_repl = ignore_repl;
+    m->affix_guesses = affix_guesses;
+    m->ignore_count = ignore_count;
+    m->resize_check_cache(check_cache_.size());
+
+    m->lang_.copy(lang_);
+    m->s_cmp = s_cmp;
+    m->s_cmp_begin = s_cmp_begin;
+    m->s_cmp_middle = s_cmp_middle;
+    m->s_cmp_end = s_cmp_end;
+
+    // Share everything but the personal, session and replacement word
+    // lists, keeping the same order.
+    Vector<const SpellerDict *> shared;
+    for (const SpellerDict * i = dicts_; i; i = i->next)
+      if (i->special_id != personal_id && i->special_id != session_id
+          && i->special_id != personal_repl_id)
+        shared.push_back(i);
+    while (!shared.empty()) {
+      SpellerDict * d = new SpellerDict(*shared.back());
+      shared.pop_back();
+      d->dict->copy();
+      d->next = 0;
+      RET_ON_ERR(m->add_dict(d));
+    }
+    if (config_->retrieve_bool("use-other-dicts"))
+      RET_ON_ERR(m->add_other_dicts(this));
 
-    return no_err;
+    RET_ON_ERR(m->setup_convert());
+
+    m->unconditional_run_together_ = unconditional_run_together_;
+    m->run_together = run_together;
+    m->run_together_dp_ = run_together_dp_;
+    m->run_together_limit_ = run_together_limit_;
+    m->run_together_min_ = run_together_min_;
+
+    m->config_->add_notifier(new ConfigNotifier(m));
+    m->config_->set_attached(true);
+
+    m->affix_info = affix_info;
+
+    m->setup_word_sets();
+
+    if (suggest_) {
+      m->have_repl = have_repl;
+      m->suggest_.reset(suggest_->clone(m));
+      m->intr_suggest_.reset(intr_suggest_->clone(m));
+    }
+
+    return m.release();
   }
 
   //////////////////////////////////////////////////////////////////////
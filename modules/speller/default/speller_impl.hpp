@@ -29,6 +29,7 @@ namespace aspeller {
   class Language;
   struct SensitiveCompare;
   class Suggest;
+  struct RunTogetherState;
 
   enum SpecialId {main_id, personal_id, session_id, 
                   personal_repl_id, none_id};
@@ -98,6 +99,7 @@ namespace aspeller {
 			 CheckInfo *, GuessInfo *);
 
     PosibErr<bool> check(MutableString word) {
+      if (!check_cache_.empty()) return check_cached(word);
       guess_info.reset();
       return check(word.begin(), word.end(), false,
 		   unconditional_run_together_ ? run_together_limit_ : 0,
@@ -105,29 +107,64 @@ namespace aspeller {
     }
     PosibErr<bool> check(ParmString word)
     {
-      std::vector<char> w(word.size()+1);
-      strncpy(&*w.begin(), word, w.size());
-      return check(MutableString(&w.front(), w.size() - 1));
+      // only words too long for the buffer on the stack need to be
+      // copied to the heap
+      char buf[256];
+      String long_word;
+      char * w = buf;
+      if (word.size() >= sizeof(buf)) {
+        long_word.resize(word.size() + 1);
+        w = long_word.data();
+      }
+      memcpy(w, word, word.size());
+      w[word.size()] = '\0';
+      return check(MutableString(w, word.size()));
     }
 
     PosibErr<bool> check(const char * word) {return check(ParmString(word));}
 
+    // see Speller::check_batch, a lens[i] of -1 is handled by the
+    // conversion into the internal encoding, as for a single word
+    PosibErr<unsigned> check_batch(const char * const * words, const int * lens,
+                                   unsigned num, unsigned char * out);
+
     bool check2(char * word, /* it WILL modify word */
                 bool try_uppercase,
                 CheckInfo & ci, GuessInfo * gi);
 
     bool check_affix(ParmString word, CheckInfo & ci, GuessInfo * gi);
 
+    bool check_run_together(char * word, char * word_end, 
+                            /* it WILL modify word */
+                            bool try_uppercase,
+                            unsigned run_together_limit,
+                            CheckInfo *, GuessInfo *);
+    unsigned run_together_parts(RunTogetherState &, 
+                                bool title, unsigned limit);
+
+    void compute_guesses();
+
+    PosibErr<bool> check_cached(MutableString word);
+    void resize_check_cache(unsigned size);
+    void clear_check_cache();
+
     bool check_simple(ParmString, WordEntry &);
 
+    // guesses are only computed here, when they are first asked for,
+    // as most callers never use them
     const CheckInfo * check_info() {
       if (check_inf[0].word)
         return check_inf;
-      else if (guess_info.head)
+      if (guess_info.pending)
+        compute_guesses();
+      if (guess_info.head)
         return guess_info.head;
       else
         return 0;
     }
+
+    unsigned long check_cache_hits() const {return check_cache_hits_;}
+    unsigned long check_cache_lookups() const {return check_cache_lookups_;}
     
     //
     // High level Word List management methods
@@ -150,6 +187,10 @@ namespace aspeller {
     PosibErr<void> store_replacement(const String & mis, const String & cor,
 				     bool memory);
 
+    void pin_cache_data(bool);
+
+    PosibErr<Speller *> clone(const Config * word_lists = 0) const;
+
     //
     // Private Stuff (from here to the end of the class)
     //
@@ -163,7 +204,7 @@ namespace aspeller {
     CachePtr<const Language>   lang_;
     CopyPtr<SensitiveCompare>  sensitive_compare_;
     //CopyPtr<DictCollection> wls_;
-    ClonePtr<Suggest>       suggest_;
+    ClonePtr<Suggest>       suggest_; // null until setup_suggest
     ClonePtr<Suggest>       intr_suggest_;
     unsigned int            ignore_count;
     bool                    ignore_repl;
@@ -171,9 +212,17 @@ namespace aspeller {
     String                  prev_cor_repl_;
 
     void operator= (const SpellerImpl &other);
+
+    // creates the suggestion objects and reads the language data they
+    // need, if not already done
+    PosibErr<void> setup_suggest();
     SpellerImpl(const SpellerImpl &other);
 
     SpellerDict * dicts_;
+
+    PosibErr<void> add_other_dicts(const SpellerImpl * from = 0);
+    PosibErr<void> setup_convert();
+    void setup_word_sets();
     
     Dictionary       * personal_;
     Dictionary       * session_;
@@ -194,6 +243,37 @@ namespace aspeller {
 		     const char *, const char *) const;
 
     CheckInfo check_inf[8];
+    Vector<CheckInfo> compound_inf; // used by check_run_together
+    struct RunTogetherFrame {
+      unsigned start;
+      bool title;
+      unsigned limit;
+      unsigned next; // where the part being tried ends
+    };
+    Vector<RunTogetherFrame> run_together_stack_; // these four are also used
+    Vector<unsigned> run_together_parts_;         // by check_run_together
+    Vector<unsigned> run_together_end_;
+    Vector<unsigned> run_together_failed_;
+    String batch_buf_;              // these three are used by check_batch
+    Vector<unsigned> batch_pos_;
+    Vector<unsigned> batch_miss_;
+    Vector<size_t>   batch_hash_;
+
+    // A small direct-mapped cache of the results of recently checked
+    // words, keyed by the exact bytes of the word.  It is only used by
+    // check(MutableString), when check-cache is not zero, and is
+    // cleared whenever the personal or session dictionary or an
+    // option which affects checking changes.
+    struct CheckCacheEntry {
+      static const unsigned MAX_SIZE = 31;
+      unsigned char size; // 0 if the entry is unused
+      bool correct;
+      char word[MAX_SIZE];
+      CheckInfo ci;
+    };
+    Vector<CheckCacheEntry> check_cache_;
+    unsigned long check_cache_hits_;
+    unsigned long check_cache_lookups_;
     GuessInfo guess_info;
 
     SensitiveCompare s_cmp;
@@ -201,15 +281,21 @@ namespace aspeller {
     SensitiveCompare s_cmp_middle; // are used by the affix code.
     SensitiveCompare s_cmp_end;
 
+    // the dictionaries in the order they are searched, see
+    // setup_word_sets, an overlay speller searches its personal and
+    // session lists first in check_ws
     typedef Vector<const Dict *> WS;
     WS check_ws, affix_ws, suggest_ws, suggest_affix_ws;
 
     bool                    unconditional_run_together_;
     unsigned int            run_together_limit_;
     unsigned int            run_together_min_;
+    bool                    run_together_dp_;
 
     bool affix_info, affix_compress;
 
+    bool affix_guesses;
+
     bool have_repl;
 
     bool have_soundslike;
@@ -220,6 +306,8 @@ namespace aspeller {
 
     bool run_together;
 
+    bool overlay; // created by clone with its own word lists
+
   };
 
   struct LookupInfo {
@@ -231,8 +319,22 @@ namespace aspeller {
     // returns 0 if nothing found
     // 1 if a match is found
     // -1 if a word is found but affix doesn't match and "gi"
-    int lookup (ParmString word, const SensitiveCompare * c, char aff, 
+    // "clean_hash" is the result of clean_hash(word)
+    int lookup (ParmString word, size_t clean_hash,
+                const SensitiveCompare * c, char aff, 
                 WordEntry & o, GuessInfo * gi) const;
+    // the hash of "word" the dictionaries use to find it (see
+    // Dictionary::prefetch), 0 if they are not used in this mode
+    size_t clean_hash(ParmString word) const {
+      if (mode != Word && mode != Clean) return 0;
+      return InsensitiveHash<size_t>(&sp->lang())(word);
+    }
+    // hint that "word" will be looked up soon
+    void prefetch(ParmString word, size_t clean_hash) const {
+      if (mode != Word && mode != Clean) return;
+      for (SpellerImpl::WS::const_iterator i = begin; i != end; ++i)
+        (*i)->prefetch(word, clean_hash);
+    }
   };
 
   inline LookupInfo::LookupInfo(SpellerImpl * s, Mode m) 
@@ -446,7 +446,8 @@ namespace {
   {
     unsigned res = check_word_s(word, ci);
     if (res) return pos + 1;
-    if (pos + 1 >= sp->run_together_limit_) return 0;
+    // check_info only has room for 8 parts
+    if (pos + 1 >= sp->run_together_limit_ || pos + 1 >= 8) return 0;
     for (char * i = word + sp->run_together_min_; 
          i <= word_end - sp->run_together_min_;
          ++i)
@@ -1287,6 +1288,11 @@ namespace {
       return -1;
     }
     SuggestionList & suggest(const char * word);
+    Suggest * clone(SpellerImpl * m) const {
+      SuggestImpl * s = new SuggestImpl(*this);
+      s->speller_ = m;
+      return s;
+    }
   };
   
   PosibErr<void> SuggestImpl::setup(SpellerImpl * m)
@@ -1339,6 +1345,11 @@ namespace aspeller {
     return s.release();
   }
 
+  PosibErr<void> check_suggest_mode(ParmString mode, SpellerImpl * m) {
+    SuggestParms parms;
+    return parms.set(mode, m);
+  }
+
   //Suggest * new_default_suggest(SpellerImpl * m, const SuggestParms & p) {
   //  return new aspeller_default_suggest::SuggestImpl(m,p);
   //}
@@ -34,10 +34,14 @@ namespace aspeller {
     virtual PosibErr<void> set_mode(ParmString) = 0;
     virtual double score(const char * base, const char * other) = 0;
     virtual SuggestionList & suggest(const char * word) = 0;
+    // returns a copy which is used with another speller
+    virtual Suggest * clone(SpellerImpl *) const = 0;
     virtual ~Suggest() {}
   };
   
   PosibErr<Suggest *> new_default_suggest(SpellerImpl *);
+  // returns an error if "mode" is not a valid suggestion mode
+  PosibErr<void> check_suggest_mode(ParmString mode, SpellerImpl *);
 }
 
 
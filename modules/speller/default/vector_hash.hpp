@@ -226,6 +226,13 @@ namespace aspeller {
 
     iterator find(const key_type&);
     const_iterator find(const key_type&) const;
+
+    // start loading the first bucket find would examine
+    void prefetch(const key_type & k) const {
+#ifdef __GNUC__
+      __builtin_prefetch(&vector_[hash1(k)]);
+#endif
+    }
   
     size_type erase(const key_type &key);
     void erase(const iterator &p);
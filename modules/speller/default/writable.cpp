@@ -5,6 +5,18 @@
 // at http://www.gnu.org/.
 
 #include <time.h>
+#include <sys/stat.h>
+
+#include "settings.h"
+
+#ifdef HAVE_MMAP
+#  include <sys/mman.h>
+#endif
+
+#ifdef USE_POSIX_MUTEX
+#  include <pthread.h>
+#  include <unistd.h>
+#endif
 
 #include "hash-t.hpp"
 #include "data.hpp"
@@ -14,7 +26,10 @@
 #include "file_util.hpp"
 #include "fstream.hpp"
 #include "language.hpp"
+#include "lock.hpp"
 #include "getdata.hpp"
+#include "string_enumeration.hpp"
+#include "vararray.hpp"
 
 namespace {
 
@@ -56,43 +71,290 @@ void write_n_escape(FStream & o, const char * str) {
   }
 }
 
-static inline char f_getc(FStream & in) {
-  int c = in.get();
-  return c == EOF ? '\0' : (char)c;
+void write_n_escape(String & o, const char * str) {
+  while (*str != '\0') {
+    if (*str == '\n') o += "\\n";
+    else if (*str == '\r') o += "\\r";
+    else if (*str == '\\') o += "\\\\";
+    else o += *str;
+    ++str;
+  }
 }
-  
-bool getline_n_unescape(FStream & in, String & str, char delem) {
-  str.clear();
-  char c = f_getc(in);
-  if (!c) return false;
-  while (c && c != delem) {
-    if (c == '\\') {
-      c = f_getc(in);
-      if (c == 'n') str.append('\n');
-      else if (c == 'r') str.append('\r');
-      else if (c == '\\') str.append('\\');
-      else {str.append('\\'); continue;}
-    } else {
-      str.append(c);
+
+//
+// LineReader reads the lines of a personal or replacement word list
+// in place, rather than a character at a time, with the whole file
+// mapped into memory when possible.
+//
+
+class LineReader {
+  long         base_; // the file offset of begin_
+  const char * begin_;
+  const char * cur_;
+  const char * end_;
+  char *       mmaped_;
+  size_t       mmaped_size_;
+  String       data_; // the contents of the file when it can't be mapped
+  LineReader(const LineReader &);
+  void operator=(const LineReader &);
+public:
+  LineReader() : base_(0), begin_(0), cur_(0), end_(0), mmaped_(0) {}
+  ~LineReader() {
+#ifdef HAVE_MMAP
+    if (mmaped_) munmap(mmaped_, mmaped_size_);
+#endif
+  }
+  // reads the rest of "in", from its current position
+  PosibErr<void> open(FStream & in, ParmString file_name);
+  // the position in the file of the next line
+  long tell() const {return base_ + (cur_ - begin_);}
+  // the number of lines left
+  unsigned num_lines() const;
+  // ignores the last line if it does not end in a newline, returns
+  // false if there was such a line
+  bool drop_partial_line();
+  bool getline(String & buf);
+  bool getline(DataPair & d, String & buf);
+  // unescapes the line as written by write_n_escape
+  bool getline_n_unescape(String & buf);
+  bool getline_n_unescape(DataPair & d, String & buf);
+private:
+  const char * next_line() {
+    const char * e = (const char *)memchr(cur_, '\n', end_ - cur_);
+    return e ? e : end_;
+  }
+};
+
+PosibErr<void> LineReader::open(FStream & in, ParmString file_name)
+{
+  // the size below is only meaningful for a regular file, a directory
+  // for example can be opened but reports a nonsense size
+  struct stat st;
+  if (fstat(in.file_no(), &st) != 0 || !S_ISREG(st.st_mode))
+    return make_err(cant_read_file, file_name);
+  long start = in.tell();
+  in.seek(0, SEEK_END);
+  long size = in.tell();
+  in.seek(start);
+  if (start < 0 || size < start) 
+    return make_err(cant_read_file, file_name);
+#ifdef HAVE_MMAP
+  if (size > 0) {
+    void * p = mmap(NULL, size, PROT_READ, MAP_SHARED, in.file_no(), 0);
+    if (p != MAP_FAILED) {
+      mmaped_ = static_cast<char *>(p);
+      mmaped_size_ = size;
+      begin_ = mmaped_;
+      cur_ = begin_ + start;
+      end_ = begin_ + size;
+      return no_err;
+    }
+  }
+#endif
+  data_.resize(size - start);
+  if (size > start && !in.read(data_.mstr(), size - start))
+    return make_err(cant_read_file, file_name);
+  base_ = start;
+  begin_ = cur_ = data_.data();
+  end_ = begin_ + data_.size();
+  return no_err;
+}
+
+unsigned LineReader::num_lines() const
+{
+  unsigned num = 0;
+  const char * p = cur_;
+  while (p != end_) {
+    const char * e = (const char *)memchr(p, '\n', end_ - p);
+    ++num;
+    if (!e) break;
+    p = e + 1;
+  }
+  return num;
+}
+
+bool LineReader::drop_partial_line()
+{
+  const char * e = end_;
+  while (e != cur_ && e[-1] != '\n') --e;
+  if (e == end_) return true;
+  end_ = e;
+  return false;
+}
+
+bool LineReader::getline(String & buf)
+{
+  if (cur_ == end_) return false;
+  const char * e = next_line();
+  buf.assign(cur_, e - cur_);
+  cur_ = e == end_ ? e : e + 1;
+  return true;
+}
+
+bool LineReader::getline_n_unescape(String & buf)
+{
+  if (cur_ == end_) return false;
+  const char * e = next_line();
+  const char * p = (const char *)memchr(cur_, '\\', e - cur_);
+  if (!p) {
+    buf.assign(cur_, e - cur_);
+  } else {
+    buf.assign(cur_, p - cur_);
+    for (; p != e; ++p) {
+      if (*p == '\\' && p + 1 != e) {
+        if      (p[1] == 'n')  {buf.append('\n'); ++p;}
+        else if (p[1] == 'r')  {buf.append('\r'); ++p;}
+        else if (p[1] == '\\') {buf.append('\\'); ++p;}
+        else buf.append('\\');
+      } else {
+        buf.append(*p);
+      }
     }
-    c = f_getc(in);
   }
+  cur_ = e == end_ ? e : e + 1;
   return true;
 }
 
-bool getline_n_unescape(FStream & in, DataPair & d, String & buf)
+bool LineReader::getline(DataPair & d, String & buf)
 {
-  if (!getline_n_unescape(in, buf, '\n')) return false;
+  if (!getline(buf)) return false;
   d.value.str  = buf.mstr();
   d.value.size = buf.size();
   return true;
 }
 
+bool LineReader::getline_n_unescape(DataPair & d, String & buf)
+{
+  if (!getline_n_unescape(buf)) return false;
+  d.value.str  = buf.mstr();
+  d.value.size = buf.size();
+  return true;
+}
+
+//
+// StrList holds the converted words of a file before they are added,
+// so that their soundslikes can be computed at once.
+//
+
+struct StrList {
+  CharVector       data;
+  Vector<unsigned> pos;
+  void add(const char * str) {
+    pos.push_back(data.size());
+    data.append(str, strlen(str) + 1);
+  }
+  unsigned size() const {return pos.size();}
+  const char * operator[] (unsigned i) const {return data.data() + pos[i];}
+};
+
+// below this many words per thread, threads are not worth starting
+static const unsigned SOUNDSLIKE_CHUNK = 8192;
+
+struct SoundslikeJob {
+  const Language * lang;
+  const StrList  * words;
+  StrList        * sls;
+  unsigned         begin, end;
+  void run() const {
+    for (unsigned i = begin; i != end; ++i)
+      lang->LangImpl::to_soundslike(sls->data.mstr() + sls->pos[i],
+                                    (*words)[i]);
+  }
+};
+
+#ifdef USE_POSIX_MUTEX
+static void * soundslike_thread(void * d)
+{
+  static_cast<SoundslikeJob *>(d)->run();
+  return 0;
+}
+#endif
+
+// computes the soundslike of every word in "words", using one thread
+// per processor when there are enough words
+static void to_soundslikes(const Language * lang, 
+                           const StrList & words, StrList & sls)
+{
+  sls.data.resize(words.data.size());
+  sls.pos = words.pos;
+  unsigned num_threads = 1;
+#ifdef USE_POSIX_MUTEX
+  long num_procs = sysconf(_SC_NPROCESSORS_ONLN);
+  if (num_procs > 1) num_threads = num_procs;
+  if (num_threads > words.size() / SOUNDSLIKE_CHUNK)
+    num_threads = words.size() / SOUNDSLIKE_CHUNK;
+  if (num_threads < 1) num_threads = 1;
+#endif
+  Vector<SoundslikeJob> jobs(num_threads);
+  for (unsigned i = 0; i != num_threads; ++i) {
+    SoundslikeJob & j = jobs[i];
+    j.lang  = lang;
+    j.words = &words;
+    j.sls   = &sls;
+    j.begin = words.size() * i / num_threads;
+    j.end   = words.size() * (i + 1) / num_threads;
+  }
+#ifdef USE_POSIX_MUTEX
+  if (num_threads > 1) {
+    Vector<pthread_t> threads(num_threads);
+    unsigned started = 1;
+    for (; started != num_threads; ++started)
+      if (pthread_create(&threads[started], 0, soundslike_thread, &jobs[started]) != 0)
+        break;
+    jobs[0].run();
+    // if a thread could not be created do its work here
+    for (unsigned i = started; i != num_threads; ++i)
+      jobs[i].run();
+    for (unsigned i = 1; i != started; ++i)
+      pthread_join(threads[i], 0);
+    return;
+  }
+#endif
+  jobs[0].run();
+}
+
 typedef Vector<Str> StrVector;
 
 typedef hash_multiset<Str,Hash,Equal> WordLookup;
 typedef hash_map<Str,StrVector>  SoundslikeLookup;
 
+// A Bloom filter over the hashes of the words in word_lookup so that
+// looking up a word which is not there, by far the common case for a
+// personal or session dictionary, usually does not need to touch the
+// hash table.  Two bits are set for each word.  Words are never
+// removed, instead the filter is rebuilt, with at least 16 bits per
+// word, once it holds more than one word for every 8 bits.
+class WordFilter {
+  Vector<unsigned> bits_;
+  unsigned shift_; // 32 - log2 of the number of bits
+  unsigned num_;
+  unsigned h1(size_t h) const {return ((unsigned)h * 2654435761u) >> shift_;}
+  unsigned h2(size_t h) const {
+    unsigned x = (unsigned)h;
+    return ((x ^ x >> 15) * 2246822519u) >> shift_;}
+  void set(unsigned b) {bits_[b / 32] |= 1u << b % 32;}
+  bool test(unsigned b) const {return bits_[b / 32] & 1u << b % 32;}
+public:
+  WordFilter() : shift_(32), num_(0) {}
+  bool full() const {return num_ >= bits_.size() * 32 / 8;}
+  void reset(unsigned num_words) {
+    unsigned n = 64;
+    shift_ = 32 - 6;
+    while (n < num_words * 16) {n *= 2; --shift_;}
+    bits_.assign(n / 32, 0);
+    num_ = 0;
+  }
+  void clear() {
+    for (unsigned i = 0; i != bits_.size(); ++i) bits_[i] = 0;
+    num_ = 0;
+  }
+  void add(size_t h) {set(h1(h)); set(h2(h)); ++num_;}
+  bool may_have(size_t h) const {
+    return num_ != 0 && test(h1(h)) && test(h2(h));
+  }
+  size_t memory_used() const {return bits_.size() * sizeof(unsigned);}
+};
+
 class WritableBase : public Dictionary {
 protected:
   String suffix;
@@ -101,15 +363,40 @@ protected:
   time_t cur_file_date;
   
   String compatibility_file_name;
+
+  // When use_journal is set changes are saved by appending a record
+  // for each word added or removed to "<file>.journal" rather than by
+  // rewriting the file.  The journal is folded back into the file once
+  // it grows large.  All access to the journal is done while holding
+  // the lock on the file itself.
+  bool   use_journal;
+  bool   loading;      // true while reading a file, the words are not journaled
+  bool   must_rewrite; // the journal can not describe the changes made
+  long   journal_pos;  // how much of the journal has been read
+  String journal;      // records not yet appended to the journal
     
   WritableBase(BasicType t, const char * n, const char * s, const char * cs)
     : Dictionary(t,n),
       suffix(s), compatibility_suffix(cs),
-      use_soundslike(true) {fast_lookup = true;}
+      use_journal(false), loading(false), must_rewrite(false), journal_pos(0),
+      use_soundslike(true), have_words_(false), have_soundslikes_(false) 
+    {fast_lookup = true;}
   virtual ~WritableBase() {}
   
   virtual PosibErr<void> save(FStream &, ParmString) = 0;
   virtual PosibErr<void> merge(FStream &, ParmString, Config * = 0) = 0;
+  // reads the file when the dictionary is first loaded
+  virtual PosibErr<void> load_file(FStream & in, ParmString f, Config & c) {
+    return merge(in, f, &c);}
+  // applies a journal record, "op" is either '+' or '-'
+  virtual PosibErr<void> replay(char op, char * rec) = 0;
+
+  String journal_file_name() const {
+    String fn = file_name(); fn += ".journal"; return fn;}
+  void journal_record(char op, const char * w, const char * w2 = 0);
+  PosibErr<bool> replay_journal(FStream &, ParmString);
+  void add_soundslike(ParmString sl, Str entry) const;
+  void remove_soundslike(ParmString w, Str entry);
     
   PosibErr<void> save2(FStream &, ParmString);
   PosibErr<void> update(FStream &, ParmString);
@@ -129,17 +416,90 @@ protected:
   PosibErr<void> save_noupdate() {return save(false);}
 
   bool use_soundslike;
-  StackPtr<WordLookup> word_lookup;
-  SoundslikeLookup     soundslike_lookup_;
-  ObjStack             buffer;
+
+  // The tables and the buffer are only created when they are first
+  // needed so that an empty dictionary, such as the session
+  // dictionary or the word lists of an overlay speller, costs next to
+  // nothing.  Lookups check for a missing table and the filter first.
+  // Since only suggestions use the soundslike table it is not kept
+  // up to date until it is first used, at which point it is built
+  // from the words, so that checking alone never needs the
+  // soundslike data of the language.  Since const methods, such as
+  // soundslike_lookup and the enumerations, may create the two tables,
+  // they are only created while holding "lazy_lock", and "have_words_"
+  // and "have_soundslikes_" are only set once a table is complete.
+  mutable StackPtr<WordLookup>       word_lookup;
+  mutable StackPtr<SoundslikeLookup> soundslike_lookup_;
+  mutable StackPtr<ObjStack>         buffer_;
+  mutable Mutex                      lazy_lock;
+  mutable bool                       have_words_;
+  mutable bool                       have_soundslikes_;
+  WordFilter                         filter;
+
+  bool have_words() const {return atomic_load(have_words_);}
+  WordLookup & words() const {
+    if (!have_words()) {
+      LOCK(&lazy_lock);
+      if (!word_lookup)
+        word_lookup.reset(new WordLookup(10, Hash(lang()), Equal(lang())));
+      atomic_store(have_words_, true);
+    }
+    return *word_lookup;
+  }
+  SoundslikeLookup & soundslikes() const {
+    if (!atomic_load(have_soundslikes_)) {
+      LOCK(&lazy_lock);
+      if (!soundslike_lookup_) {
+        soundslike_lookup_.reset(new SoundslikeLookup());
+        build_soundslikes();
+      }
+      atomic_store(have_soundslikes_, true);
+    }
+    return *soundslike_lookup_;
+  }
+  // adds the soundslikes of the words already in word_lookup
+  virtual void build_soundslikes() const = 0;
+  // true if the soundslikes of new words need to be added
+  bool keep_soundslikes() const {
+    return use_soundslike && atomic_load(have_soundslikes_);
+  }
+  ObjStack & buffer() const {
+    if (!buffer_) buffer_.reset(new ObjStack());
+    return *buffer_;
+  }
+  // false if "w" is definitely not in word_lookup
+  bool may_have(ParmString w) const {
+    return have_words() && filter.may_have(Hash(lang())(w));
+  }
+  WordLookup::iterator insert_word(Str w);
  
   void set_lang_hook(Config & c) {
     set_file_encoding(lang()->data_encoding(), c);
-    word_lookup.reset(new WordLookup(10, Hash(lang()), Equal(lang())));
     use_soundslike = lang()->have_soundslike();
   }
 };
 
+WordLookup::iterator WritableBase::insert_word(Str w)
+{
+  WordLookup::iterator i = words().insert(w).first;
+  if (filter.full()) {
+    filter.reset(word_lookup->size());
+    Hash hash(lang());
+    for (WordLookup::iterator j = word_lookup->begin(); j != word_lookup->end(); ++j)
+      filter.add(hash(*j));
+  } else {
+    filter.add(Hash(lang())(w));
+  }
+  return i;
+}
+
+struct Loading {
+  bool & loading;
+  bool   prev;
+  Loading(bool & l) : loading(l), prev(l) {loading = true;}
+  ~Loading() {loading = prev;}
+};
+
 PosibErr<void> WritableBase::update_file_date_info(FStream & f) {
   RET_ON_ERR(update_file_info(f));
   cur_file_date = get_modification_time(f);
@@ -152,13 +512,24 @@ PosibErr<void> WritableBase::load(ParmString f0, Config & config,
   set_file_name(f0);
   const String f = file_name();
   FStream in;
+  Loading l(loading);
+  use_journal = config.retrieve_bool("personal-journal");
 
   if (file_exists(f)) {
       
     RET_ON_ERR(open_file_readlock(in, f));
     if (in.peek() == EOF) return make_err(cant_read_file,f); 
     // ^^ FIXME 
-    RET_ON_ERR(merge(in, f, &config));
+    RET_ON_ERR(load_file(in, f, config));
+
+    String jfn = journal_file_name();
+    journal_pos = 0;
+    if (file_exists(jfn)) {
+      FStream jin;
+      RET_ON_ERR(jin.open(jfn, "r"));
+      // an incomplete record is ignored, the next save rewrites the file
+      RET_ON_ERR(replay_journal(jin, jfn));
+    }
       
   } else if (f.substr(f.size()-suffix.size(),suffix.size()) 
              == suffix) {
@@ -193,6 +564,7 @@ PosibErr<void> WritableBase::merge(ParmString f0) {
 
 PosibErr<void> WritableBase::update(FStream & in, ParmString fn) {
   typedef PosibErr<void> Ret;
+  Loading l(loading);
   {
     Ret pe = merge(in, fn);
     if (pe.has_err() && compatibility_file_name.empty()) return pe;
@@ -220,21 +592,76 @@ PosibErr<void> WritableBase::save_as(ParmString fn) {
   RET_ON_ERR(open_file_writelock(inout, file_name()));
   RET_ON_ERR(save2(inout, file_name()));
   RET_ON_ERR(update_file_date_info(inout));
+  remove_file(journal_file_name());
+  journal.clear();
+  journal_pos = 0;
+  must_rewrite = false;
   return no_err;
 }
 
+// once the journal is larger than this, and larger than a quarter of
+// the file, it is folded into the file
+static const long JOURNAL_COMPACT_SIZE = 16384;
+
 PosibErr<void> WritableBase::save(bool do_update) {
   FStream inout;
   RET_ON_ERR_SET(open_file_writelock(inout, file_name()),
                  bool, prev_existed);
 
-  if (do_update
-      && prev_existed 
-      && get_modification_time(inout) > cur_file_date)
-    RET_ON_ERR(update(inout, file_name()));
+  String jfn = journal_file_name();
+  FStream jout;
+  bool have_journal = false;
+  long journal_size = 0;
+  if (prev_existed && compatibility_file_name.empty()
+      && (file_exists(jfn) || (use_journal && !journal.empty())))
+  {
+    // not named "pe", which RET_ON_ERR uses for its own variable
+    PosibErr<void> open_err = jout.open(jfn, "r+");
+    if (open_err.get_err() != 0)
+      open_err = jout.open(jfn, "w+");
+    RET_ON_ERR(open_err);
+    have_journal = true;
+    jout.seek(0, SEEK_END);
+    journal_size = jout.tell();
+  }
+
+  bool journal_complete = true;
+  if (do_update && prev_existed) {
+    // if the journal shrank it was folded into the file by someone else
+    if (get_modification_time(inout) > cur_file_date
+        || journal_size < journal_pos) 
+    {
+      RET_ON_ERR(update(inout, file_name()));
+      journal_pos = 0;
+    }
+    if (have_journal) {
+      RET_ON_ERR_SET(replay_journal(jout, jfn), bool, c);
+      journal_complete = c;
+    }
+  }
+
+  if (use_journal && have_journal && journal_complete && !must_rewrite) {
+    bool at_end = journal_pos == journal_size;
+    jout.seek(0, SEEK_END);
+    jout.write(journal.data(), journal.size());
+    jout.flush();
+    journal.clear();
+    journal_size = jout.tell();
+    if (at_end) journal_pos = journal_size;
+    inout.seek(0, SEEK_END);
+    if (journal_size < JOURNAL_COMPACT_SIZE || journal_size < inout.tell() / 4)
+      return no_err;
+  }
 
   RET_ON_ERR(save2(inout, file_name()));
   RET_ON_ERR(update_file_date_info(inout));
+  if (have_journal) {
+    jout.close();
+    remove_file(jfn);
+  }
+  journal.clear();
+  journal_pos = 0;
+  must_rewrite = false;
     
   if (compatibility_file_name.size() != 0) {
     remove_file(compatibility_file_name.c_str());
@@ -245,12 +672,75 @@ PosibErr<void> WritableBase::save(bool do_update) {
 }
 
 PosibErr<void> WritableBase::clear() {
-  word_lookup->clear();
-  soundslike_lookup_.clear();
-  buffer.reset();
+  if (word_lookup) word_lookup->clear();
+  if (soundslike_lookup_) soundslike_lookup_->clear();
+  if (buffer_) buffer_->reset();
+  filter.clear();
+  journal.clear();
+  if (!loading) must_rewrite = true;
   return no_err;
 }
 
+void WritableBase::journal_record(char op, const char * w, const char * w2)
+{
+  if (!use_journal || loading) return;
+  ConvP conv(oconv);
+  journal += op;
+  write_n_escape(journal, conv(w));
+  if (w2) {
+    journal += ' ';
+    write_n_escape(journal, conv(w2));
+  }
+  journal += '\n';
+}
+
+// replays the journal from journal_pos, returns false if the last
+// record was only partly written
+PosibErr<bool> WritableBase::replay_journal(FStream & in, ParmString fn)
+{
+  Loading l(loading);
+  in.seek(journal_pos);
+  LineReader lines;
+  RET_ON_ERR(lines.open(in, fn));
+  bool complete = lines.drop_partial_line();
+  String buf;
+  while (lines.getline_n_unescape(buf)) {
+    if (buf.empty() || (buf[0] != '+' && buf[0] != '-'))
+      return make_err(bad_file_format, fn);
+    PosibErr<void> pe = replay(buf[0], buf.mstr() + 1);
+    if (pe.has_err()) return pe.with_file(fn);
+  }
+  journal_pos = lines.tell();
+  return complete;
+}
+
+// adds "entry" to the soundslike list of "sl"
+void WritableBase::add_soundslike(ParmString sl, Str entry) const
+{
+  byte * s0 = (byte *)buffer().alloc(sl.size() + 2);
+  *s0++ = sl.size();
+  memcpy(s0, sl.str(), sl.size() + 1);
+  (*soundslike_lookup_)[(char *)s0].push_back(entry);
+}
+
+// removes one occurrence of "entry" from the soundslike list of "w"
+void WritableBase::remove_soundslike(ParmString w, Str entry)
+{
+  if (!soundslike_lookup_) return;
+  VARARRAY(char, sl, w.size() + 1);
+  if (!invisible_soundslike)
+    lang()->LangImpl::to_soundslike(sl, w.str(), w.size());
+  else
+    *sl = '\0';
+  SoundslikeLookup::iterator i = soundslike_lookup_->find(sl);
+  if (i == soundslike_lookup_->end()) return;
+  StrVector & v = i->second;
+  for (StrVector::iterator j = v.begin(); j != v.end(); ++j) {
+    if (*j == entry) {v.erase(j); break;}
+  }
+  if (v.empty()) soundslike_lookup_->erase(i);
+}
+
 PosibErr<void> WritableBase::set_file_encoding(ParmString enc, Config & c)
 {
   if (enc == file_encoding) return no_err;
@@ -359,6 +849,53 @@ struct CleanElements : public SoundslikeEnumeration {
   }
 };
 
+// BaseSoundslikeElements and BaseElements enumerate the elements of
+// the base of a WritableDict followed by the ones added to it.  The
+// soundslikes from the base are marked with the base in intr[2] so
+// that soundslike_lookup knows where to find their words.
+
+struct BaseSoundslikeElements : public SoundslikeEnumeration {
+
+  StackPtr<SoundslikeEnumeration> base;
+  StackPtr<SoundslikeEnumeration> rest;
+  const Dictionary * tag;
+
+  BaseSoundslikeElements(SoundslikeEnumeration * b, SoundslikeEnumeration * r,
+                         const Dictionary * t) 
+    : base(b), rest(r), tag(t) {}
+
+  WordEntry * next(int stopped_at) {
+    if (base) {
+      WordEntry * w = base->next(stopped_at);
+      if (w) {
+        w->intr[2] = (void *)tag;
+        return w;
+      }
+      base.del();
+    }
+    return rest->next(stopped_at);
+  }
+};
+
+struct BaseElements : public WordEntryEnumeration {
+
+  ClonePtr<WordEntryEnumeration> base;
+  ClonePtr<WordEntryEnumeration> rest;
+
+  BaseElements(WordEntryEnumeration * b, WordEntryEnumeration * r)
+    : base(b), rest(r) {}
+
+  WordEntryEnumeration * clone() const {return new BaseElements(*this);}
+  void assign(const WordEntryEnumeration * other) {
+    *this = *static_cast<const BaseElements *>(other);
+  }
+  WordEntry * next() {
+    WordEntry * w = base->next();
+    return w ? w : rest->next();
+  }
+  bool at_end() const {return base->at_end() && rest->at_end();}
+};
+
 struct ElementsParms {
   typedef WordEntry *                Value;
   typedef WordLookup::const_iterator Iterator;
@@ -380,6 +917,16 @@ class WritableDict : public WritableBase
 public: //but don't use
   PosibErr<void> save(FStream &, ParmString);
   PosibErr<void> merge(FStream &, ParmString, Config * config);
+  PosibErr<void> load_file(FStream &, ParmString, Config &);
+  PosibErr<unsigned> read_header(LineReader &, ParmString, Config * config);
+
+  // Large lists are compiled into "<file>.rws" which, when up to date,
+  // is used as a read-only base with only the words added since then
+  // kept in word_lookup.  The base is never shared, and is deleted
+  // directly since release() would take the lock on the dictionary
+  // cache, which is already held when this dictionary is released.
+  StackPtr<Dictionary> base;
+  PosibErr<void> detach_base();
 
 public:
 
@@ -388,12 +935,38 @@ public:
   Size   size()     const;
   bool   empty()    const;
   
-  PosibErr<void> add(ParmString w) {return Dictionary::add(w);}
+  PosibErr<void> add(ParmString w) {
+    return keep_soundslikes() ? Dictionary::add(w) : add(w, "");}
   PosibErr<void> add(ParmString w, ParmString s);
+  PosibErr<void> remove(ParmString w);
+  PosibErr<void> replay(char op, char * rec);
+  PosibErr<void> clear();
 
-  bool lookup(ParmString word, const SensitiveCompare *, WordEntry &) const;
+  void prefetch(ParmString word, size_t h) const {
+    if (base) base->prefetch(word, h);
+  }
 
-  bool clean_lookup(ParmString sondslike, WordEntry &) const;
+  // look up the word in this dictionary only, not in base
+  bool local_lookup(ParmString, const SensitiveCompare *, WordEntry &) const;
+  bool local_clean_lookup(ParmString, WordEntry &) const;
+
+  bool lookup(ParmString word, const SensitiveCompare * c, 
+              WordEntry & o) const {
+    return local_lookup(word, c, o) || (base && base->lookup(word, c, o));
+  }
+  bool hashed_lookup(ParmString word, size_t h, const SensitiveCompare * c, 
+                     WordEntry & o) const {
+    return local_lookup(word, c, o) 
+      || (base && base->hashed_lookup(word, h, c, o));
+  }
+
+  bool clean_lookup(ParmString sl, WordEntry & o) const {
+    return local_clean_lookup(sl, o) || (base && base->clean_lookup(sl, o));
+  }
+  bool hashed_clean_lookup(ParmString sl, size_t h, WordEntry & o) const {
+    return local_clean_lookup(sl, o) 
+      || (base && base->hashed_clean_lookup(sl, h, o));
+  }
 
   bool soundslike_lookup(const WordEntry & soundslike, WordEntry &) const;
   bool soundslike_lookup(ParmString soundslike, WordEntry &) const;
@@ -401,37 +974,42 @@ public:
   WordEntryEnumeration * detailed_elements() const;
 
   SoundslikeEnumeration * soundslike_elements() const;
+
+  void build_soundslikes() const;
 };
 
 WritableDict::Size WritableDict::size() const 
 {
-  return word_lookup->size();
+  return (have_words() ? word_lookup->size() : 0) + (base ? base->size() : 0);
 }
 
 bool WritableDict::empty() const 
 {
-  return word_lookup->empty();
+  return (!have_words() || word_lookup->empty()) && (!base || base->empty());
 }
 
-bool WritableDict::lookup(ParmString word, const SensitiveCompare * c,
-                          WordEntry & o) const
+bool WritableDict::local_lookup(ParmString word, const SensitiveCompare * c,
+                                WordEntry & o) const
 {
   o.clear();
-  pair<WordLookup::iterator, WordLookup::iterator> p(word_lookup->equal_range(word));
-  while (p.first != p.second) {
-    if ((*c)(word,*p.first)) {
-      o.what = WordEntry::Word;
-      set_word(o, *p.first);
-      return true;
+  if (may_have(word)) {
+    pair<WordLookup::iterator, WordLookup::iterator> p(word_lookup->equal_range(word));
+    while (p.first != p.second) {
+      if ((*c)(word,*p.first)) {
+        o.what = WordEntry::Word;
+        set_word(o, *p.first);
+        return true;
+      }
+      ++p.first;
     }
-    ++p.first;
   }
   return false;
 }
 
-bool WritableDict::clean_lookup(ParmString sl, WordEntry & o) const
+bool WritableDict::local_clean_lookup(ParmString sl, WordEntry & o) const
 {
   o.clear();
+  if (!may_have(sl)) return false;
   pair<WordLookup::iterator, WordLookup::iterator> p(word_lookup->equal_range(sl));
   if (p.first == p.second) return false;
   o.what = WordEntry::Word;
@@ -442,6 +1020,9 @@ bool WritableDict::clean_lookup(ParmString sl, WordEntry & o) const
 
 bool WritableDict::soundslike_lookup(const WordEntry & word, WordEntry & o) const 
 {
+  if (base && word.intr[2] == base.get())
+    return base->soundslike_lookup(word, o);
+
   if (use_soundslike) {
 
     const StrVector * tmp 
@@ -468,9 +1049,11 @@ bool WritableDict::soundslike_lookup(ParmString word, WordEntry & o) const
   if (use_soundslike) {
 
     o.clear();
-    SoundslikeLookup::const_iterator i = soundslike_lookup_.find(word);
-    if (i == soundslike_lookup_.end()) {
-      return false;
+    if (!have_words())
+      return base && base->soundslike_lookup(word, o);
+    SoundslikeLookup::const_iterator i = soundslikes().find(word);
+    if (i == soundslike_lookup_->end()) {
+      return base && base->soundslike_lookup(word, o);
     } else {
       o.what = WordEntry::Word;
       sl_init(&i->second, o);
@@ -485,17 +1068,24 @@ bool WritableDict::soundslike_lookup(ParmString word, WordEntry & o) const
 }
 
 SoundslikeEnumeration * WritableDict::soundslike_elements() const {
+  SoundslikeEnumeration * els;
   if (use_soundslike)
-    return new SoundslikeElements(soundslike_lookup_.begin(), 
-                                  soundslike_lookup_.end());
+    els = new SoundslikeElements(soundslikes().begin(), 
+                                 soundslikes().end());
   else
-    return new CleanElements(word_lookup->begin(),
-                             word_lookup->end());
+    els = new CleanElements(words().begin(),
+                            words().end());
+  if (base)
+    return new BaseSoundslikeElements(base->soundslike_elements(), els, base);
+  return els;
 }
 
 WritableDict::Enum * WritableDict::detailed_elements() const {
-  return new MakeEnumeration<ElementsParms>
-    (word_lookup->begin(),ElementsParms(word_lookup->end()));
+  Enum * els = new MakeEnumeration<ElementsParms>
+    (words().begin(),ElementsParms(words().end()));
+  if (base)
+    return new BaseElements(base->detailed_elements(), els);
+  return els;
 }
 
 PosibErr<void> WritableDict::add(ParmString w, ParmString s) {
@@ -504,24 +1094,93 @@ PosibErr<void> WritableDict::add(ParmString w, ParmString s) {
   WordEntry we;
   if (WritableDict::lookup(w,&c,we)) return no_err;
   byte * w2;
-  w2 = (byte *)buffer.alloc(w.size() + 3);
+  w2 = (byte *)buffer().alloc(w.size() + 3);
   *w2++ = lang()->get_word_info(w);
   *w2++ = w.size();
   memcpy(w2, w.str(), w.size() + 1);
-  word_lookup->insert((char *)w2);
-  if (use_soundslike) {
-    byte * s2;
-    s2 = (byte *)buffer.alloc(s.size() + 2);
-    *s2++ = s.size();
-    memcpy(s2, s.str(), s.size() + 1);
-    soundslike_lookup_[(char *)s2].push_back((char *)w2);
+  insert_word((char *)w2);
+  if (keep_soundslikes())
+    add_soundslike(s, (char *)w2);
+  journal_record('+', w);
+  return no_err;
+}
+
+PosibErr<void> WritableDict::remove(ParmString w) {
+  if (base) {
+    SensitiveCompare c(lang());
+    WordEntry we;
+    if (base->lookup(w, &c, we)) RET_ON_ERR(detach_base());
   }
+  if (!word_lookup) return no_err;
+  pair<WordLookup::iterator, WordLookup::iterator> p(word_lookup->equal_range(w));
+  while (p.first != p.second && strcmp(*p.first, w) != 0)
+    ++p.first;
+  if (p.first == p.second) return no_err;
+  Str w2 = *p.first;
+  word_lookup->erase(p.first);
+  if (use_soundslike)
+    remove_soundslike(w, w2);
+  journal_record('-', w);
   return no_err;
 }
 
-PosibErr<void> WritableDict::merge(FStream & in, 
-                                   ParmString file_name, 
-                                   Config * config)
+PosibErr<void> WritableDict::replay(char op, char * rec) {
+  ConvP conv(iconv);
+  if (op == '+')
+    return add(conv(rec));
+  else
+    return remove(conv(rec));
+}
+
+PosibErr<void> WritableDict::clear() {
+  base.del();
+  return WritableBase::clear();
+}
+
+// moves all the words in the base into word_lookup
+PosibErr<void> WritableDict::detach_base()
+{
+  Loading l(loading);
+  StrList words;
+  {
+    StackPtr<Enum> els(base->detailed_elements());
+    WordEntry * w;
+    while ( (w = els->next()) )
+      words.add(w->word);
+  }
+  base.del();
+  WritableBase::words().resize(WritableBase::words().size() + words.size());
+  bool need_sls = keep_soundslikes() && !invisible_soundslike;
+  StrList sls;
+  if (need_sls)
+    to_soundslikes(lang(), words, sls);
+  for (unsigned i = 0; i != words.size(); ++i)
+    RET_ON_ERR(add(words[i], need_sls ? sls[i] : ""));
+  return no_err;
+}
+
+void WritableDict::build_soundslikes() const
+{
+  if (!use_soundslike || !word_lookup) return;
+  Vector<Str> entries;
+  StrList words, sls;
+  entries.reserve(word_lookup->size());
+  for (WordLookup::const_iterator i = word_lookup->begin(); 
+       i != word_lookup->end(); ++i) {
+    entries.push_back(*i);
+    words.add(*i);
+  }
+  if (!invisible_soundslike)
+    to_soundslikes(lang(), words, sls);
+  soundslike_lookup_->resize(entries.size());
+  for (unsigned i = 0; i != entries.size(); ++i)
+    add_soundslike(invisible_soundslike ? "" : sls[i], entries[i]);
+}
+
+// reads the first line, returns the version of the file
+PosibErr<unsigned> WritableDict::read_header(LineReader & lines,
+                                             ParmString file_name,
+                                             Config * config)
 {
   typedef PosibErr<void> Ret;
   unsigned int ver;
@@ -529,7 +1188,7 @@ PosibErr<void> WritableDict::merge(FStream & in,
   String buf;
   DataPair dp;
 
-  if (!getline(in, dp, buf))
+  if (!lines.getline(dp, buf))
     make_err(bad_file_format, file_name);
 
   split(dp);
@@ -554,14 +1213,46 @@ PosibErr<void> WritableDict::merge(FStream & in,
     set_file_encoding(dp.key, *config);
   else
     set_file_encoding("", *config);
+
+  return ver;
+}
+
+PosibErr<void> WritableDict::merge(FStream & in, 
+                                   ParmString file_name, 
+                                   Config * config)
+{
+  typedef PosibErr<void> Ret;
+
+  LineReader lines;
+  RET_ON_ERR(lines.open(in, file_name));
+
+  RET_ON_ERR_SET(read_header(lines, file_name, config), unsigned, ver);
+
+  String buf;
+  DataPair dp;
   
+  unsigned num = lines.num_lines();
+  words().resize(words().size() + num);
+  if (keep_soundslikes())
+    soundslike_lookup_->resize(soundslike_lookup_->size() + num);
+
+  StrList words;
+  words.pos.reserve(num);
   ConvP conv(iconv);
-  while (getline_n_unescape(in, dp, buf)) {
+  while (lines.getline_n_unescape(dp, buf)) {
     if (ver == 10)
       split(dp);
     else
       dp.key = dp.value;
-    Ret pe = add(conv(dp.key));
+    words.add(conv(dp.key));
+  }
+
+  bool need_sls = keep_soundslikes() && !invisible_soundslike;
+  StrList sls;
+  if (need_sls)
+    to_soundslikes(lang(), words, sls);
+  for (unsigned i = 0; i != words.size(); ++i) {
+    Ret pe = add(words[i], need_sls ? sls[i] : "");
     if (pe.has_err()) {
       clear();
       return pe.with_file(file_name);
@@ -570,15 +1261,101 @@ PosibErr<void> WritableDict::merge(FStream & in,
   return no_err;
 }
 
+// personal word lists smaller than this are always read directly
+static const long PERSONAL_CACHE_MIN_SIZE = 65536;
+
+struct WordsEnumeration : public StringEnumeration {
+  WordLookup::const_iterator i;
+  WordLookup::const_iterator end;
+  WordsEnumeration(WordLookup::const_iterator i0, WordLookup::const_iterator e0)
+    : i(i0), end(e0) {}
+  bool at_end() const {return i == end;}
+  const char * next() {
+    if (i == end) return 0;
+    return *i++;
+  }
+  StringEnumeration * clone() const {return new WordsEnumeration(*this);}
+  void assign(const StringEnumeration * other) {
+    *this = *static_cast<const WordsEnumeration *>(other);
+  }
+};
+
+// identifies the contents of a word list by its size, modification
+// time, and a hash of the contents
+static void get_cache_source(FStream & in, String & res)
+{
+  unsigned int h = 2166136261u;
+  long size = 0;
+  char buf[16384];
+  size_t n;
+  in.seek(0);
+  while ( (n = fread(buf, 1, sizeof(buf), in.c_stream())) > 0 ) {
+    for (size_t i = 0; i != n; ++i) {
+      h ^= (byte)buf[i];
+      h *= 16777619u;
+    }
+    size += n;
+  }
+  in.seek(0);
+  res.clear();
+  res.printf("personal_ws %ld %ld %08x", 
+             size, (long)get_modification_time(in), h);
+}
+
+PosibErr<void> WritableDict::load_file(FStream & in, ParmString f, 
+                                       Config & config)
+{
+  in.seek(0, SEEK_END);
+  long size = in.tell();
+  in.seek(0);
+  if (size < PERSONAL_CACHE_MIN_SIZE || !config.retrieve_bool("personal-cache"))
+    return merge(in, f, &config);
+
+  String source;
+  get_cache_source(in, source);
+  String cache_name = f;
+  cache_name += ".rws";
+
+  if (file_exists(cache_name)) {
+    LineReader lines;
+    RET_ON_ERR(lines.open(in, f));
+    RET_ON_ERR(read_header(lines, f, &config));
+    PosibErr<Dictionary *> pe = load_word_list_cache(cache_name, source, config);
+    if (pe.get_err() == 0) {
+      base.reset(pe.data);
+      return no_err;
+    }
+    in.seek(0);
+  }
+
+  RET_ON_ERR(merge(in, f, &config));
+  // if the cache can not be created the list is simply read again
+  // the next time
+  create_word_list_cache(cache_name, source,
+                         new WordsEnumeration(words().begin(), words().end()),
+                         *lang(), config).ignore_err();
+  return no_err;
+}
+
 PosibErr<void> WritableDict::save(FStream & out, ParmString file_name) 
 {
   out.printf("personal_ws-1.1 %s %i %s\n", 
-             lang_name(), word_lookup->size(), file_encoding.c_str());
+             lang_name(), size(), file_encoding.c_str());
 
-  WordLookup::const_iterator i = word_lookup->begin();
-  WordLookup::const_iterator e = word_lookup->end();
-    
   ConvP conv(oconv);
+
+  if (base) {
+    StackPtr<Enum> els(base->detailed_elements());
+    WordEntry * w;
+    while ( (w = els->next()) ) {
+      write_n_escape(out, conv(w->word));
+      out << '\n';
+    }
+  }
+
+  WordLookup::const_iterator i = words().begin();
+  WordLookup::const_iterator e = words().end();
+    
   for (;i != e; ++i) {
     write_n_escape(out, conv(*i));
     out << '\n';
@@ -623,30 +1400,36 @@ public:
       
   WordEntryEnumeration * detailed_elements() const;
   SoundslikeEnumeration * soundslike_elements() const;
+
+  void build_soundslikes() const;
       
   PosibErr<void> add_repl(ParmString mis, ParmString cor) {
-    return Dictionary::add_repl(mis,cor);}
+    return keep_soundslikes() ? Dictionary::add_repl(mis,cor) 
+                              : add_repl(mis, cor, "");}
   PosibErr<void> add_repl(ParmString mis, ParmString cor, ParmString s);
+  PosibErr<void> remove_repl(ParmString mis, ParmString cor);
 
 private:
+  PosibErr<void> replay(char op, char * rec);
   PosibErr<void> save(FStream &, ParmString );
   PosibErr<void> merge(FStream &, ParmString , Config * config);
 };
 
 WritableReplDict::Size WritableReplDict::size() const 
 {
-  return word_lookup->size();
+  return have_words() ? word_lookup->size() : 0;
 }
 
 bool WritableReplDict::empty() const 
 {
-  return word_lookup->empty();
+  return !have_words() || word_lookup->empty();
 }
     
 bool WritableReplDict::lookup(ParmString word, const SensitiveCompare * c,
                               WordEntry & o) const
 {
   o.clear();
+  if (!may_have(word)) return false;
   pair<WordLookup::iterator, WordLookup::iterator> p(word_lookup->equal_range(word));
   while (p.first != p.second) {
     if ((*c)(word,*p.first)) {
@@ -663,6 +1446,7 @@ bool WritableReplDict::lookup(ParmString word, const SensitiveCompare * c,
 bool WritableReplDict::clean_lookup(ParmString sl, WordEntry & o) const
 {
   o.clear();
+  if (!may_have(sl)) return false;
   pair<WordLookup::iterator, WordLookup::iterator> p(word_lookup->equal_range(sl));
   if (p.first == p.second) return false;
   o.what = WordEntry::Misspelled;
@@ -692,8 +1476,9 @@ bool WritableReplDict::soundslike_lookup(ParmString soundslike, WordEntry & o) c
 {
   if (use_soundslike) {
     o.clear();
-    SoundslikeLookup::const_iterator i = soundslike_lookup_.find(soundslike);
-    if (i == soundslike_lookup_.end()) {
+    if (!have_words()) return false;
+    SoundslikeLookup::const_iterator i = soundslikes().find(soundslike);
+    if (i == soundslike_lookup_->end()) {
       return false;
     } else {
       o.what = WordEntry::Misspelled;
@@ -707,16 +1492,39 @@ bool WritableReplDict::soundslike_lookup(ParmString soundslike, WordEntry & o) c
 
 SoundslikeEnumeration * WritableReplDict::soundslike_elements() const {
   if (use_soundslike)
-    return new SoundslikeElements(soundslike_lookup_.begin(), 
-                                  soundslike_lookup_.end());
+    return new SoundslikeElements(soundslikes().begin(), 
+                                  soundslikes().end());
   else
-    return new CleanElements(word_lookup->begin(),
-                             word_lookup->end());
+    return new CleanElements(words().begin(),
+                             words().end());
+}
+
+// every replacement has an entry for its misspelling in the
+// soundslike list
+void WritableReplDict::build_soundslikes() const
+{
+  if (!use_soundslike || !word_lookup) return;
+  Vector<Str> entries;
+  StrList miss, sls;
+  entries.reserve(word_lookup->size());
+  for (WordLookup::const_iterator i = word_lookup->begin(); 
+       i != word_lookup->end(); ++i) {
+    entries.push_back(*i);
+    miss.add(*i);
+  }
+  if (!invisible_soundslike)
+    to_soundslikes(lang(), miss, sls);
+  soundslike_lookup_->resize(entries.size());
+  for (unsigned i = 0; i != entries.size(); ++i) {
+    unsigned num = get_vector(entries[i])->size();
+    for (unsigned j = 0; j != num; ++j)
+      add_soundslike(invisible_soundslike ? "" : sls[i], entries[i]);
+  }
 }
 
 WritableReplDict::Enum * WritableReplDict::detailed_elements() const {
   return new MakeEnumeration<ElementsParms>
-    (word_lookup->begin(),ElementsParms(word_lookup->end()));
+    (words().begin(),ElementsParms(words().end()));
 }
 
 static void repl_next(WordEntry * w)
@@ -774,20 +1582,20 @@ PosibErr<void> WritableReplDict::add_repl(ParmString mis, ParmString cor, ParmSt
   SensitiveCompare cmp(lang()); // FIXME: I don't think this is completely correct
   WordEntry we;
 
-  pair<WordLookup::iterator, WordLookup::iterator> p0(word_lookup->equal_range(mis));
+  pair<WordLookup::iterator, WordLookup::iterator> p0(words().equal_range(mis));
   WordLookup::iterator p = p0.first;
 
   for (; p != p0.second && !cmp(mis,*p); ++p);
 
   if (p == p0.second) {
-    byte * m0  = (byte *)buffer.alloc(sizeof(StrVector) + mis.size() + 3, sizeof(void *));
+    byte * m0  = (byte *)buffer().alloc(sizeof(StrVector) + mis.size() + 3, sizeof(void *));
     new (m0) StrVector;
     m0 += sizeof(StrVector);
     *m0++ = lang()->get_word_info(mis);
     *m0++ = mis.size();
     memcpy(m0, mis.str(), mis.size() + 1);
     m = (char *)m0;
-    p = word_lookup->insert(m).first;
+    p = insert_word(m);
   } else {
     m = *p;
   }
@@ -797,28 +1605,66 @@ PosibErr<void> WritableReplDict::add_repl(ParmString mis, ParmString cor, ParmSt
   for (StrVector::iterator i = v->begin(); i != v->end(); ++i)
     if (cmp(cor, *i)) return no_err;
     
-  byte * c0 = (byte *)buffer.alloc(cor.size() + 3);
+  byte * c0 = (byte *)buffer().alloc(cor.size() + 3);
   *c0++ = lang()->get_word_info(cor);
   *c0++ = cor.size();
   memcpy(c0, cor.str(), cor.size() + 1);
   v->push_back((char *)c0);
 
-  if (use_soundslike) {
-    byte * s0 = (byte *)buffer.alloc(sl.size() + 2);
-    *s0++ = sl.size();
-    memcpy(s0, sl.str(), sl.size() + 1);
-    soundslike_lookup_[(char *)s0].push_back(m);
+  if (keep_soundslikes())
+    add_soundslike(sl, m);
+
+  journal_record('+', mis, cor);
+  return no_err;
+}
+
+PosibErr<void> WritableReplDict::remove_repl(ParmString mis, ParmString cor) 
+{
+  if (!word_lookup) return no_err;
+  pair<WordLookup::iterator, WordLookup::iterator> p(word_lookup->equal_range(mis));
+  while (p.first != p.second && strcmp(*p.first, mis) != 0)
+    ++p.first;
+  if (p.first == p.second) return no_err;
+  Str m = *p.first;
+
+  StrVector * v = get_vector(m);
+  StrVector::iterator i = v->begin();
+  while (i != v->end() && strcmp(*i, cor) != 0)
+    ++i;
+  if (i == v->end()) return no_err;
+  v->erase(i);
+
+  // every replacement added an entry to the soundslike list
+  if (use_soundslike)
+    remove_soundslike(mis, m);
+  if (v->empty()) {
+    v->~StrVector();
+    word_lookup->erase(p.first);
   }
 
+  journal_record('-', mis, cor);
   return no_err;
 }
 
+PosibErr<void> WritableReplDict::replay(char op, char * rec) 
+{
+  char * cor = strchr(rec, ' ');
+  if (!cor) return no_err; // bad record, ignore
+  *cor++ = '\0';
+  ConvP conv1(iconv);
+  ConvP conv2(iconv);
+  if (op == '+')
+    return add_repl(conv1(rec), conv2(cor));
+  else
+    return remove_repl(conv1(rec), conv2(cor));
+}
+
 PosibErr<void> WritableReplDict::save (FStream & out, ParmString file_name) 
 {
   out.printf("personal_repl-1.1 %s 0 %s\n", lang_name(), file_encoding.c_str());
   
-  WordLookup::iterator i = word_lookup->begin();
-  WordLookup::iterator e = word_lookup->end();
+  WordLookup::iterator i = words().begin();
+  WordLookup::iterator e = words().end();
 
   ConvP conv1(oconv);
   ConvP conv2(oconv);
@@ -845,10 +1691,13 @@ PosibErr<void> WritableReplDict::merge(FStream & in,
   unsigned int version;
   unsigned int num_words, num_repls;
 
+  LineReader lines;
+  RET_ON_ERR(lines.open(in, file_name));
+
   String buf;
   DataPair dp;
 
-  if (!getline(in, dp, buf))
+  if (!lines.getline(dp, buf))
     make_err(bad_file_format, file_name);
 
   split(dp);
@@ -882,22 +1731,37 @@ PosibErr<void> WritableReplDict::merge(FStream & in,
 
   if (version == 11) {
 
+    unsigned num = lines.num_lines();
+    words().resize(words().size() + num);
+    if (keep_soundslikes())
+      soundslike_lookup_->resize(soundslike_lookup_->size() + num);
+
+    StrList miss, repls;
+    miss.pos.reserve(num);
+    repls.pos.reserve(num);
     ConvP conv1(iconv);
     ConvP conv2(iconv);
-    for (;;) {
-      bool res = getline_n_unescape(in, buf, '\n');
-      if (!res) break;
+    while (lines.getline_n_unescape(buf)) {
       char * mis = buf.mstr();
       char * repl = strchr(mis, ' ');
       if (!repl) continue; // bad line, ignore
       *repl = '\0'; // split string
       ++repl;
       if (!repl[0]) continue; // empty repl, ignore
-      WritableReplDict::add_repl(conv1(mis), conv2(repl));
+      miss.add(conv1(mis));
+      repls.add(conv2(repl));
     }
+
+    bool need_sls = keep_soundslikes() && !invisible_soundslike;
+    StrList sls;
+    if (need_sls)
+      to_soundslikes(lang(), miss, sls);
+    for (unsigned i = 0; i != miss.size(); ++i)
+      WritableReplDict::add_repl(miss[i], repls[i], need_sls ? sls[i] : "");
     
   } else {
     
+    in.seek(lines.tell());
     String mis, sound, repl;
     unsigned int h,i,j;
     for (h=0; h != num_soundslikes; ++h) {
@@ -918,6 +1782,7 @@ PosibErr<void> WritableReplDict::merge(FStream & in,
 
 WritableReplDict::~WritableReplDict()
 {
+  if (!word_lookup) return;
   WordLookup::iterator i = word_lookup->begin();
   WordLookup::iterator e = word_lookup->end();
   
@@ -35,6 +35,23 @@
 # include <fcntl.h>
 #endif
 
+#ifndef WIN32
+# include <errno.h>
+# include <signal.h>
+# include <unistd.h>
+# include <poll.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+#endif
+
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
+
+#ifdef USE_POSIX_MUTEX
+# include <pthread.h>
+#endif
+
 #include "asc_ctype.hpp"
 #include "check_funs.hpp"
 #include "config.hpp"
@@ -44,8 +61,10 @@
 #include "errors.hpp"
 #include "file_util.hpp"
 #include "fstream.hpp"
+#include "getdata.hpp"
 #include "info.hpp"
 #include "iostream.hpp"
+#include "lock.hpp"
 #include "posib_err.hpp"
 #include "speller.hpp"
 #include "stack_ptr.hpp"
@@ -78,6 +97,7 @@ void convt();
 void normlz();
 void filter();
 void list();
+void serve();
 void dicts();
 void modes();
 void filters();
@@ -92,6 +112,8 @@ void expand();
 void combine();
 void munch_list();
 void dump_affix();
+void compile_lang();
+void build_index();
 
 void print_error(ParmString msg)
 {
@@ -172,6 +194,7 @@ const PossibleOption possible_options[] = {
   COMMAND("check",     'c',  0),
   COMMAND("pipe",      'a',  0),
   COMMAND("list",      '\0', 0),
+  COMMAND("serve",     '\0', 0),
   COMMAND("conv",      '\0', 2),
   COMMAND("norm",      '\0', 1),
   COMMAND("filter",    '\0', 0),
@@ -183,6 +206,8 @@ const PossibleOption possible_options[] = {
   COMMAND("clean",     '\0', 0),
   COMMAND("filters",   '\0', 0),
   COMMAND("modes",     '\0', 0),
+  COMMAND("compile-lang",'\0', 0),
+  COMMAND("build-index", '\0', 0),
 
   COMMAND("dump",   '\0', 1),
   COMMAND("create", '\0', 1),
@@ -248,6 +273,14 @@ static void line_buffer() {
 #endif
 }
 
+static void block_buffer() {
+#ifndef WIN32
+  // set up stdout to be fully buffered, it is then up to the caller
+  // to flush it at the appropriate times
+  assert(setvbuf(stdout, 0, _IOFBF, 1<<16) == 0);
+#endif
+}
+
 Conv dconv;
 Conv uiconv;
 
@@ -417,6 +450,8 @@ int main (int argc, const char *argv[])
     pipe();
   else if (action_str == "list")
     list();
+  else if (action_str == "serve")
+    serve();
   else if (action_str == "conv")
     convt();
   else if (action_str == "norm")
@@ -439,6 +474,10 @@ int main (int argc, const char *argv[])
     filters();
   else if (action_str == "modes")
     modes();
+  else if (action_str == "compile-lang")
+    compile_lang();
+  else if (action_str == "build-index")
+    build_index();
   else if (action_str == "dump")
     action = do_dump;
   else if (action_str == "create")
@@ -645,7 +684,7 @@ bool get_word_pair(char * line, char * & w1, char * & w2)
   return true;
 }
 
-void print_elements(const AspellWordList * wl) {
+void print_elements(OStream & out, const AspellWordList * wl) {
   AspellStringEnumeration * els = aspell_word_list_elements(wl);
   int count = 0;
   const char * w;
@@ -655,8 +694,10 @@ void print_elements(const AspellWordList * wl) {
     line += w;
     line += ", ";
   }
-  line.resize(line.size() - 2);
-  COUT.printf("%u: %s\n", count, line.c_str());
+  if (count > 0)
+    line.resize(line.size() - 2);
+  delete_aspell_string_enumeration(els);
+  out.printf("%u: %s\n", count, line.c_str());
 }
 
 struct StatusFunInf 
@@ -664,7 +705,8 @@ struct StatusFunInf
   aspeller::SpellerImpl * real_speller;
   Conv oconv;
   bool verbose;
-  StatusFunInf(Convert * c) : oconv(c) {}
+  OStream * out;
+  StatusFunInf(Convert * c) : oconv(c), out(&COUT) {}
 };
 
 void status_fun(void * d, Token, int correct)
@@ -673,11 +715,11 @@ void status_fun(void * d, Token, int correct)
   if (p->verbose && correct) {
     const CheckInfo * ci = p->real_speller->check_info();
     if (ci->compound)
-      COUT.put("-\n");
+      p->out->put("-\n");
     else if (ci->pre_flag || ci->suf_flag)
-      COUT.printf("+ %s\n", p->oconv(ci->word.str()));
+      p->out->printf("+ %s\n", p->oconv(ci->word.str()));
     else
-      COUT.put("*\n");
+      p->out->put("*\n");
   }
 }
 
@@ -695,15 +737,107 @@ DocumentChecker * new_checker(AspellSpeller * speller,
     print_error(aspell_speller_error_message(speller)); break;\
   } } while (false)
 
+//
+// BatchInput reads the requests for the batch protocol in large blocks
+// rather than one character at a time.  It also knows when no more
+// input is immediately available so that the replies only need to be
+// flushed then.
+//
+
+class BatchInput {
+  CharVector buf_;
+  size_t begin_;
+  size_t end_;
+  bool eof_;
+  bool fill();
+public:
+  BatchInput() : begin_(0), end_(0), eof_(false) {buf_.resize(1<<16);}
+  bool getline(CharVector & line);
+  bool idle();
+};
+
+bool BatchInput::fill()
+{
+  if (eof_) return false;
+  if (begin_ > 0) {
+    memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+  }
+  if (end_ == buf_.size())
+    buf_.resize(buf_.size() * 2);
+#ifndef WIN32
+  ssize_t res;
+  do {
+    res = read(0, buf_.data() + end_, buf_.size() - end_);
+  } while (res < 0 && errno == EINTR);
+#else
+  size_t res = fread(buf_.data() + end_, 1, buf_.size() - end_, stdin);
+#endif
+  if (res <= 0) {eof_ = true; return false;}
+  end_ += res;
+  return true;
+}
+
+bool BatchInput::getline(CharVector & line)
+{
+  size_t searched = 0; // relative to begin_ as fill() may move the data
+  for (;;) {
+    const char * nl = static_cast<const char *>
+      (memchr(buf_.data() + begin_ + searched, '\n', 
+              end_ - begin_ - searched));
+    if (nl) {
+      size_t stop = nl - buf_.data();
+      line.append(buf_.data() + begin_, stop - begin_);
+      begin_ = stop + 1;
+      return true;
+    }
+    searched = end_ - begin_;
+    if (!fill()) break;
+  }
+  if (begin_ == end_) return false;
+  line.append(buf_.data() + begin_, end_ - begin_);
+  begin_ = end_;
+  return true;
+}
+
+bool BatchInput::idle()
+{
+  if (memchr(buf_.data() + begin_, '\n', end_ - begin_)) return false;
+  if (eof_) return true;
+#ifndef WIN32
+  pollfd pfd;
+  pfd.fd = 0;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return poll(&pfd, 1, 0) <= 0;
+#else
+  return true;
+#endif
+}
+
 void pipe() 
 {
-  line_buffer();
+  String protocol = options->retrieve("pipe-protocol");
+  bool batch = false;
+  if (protocol == "batch") {
+    batch = true;
+  } else if (protocol != "ispell") {
+    print_error(_("Unknown pipe protocol: \"%s\""), protocol);
+    exit(1);
+  }
+
+  if (batch)
+    block_buffer();
+  else
+    line_buffer();
 
   bool terse_mode = true;
   bool do_time = options->retrieve_bool("time");
   bool suggest = options->retrieve_bool("suggest");
   bool include_guesses = options->retrieve_bool("guess");
   clock_t start,finish;
+  clock_t check_time = 0;
 
   if (!options->have("mode") && !options->have("filter")) {
     PosibErrBase err(options->replace("mode", "nroff"));
@@ -731,8 +865,14 @@ void pipe()
   if (do_time)
     COUT << _("Time to load word list: ")
          << (clock() - start)/(double)CLOCKS_PER_SEC << "\n";
+  // in batch mode the reply for each request is collected in "reply"
+  // so that it can be written out with its size
+  String reply;
+  OStream & out = batch ? static_cast<OStream &>(reply) : COUT;
+  BatchInput input;
   StatusFunInf status_fun_inf(setup_conv(&real_speller->lang(), config));
   status_fun_inf.real_speller = real_speller;
+  status_fun_inf.out = &out;
   bool & print_star = status_fun_inf.verbose;
   print_star = true;
   StackPtr<DocumentChecker> checker(new_checker(speller, status_fun_inf));
@@ -743,6 +883,7 @@ void pipe()
   char * line0;
   char * word;
   char * word2;
+  char * id = 0;
   int    ignore;
   PosibErrBase err;
 
@@ -750,17 +891,38 @@ void pipe()
 
   for (;;) {
     buf.clear();
-    fflush(stdout);
-    while (c = getchar(), c != '\n' && c != EOF)
-      buf.push_back(static_cast<char>(c));
+    if (batch) {
+      if (input.idle()) fflush(stdout);
+      c = input.getline(buf) ? '\n' : EOF;
+      if (buf.empty()) {
+        if (c != EOF) continue;
+        else          break;
+      }
+      // split off the request id, a request without any data still
+      // gets an (empty) reply
+      unsigned id_len = 0;
+      while (id_len != buf.size() 
+             && buf[id_len] != ' ' && buf[id_len] != '\t') ++id_len;
+      if (id_len == buf.size()) buf.push_back(' ');
+      buf[id_len] = '\0';
+      reply.clear();
+    } else {
+      fflush(stdout);
+      while (c = getchar(), c != '\n' && c != EOF)
+        buf.push_back(static_cast<char>(c));
+    }
     buf.push_back('\n'); // always add new line so strlen > 0
     buf.push_back('\0');
     line = buf.data();
+    if (batch) {
+      id = line;
+      line += strlen(id) + 1;
+    }
     ignore = 0;
     switch (line[0]) {
     case '\n':
-      if (c != EOF) continue;
-      else          break;
+      if (c != EOF && !batch) continue;
+      else                    break;
     case '*':
       word = trim_wspace(line + 1);
       aspell_speller_add_to_personal(speller, word, -1);
@@ -788,14 +950,12 @@ void pipe()
       if (err.get_err())
 	config->replace("mode", "tex");
       reload_filters(real_speller);
-      checker.del();
-      checker = new_checker(speller, status_fun_inf);
+      checker->reload_filter();
       break;
     case '-':
       config->remove("filter");
       reload_filters(real_speller);
-      checker.del();
-      checker = new_checker(speller, status_fun_inf);
+      checker->reload_filter();
       break;
     case '~':
       break;
@@ -833,22 +993,22 @@ void pipe()
 	  case 'r':
 	    word = trim_wspace(line + 4);
 	    BREAK_ON_ERR_SET(config->retrieve(word), String, ret);
-            COUT.printl(ret);
+            out.printl(ret);
 	    break;
 	  }
 	  break;
 	case 'p':
 	  switch (line[3]) {
 	  case 'p':
-	    print_elements(aspell_speller_personal_word_list(speller));
+	    print_elements(out, aspell_speller_personal_word_list(speller));
 	    break;
 	  case 's':
-	    print_elements(aspell_speller_session_word_list(speller));
+	    print_elements(out, aspell_speller_session_word_list(speller));
 	    break;
 	  }
 	  break;
 	case 'l':
-	  COUT.printl(config->retrieve("lang"));
+	  out.printl(config->retrieve("lang"));
 	  break;
 	}
 	break;
@@ -860,8 +1020,12 @@ void pipe()
     default:
       line0 = line;
       line += ignore;
+      if (do_time) start = clock();
       checker->process(line, strlen(line));
-      while (Token token = checker->next_misspelling()) {
+      for (;;) {
+        Token token = checker->next_misspelling();
+        if (do_time) check_time += clock() - start;
+        if (!token) break;
 	word = line + token.offset;
 	word[token.len] = '\0';
         const char * cword = iconv(word);
@@ -893,7 +1057,7 @@ void pipe()
         unsigned offset = mb_len(line0, token.offset + ignore);
 	if (suggestions && !aspell_word_list_empty(suggestions)) 
         {
-          COUT.printf("& %s %u %u:", word, 
+          out.printf("& %s %u %u:", word, 
                       aspell_word_list_size(suggestions), offset);
 	  AspellStringEnumeration * els 
 	    = aspell_word_list_elements(suggestions);
@@ -904,37 +1068,52 @@ void pipe()
 	      sugs.push_back(w);
 	    Vector<String>::reverse_iterator i = sugs.rbegin();
 	    while (true) {
-              COUT.printf(" %s", i->c_str());
+              out.printf(" %s", i->c_str());
 	      ++i;
 	      if (i == sugs.rend()) break;
-              COUT.put(',');
+              out.put(',');
 	    }
 	  } else {
 	    while ( ( w = aspell_string_enumeration_next(els)) != 0) {
-              COUT.printf(" %s%s", w, 
+              out.printf(" %s%s", w, 
                           aspell_string_enumeration_at_end(els) ? "" : ",");
 	    }
 	  }
 	  delete_aspell_string_enumeration(els);
           if (include_guesses)
-            COUT.put(guesses);
-	  COUT.put('\n');
+            out.put(guesses);
+	  out.put('\n');
 	} else {
           if (guesses.empty())
-            COUT.printf("# %s %u\n", word, offset);
+            out.printf("# %s %u\n", word, offset);
           else
-            COUT.printf("? %s 0 %u: %s\n", word, offset,
+            out.printf("? %s 0 %u: %s\n", word, offset,
                         guesses.c_str() + 2);
 	}
 	if (do_time)
-          COUT.printf(_("Suggestion Time: %f\n"), 
+          out.printf(_("Suggestion Time: %f\n"), 
                       (finish-start)/(double)CLOCKS_PER_SEC);
+        if (do_time) start = clock();
       }
-      COUT.put('\n');
+      out.put('\n');
+    }
+    if (batch) {
+      COUT.printf("%s %lu\n", id, (unsigned long)reply.size());
+      COUT.write(reply.data(), reply.size());
     }
     if (c == EOF) break;
   }
 
+  if (do_time) {
+    COUT << _("Time to check words: ")
+         << check_time/(double)CLOCKS_PER_SEC << "\n";
+    unsigned long lookups = real_speller->check_cache_lookups();
+    if (lookups > 0)
+      COUT.printf(_("Check cache hits: %lu of %lu (%.1f%%)\n"),
+                  real_speller->check_cache_hits(), lookups,
+                  100.0 * real_speller->check_cache_hits() / lookups);
+  }
+
   delete_aspell_speller(speller);
 }
 
@@ -1289,8 +1468,20 @@ void Mapping::to_ispell()
 // list
 //
 
+void list_files();
+bool list_via_daemon(ParmString socket_path);
+
 void list()
 {
+  if (!args.empty()) {
+    list_files();
+    return;
+  }
+
+  String socket_path = options->retrieve("socket");
+  if (!socket_path.empty() && list_via_daemon(socket_path))
+    return;
+
   AspellCanHaveError * ret 
     = new_aspell_speller(reinterpret_cast<AspellConfig *>(options.get()));
   if (aspell_error(ret)) {
@@ -1314,6 +1505,809 @@ void list()
   delete_aspell_speller(speller);
 }
 
+//
+// When files are given on the command line, each file (or chunk of a
+// large file) becomes a ListJob.  The jobs are distributed across
+// "jobs" worker threads, each with its own speller.  As the spellers
+// are created from the same config they share the loaded language
+// and dictionaries via the global cache.  The results are collected
+// in the job and printed by the main thread in order.
+//
+// A chunk other than the first is checked as if the filters were in
+// their initial state.  When its results are printed the state the
+// filters were really in at the end of the previous chunk is known,
+// and if that is different the chunk is checked again, starting from
+// that state.  So files are only split if the filters can save their
+// state.  Files are also not split, and not broken into lines, if the
+// input encoding has code units of more than one byte, as the line
+// ends can then not be found without decoding the text.
+//
+// A file is mapped into memory once, when the first of its chunks is
+// checked, and unmapped when all of them are printed.
+//
+
+static const size_t list_chunk_size = 1 << 20;
+
+struct MappedFile {
+  const char * data;
+  size_t       size;
+  bool         mapped;
+  String       buf;
+  MappedFile() : data(0), size(0), mapped(false) {}
+  PosibErr<void> open(ParmString name, size_t size);
+  ~MappedFile();
+};
+
+struct ListFile {
+  String name;
+  size_t size;
+  bool   too_large; // to be mapped into memory
+  unsigned chunks_left;
+  unsigned count;
+  MappedFile * map; // see list_file_map
+  String err;       // the error opening the file
+  ListFile() : size(0), too_large(false), chunks_left(0), count(0), map(0) {}
+};
+
+struct ListJob {
+  ListFile * file;
+  size_t   begin;
+  size_t   end;
+  bool     done;
+  unsigned count;
+  String   out;
+  String   err;
+  bool     have_end_state;
+  String   end_state; // the state of the filters at the end
+  ListJob() : file(0), begin(0), end(0), done(false), count(0),
+              have_end_state(false) {}
+};
+
+PosibErr<void> MappedFile::open(ParmString name, size_t sz)
+{
+  FStream f;
+  RET_ON_ERR(f.open(name, "rb"));
+  size = sz;
+  if (size == 0) return no_err;
+#ifdef HAVE_MMAP
+  void * p = mmap(NULL, size, PROT_READ, MAP_SHARED, f.file_no(), 0);
+  if (p != MAP_FAILED) {
+    data = static_cast<const char *>(p);
+    mapped = true;
+    return no_err;
+  }
+#endif
+  buf.resize(size);
+  size = fread(buf.data(), 1, size, f.c_stream());
+  data = buf.data();
+  return no_err;
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef HAVE_MMAP
+  if (mapped) munmap(const_cast<char *>(data), size);
+#endif
+}
+
+// Appends "str", which should be ASCII, in code units of "width"
+// bytes, as the misspelled words are printed just as they are in the
+// file, in the input encoding.
+static void list_append(String & out, const char * str, unsigned width)
+{
+  for (; *str; ++str) {
+    if (width == 2) {
+      unsigned short c = static_cast<unsigned char>(*str);
+      out.append(&c, sizeof(c));
+    } else if (width == 4) {
+      unsigned int c = static_cast<unsigned char>(*str);
+      out.append(&c, sizeof(c));
+    } else {
+      out += *str;
+    }
+  }
+}
+
+// "f" is the mapped file or null if it could not be opened, in which
+// case the error is reported with the first chunk only.  If
+// "start_state" is not null the filters are set to that state rather
+// than reset.
+static void list_job(DocumentChecker * checker, bool count_only, 
+                     const char * prefix, ListJob & job,
+                     const MappedFile * f, const String * start_state)
+{
+  job.count = 0;
+  job.out.clear();
+  job.err.clear();
+  job.have_end_state = false;
+  job.end_state.clear();
+  if (!f) {
+    if (job.begin == 0) job.err = job.file->err;
+    return;
+  }
+  const unsigned width = checker->in_width();
+  // a chunk contains all lines that start within [begin, end)
+  const char * begin = f->data + job.begin;
+  const char * end   = f->data + (job.end < f->size ? job.end : f->size);
+  const char * stop  = f->data + f->size;
+  if (job.begin > 0 && begin <= end) {
+    const char * nl = static_cast<const char *>
+      (memchr(begin - 1, '\n', stop - begin + 1));
+    begin = nl ? nl + 1 : stop;
+  }
+  if (end < stop && end > f->data) {
+    const char * nl = static_cast<const char *>
+      (memchr(end - 1, '\n', stop - end + 1));
+    end = nl ? nl + 1 : stop;
+  }
+  checker->reset();
+  if (start_state && checker->filter())
+    checker->filter()->restore_state(*start_state);
+  while (begin < end) {
+    const char * line_end = end;
+    if (width == 1) {
+      const char * nl = static_cast<const char *>
+        (memchr(begin, '\n', end - begin));
+      if (nl) line_end = nl + 1;
+    }
+    checker->process(begin, line_end - begin);
+    while (Token token = checker->next_misspelling()) {
+      ++job.count;
+      if (count_only) continue;
+      list_append(job.out, prefix, width);
+      job.out.append(begin + token.offset * width, token.len * width);
+      list_append(job.out, "\n", width);
+    }
+    begin = line_end;
+  }
+  if (checker->filter())
+    job.have_end_state = checker->filter()->save_state(job.end_state);
+  else
+    job.have_end_state = true;
+}
+
+struct ListState {
+  Vector<ListJob> jobs;
+  String initial_state; // the state of the filters after a reset
+  bool count_only;
+  bool show_names;
+  unsigned next;    // next job to hand out
+  unsigned printed; // number of jobs printed so far
+  unsigned max_ahead;
+  Mutex lock;
+  Cond  cond;
+};
+
+// Maps "file" if this is the first of its chunks to be checked.
+// Returns null if it can not be opened, the error is then in
+// "file.err".
+static const MappedFile * list_file_map(ListState & st, ListFile & file)
+{
+  LOCK(&st.lock);
+  if (!file.map && file.err.empty()) {
+    if (file.too_large) {
+      file.err.printf(_("The file \"%s\" is too large."), file.name.str());
+    } else {
+      MappedFile * m = new MappedFile;
+      PosibErrBase pe = m->open(file.name, file.size);
+      if (pe.has_err()) {
+        file.err = pe.get_err()->mesg;
+        delete m;
+      } else {
+        file.map = m;
+      }
+    }
+  }
+  return file.map;
+}
+
+struct ListWorker {
+  ListState * state;
+  AspellSpeller * speller;
+  DocumentChecker * checker;
+  String prefix;
+  void setup(ListState * st) {
+    AspellCanHaveError * ret 
+      = new_aspell_speller(reinterpret_cast<AspellConfig *>(options.get()));
+    if (aspell_error(ret)) {
+      print_error(aspell_error_message(ret));
+      exit(1);
+    }
+    state = st;
+    speller = to_aspell_speller(ret);
+    EXIT_ON_ERR_SET(new_document_checker(reinterpret_cast<Speller *>(speller)),
+                    DocumentChecker *, c);
+    checker = c;
+  }
+  void run_job(ListJob & job, const String * start_state = 0) {
+    prefix.clear();
+    if (state->show_names) {prefix = job.file->name; prefix += ':';}
+    list_job(checker, state->count_only, prefix.str(), job, 
+             list_file_map(*state, *job.file), start_state);
+  }
+  ListWorker() : state(0), speller(0), checker(0) {}
+  ~ListWorker() {
+    delete checker;
+    if (speller) delete_aspell_speller(speller);
+  }
+};
+
+// the state the filters were in at the end of the previous chunk of
+// the same file if it differs from the state "job" was started in,
+// otherwise null
+static const String * list_job_start_state(ListState & st, unsigned i)
+{
+  if (i == 0 || st.jobs[i-1].file != st.jobs[i].file) return 0;
+  const ListJob & prev = st.jobs[i-1];
+  if (!prev.have_end_state || prev.end_state == st.initial_state) return 0;
+  return &prev.end_state;
+}
+
+#ifdef USE_POSIX_MUTEX
+
+static void * list_worker_thread(void * d)
+{
+  ListWorker * w = static_cast<ListWorker *>(d);
+  ListState * st = w->state;
+  for (;;) {
+    unsigned i;
+    {
+      LOCK(&st->lock);
+      while (st->next < st->jobs.size() 
+             && st->next >= st->printed + st->max_ahead)
+        st->cond.wait(&st->lock);
+      if (st->next == st->jobs.size()) break;
+      i = st->next++;
+    }
+    w->run_job(st->jobs[i]);
+    {
+      LOCK(&st->lock);
+      st->jobs[i].done = true;
+      st->cond.broadcast();
+    }
+  }
+  return 0;
+}
+
+#endif
+
+static void print_list_job(ListState & st, ListJob & job)
+{
+  ListFile * file = job.file;
+  if (!job.err.empty()) {
+    print_error(job.err);
+  } else {
+    COUT.write(job.out.data(), job.out.size());
+  }
+  file->count += job.count;
+  --file->chunks_left;
+  if (file->chunks_left == 0) {
+    if (st.count_only && file->err.empty()) {
+      if (st.show_names) COUT.printf("%s:", file->name.str());
+      COUT.printf("%u\n", file->count);
+    }
+    LOCK(&st.lock);
+    delete file->map;
+    file->map = 0;
+  }
+  job.out.clear();
+}
+
+void list_files()
+{
+  Vector<ListFile> files(args.size());
+  ListState st;
+  st.count_only = options->retrieve_bool("count");
+  st.show_names = args.size() > 1;
+  st.next = 0;
+  st.printed = 0;
+
+  // the first worker is set up before the jobs so that it is known
+  // whether the filters can save their state
+  ListWorker first;
+  first.setup(&st);
+  first.checker->reset();
+  bool may_split = first.checker->in_width() == 1
+    && (!first.checker->filter() 
+        || first.checker->filter()->save_state(st.initial_state));
+
+  for (unsigned i = 0; i != args.size(); ++i) {
+    ListFile & f = files[i];
+    f.name = args[i];
+    struct stat sb;
+    if (stat(f.name.str(), &sb) == 0 && S_ISREG(sb.st_mode)) {
+      f.size = sb.st_size;
+      if (f.size != (unsigned long long)sb.st_size) {
+        f.size = 0;
+        f.too_large = true;
+      }
+    }
+    size_t pos = 0;
+    do {
+      st.jobs.push_back(ListJob());
+      ListJob & job = st.jobs.back();
+      job.file = &f;
+      job.begin = pos;
+      pos = may_split && f.size - pos > list_chunk_size 
+        ? pos + list_chunk_size : f.size;
+      job.end = pos;
+      ++f.chunks_left;
+    } while (pos < f.size);
+  }
+
+  int num_threads = options->retrieve_int("jobs");
+#ifdef USE_POSIX_MUTEX
+  if (num_threads == 0) num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (num_threads < 1) num_threads = 1;
+  if ((unsigned)num_threads > st.jobs.size()) num_threads = st.jobs.size();
+  st.max_ahead = 16 * num_threads;
+
+  Vector<ListWorker *> workers(num_threads);
+  workers[0] = &first;
+  for (int i = 1; i != num_threads; ++i) {
+    workers[i] = new ListWorker;
+    workers[i]->setup(&st);
+  }
+
+#ifdef USE_POSIX_MUTEX
+  if (num_threads > 1) {
+    Vector<pthread_t> threads(num_threads);
+    for (int i = 0; i != num_threads; ++i)
+      pthread_create(&threads[i], 0, list_worker_thread, workers[i]);
+    ListWorker again; // for checking chunks again
+    for (unsigned i = 0; i != st.jobs.size(); ++i) {
+      {
+        LOCK(&st.lock);
+        while (!st.jobs[i].done)
+          st.cond.wait(&st.lock);
+      }
+      if (const String * start_state = list_job_start_state(st, i)) {
+        if (!again.checker) again.setup(&st);
+        again.run_job(st.jobs[i], start_state);
+      }
+      print_list_job(st, st.jobs[i]);
+      {
+        LOCK(&st.lock);
+        st.printed = i + 1;
+        st.cond.broadcast();
+      }
+    }
+    for (int i = 0; i != num_threads; ++i)
+      pthread_join(threads[i], 0);
+  } else
+#endif
+  for (unsigned i = 0; i != st.jobs.size(); ++i) {
+    const String * start_state = 0;
+    if (i > 0 && st.jobs[i-1].file == st.jobs[i].file 
+        && st.jobs[i-1].have_end_state)
+      start_state = &st.jobs[i-1].end_state;
+    first.run_job(st.jobs[i], start_state);
+    print_list_job(st, st.jobs[i]);
+  }
+
+  for (int i = 1; i != num_threads; ++i)
+    delete workers[i];
+}
+
+///////////////////////////
+//
+// serve
+//
+
+//
+// The daemon started with "serve" answers requests over a Unix domain
+// socket so that short lived processes do not have to load the
+// dictionaries themselves.  Each request is a single line of the form
+// "<cmd> <data>" where <cmd> is one of:
+//   o  compare options, <data> is the result of serve_options(), the
+//      reply is "*" if the daemon uses the same options or "#" if not
+//   c  check a word, the reply is "*" if correct or "#" if not
+//   s  suggest, the reply is a single line in the "$$pp" list format
+//   l  list the misspellings in a line of text, one per line, the
+//      reply is terminated by a blank line
+// An invalid request gets the reply "!".  A connection is closed if it
+// sends more than SERVE_MAX_REQUEST bytes without a newline.
+//
+// Idle connections are watched by the main thread, a worker thread of
+// the pool is only used while a connection has requests waiting.  The
+// filter state is kept with the connection between requests so that it
+// carries across the lines of a "list" request stream; if the filters
+// can not save their state they are reset whenever the connection goes
+// idle.
+//
+
+#ifndef WIN32
+
+// The options that affect the results of a request, the client only
+// uses the daemon when they are the same on both sides.
+static String serve_options()
+{
+  String res, buf;
+  StackPtr<KeyInfoEnumeration> els(options->possible_elements(true, true));
+  const KeyInfo * ki;
+  while ((ki = els->next()) != 0) {
+    if (strcmp(ki->name, "socket") == 0 || strcmp(ki->name, "jobs") == 0)
+      continue;
+    PosibErr<String> val = options->retrieve_any(ki->name);
+    if (val.has_err()) {val.ignore_err(); continue;}
+    buf.resize(val.data.size() * 2 + 1);
+    escape(buf.data(), val.data.str(), buf.size(), " ");
+    if (!res.empty()) res += ' ';
+    res += ki->name;
+    res += '=';
+    res += buf.data();
+  }
+  return res;
+}
+
+static int connect_to_daemon(ParmString path)
+{
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  if (path.size() >= sizeof(addr.sun_path)) return -1;
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.str(), path.size() + 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool list_via_daemon(ParmString socket_path)
+{
+  int fd = connect_to_daemon(socket_path);
+  if (fd < 0) return false;
+  signal(SIGPIPE, SIG_IGN);
+  FILE * in_f = fdopen(fd, "r");
+  if (!in_f) {
+    close(fd);
+    return false;
+  }
+  FStream in(in_f);
+  int out_fd = dup(fd);
+  FILE * out_f = out_fd >= 0 ? fdopen(out_fd, "w") : 0;
+  if (!out_f) {
+    if (out_fd >= 0) close(out_fd);
+    return false;
+  }
+  FStream out(out_f);
+  String line, reply;
+  out.put("o ");
+  out.printl(serve_options());
+  out.flush();
+  if (!in.getline(reply) || reply != "*")
+    return false;
+  while (CIN.getline(line)) {
+    out.put("l ");
+    out.printl(line);
+    out.flush();
+    for (;;) {
+      if (!in.getline(reply)) {
+        print_error(_("Lost connection to the spelling daemon."));
+        exit(1);
+      }
+      if (reply.empty()) break;
+      COUT.printl(reply);
+    }
+  }
+  return true;
+}
+
+struct ServeWorker {
+  AspellSpeller * speller;
+  DocumentChecker * checker;
+};
+
+struct ServeConn {
+  int fd;
+  String in;      // input not yet answered
+  String state;   // filter state between requests
+  bool have_state;
+};
+
+static String daemon_options;
+
+static const size_t SERVE_MAX_REQUEST = 1 << 20;
+
+static bool write_all(int fd, const char * str, size_t size)
+{
+  while (size > 0) {
+    ssize_t n = write(fd, str, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    str += n;
+    size -= n;
+  }
+  return true;
+}
+
+// Answer the request in line, which includes the trailing newline.
+static void serve_request(ServeWorker & w, char * line, size_t size,
+                          String & out)
+{
+  if (size < 3 || line[1] != ' ') {
+    out.printl("!");
+    return;
+  }
+  char * data = line + 2;
+  if (line[0] == 'l') {
+    w.checker->process(data, size - 2);
+    while (Token token = w.checker->next_misspelling()) {
+      out.write(data + token.offset, token.len);
+      out.put('\n');
+    }
+    out.put('\n');
+    return;
+  }
+  line[size - 1] = '\0';
+  switch (line[0]) {
+  case 'o':
+    out.printl(daemon_options == data ? "*" : "#");
+    break;
+  case 'c': {
+    int res = aspell_speller_check(w.speller, data, -1);
+    out.printl(res == 1 ? "*" : res == 0 ? "#" : "!");
+    break;
+  } case 's': {
+    const AspellWordList * sugs 
+      = aspell_speller_suggest(w.speller, data, -1);
+    if (sugs) print_elements(out, sugs);
+    else      out.printl("!");
+    break;
+  } default:
+    out.printl("!");
+  }
+}
+
+// Read what is available on the connection and answer every complete
+// request.  Returns false once the connection should be closed.
+static bool serve_connection(ServeWorker & w, ServeConn & c)
+{
+  char buf[4096];
+  ssize_t n = read(c.fd, buf, sizeof(buf));
+  if (n < 0) return errno == EINTR || errno == EAGAIN;
+  if (n == 0) return false;
+  c.in.append(buf, n);
+
+  Filter * filter = w.checker->filter();
+  w.checker->reset();
+  if (c.have_state) filter->restore_state(c.state);
+  String out;
+  size_t begin = 0;
+  for (;;) {
+    char * line = c.in.data() + begin;
+    char * nl = static_cast<char *>(memchr(line, '\n', c.in.size() - begin));
+    if (!nl) break;
+    serve_request(w, line, nl - line + 1, out);
+    begin = nl - c.in.data() + 1;
+  }
+  c.in.erase(0, begin);
+  c.state.clear();
+  c.have_state = filter && filter->save_state(c.state);
+  if (!write_all(c.fd, out.str(), out.size())) return false;
+  return c.in.size() <= SERVE_MAX_REQUEST;
+}
+
+static void close_connection(ServeConn * c)
+{
+  close(c->fd);
+  delete c;
+}
+
+#ifdef USE_POSIX_MUTEX
+
+struct ServeQueue {
+  Mutex lock;
+  Cond  cond;
+  Vector<ServeConn *> ready; // connections with requests waiting
+  Vector<ServeConn *> idle;  // connections to watch again
+  int wake;                  // written to after adding to idle
+};
+
+struct ServeThread {
+  ServeWorker * worker;
+  ServeQueue  * queue;
+};
+
+static void * serve_thread(void * d)
+{
+  ServeThread * t = static_cast<ServeThread *>(d);
+  ServeQueue * q = t->queue;
+  for (;;) {
+    ServeConn * c;
+    {
+      LOCK(&q->lock);
+      while (q->ready.empty())
+        q->cond.wait(&q->lock);
+      c = q->ready.front();
+      q->ready.erase(q->ready.begin());
+    }
+    if (!serve_connection(*t->worker, *c)) {
+      close_connection(c);
+      continue;
+    }
+    {
+      LOCK(&q->lock);
+      q->idle.push_back(c);
+    }
+    write_all(q->wake, "", 1);
+  }
+  return 0;
+}
+
+#endif
+
+void serve()
+{
+  String path = options->retrieve("socket");
+  if (path.empty()) {
+    print_error(_("You must specify a socket with \"--socket\"."));
+    exit(1);
+  }
+
+  // only remove a socket left behind by a daemon which is no longer
+  // running
+  struct stat st;
+  if (lstat(path.str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      print_error(_("The file \"%s\" exists and is not a socket."), path);
+      exit(1);
+    }
+    int fd = connect_to_daemon(path);
+    if (fd >= 0) {
+      close(fd);
+      print_error(_("Another daemon is already listening on the socket \"%s\"."), path);
+      exit(1);
+    }
+    unlink(path.str());
+  }
+
+  int num_threads = options->retrieve_int("jobs");
+  if (num_threads == 0) num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (num_threads < 1) num_threads = 1;
+#ifndef USE_POSIX_MUTEX
+  num_threads = 1;
+#endif
+
+  Vector<ServeWorker> workers(num_threads);
+  for (int i = 0; i != num_threads; ++i) {
+    AspellCanHaveError * ret 
+      = new_aspell_speller(reinterpret_cast<AspellConfig *>(options.get()));
+    if (aspell_error(ret)) {
+      print_error(aspell_error_message(ret));
+      exit(1);
+    }
+    workers[i].speller = to_aspell_speller(ret);
+    EXIT_ON_ERR_SET(new_document_checker(reinterpret_cast<Speller *>(workers[i].speller)),
+                    DocumentChecker *, checker);
+    workers[i].checker = checker;
+  }
+  daemon_options = serve_options();
+
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  if (path.size() >= sizeof(addr.sun_path)) {
+    print_error(_("The socket path \"%s\" is too long."), path);
+    exit(1);
+  }
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.str(), path.size() + 1);
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 
+      || bind(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0
+      || listen(sock, 64) != 0) {
+    print_error(_("Unable to listen on the socket \"%s\"."), path);
+    exit(1);
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  int wake[2] = {-1, -1};
+#ifdef USE_POSIX_MUTEX
+  ServeQueue queue;
+  Vector<ServeThread> thread_info(num_threads);
+  if (num_threads > 1) {
+    if (pipe(wake) != 0) {
+      print_error(_("Unable to listen on the socket \"%s\"."), path);
+      exit(1);
+    }
+    fcntl(wake[0], F_SETFL, O_NONBLOCK);
+    queue.wake = wake[1];
+    for (int i = 0; i != num_threads; ++i) {
+      thread_info[i].worker = &workers[i];
+      thread_info[i].queue  = &queue;
+      pthread_t thread;
+      pthread_create(&thread, 0, serve_thread, &thread_info[i]);
+      pthread_detach(thread);
+    }
+  }
+#endif
+
+  Vector<ServeConn *> conns; // idle connections
+  Vector<pollfd> fds;
+  for (;;) {
+#ifdef USE_POSIX_MUTEX
+    if (num_threads > 1) {
+      LOCK(&queue.lock);
+      conns.insert(conns.end(), queue.idle.begin(), queue.idle.end());
+      queue.idle.clear();
+    }
+#endif
+    fds.resize(conns.size() + 2);
+    fds[0].fd = sock;
+    fds[1].fd = wake[0];
+    for (size_t i = 0; i != conns.size(); ++i)
+      fds[i + 2].fd = conns[i]->fd;
+    for (size_t i = 0; i != fds.size(); ++i) {
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+
+    if (fds[1].revents) {
+      char buf[64];
+      while (read(wake[0], buf, sizeof(buf)) > 0);
+    }
+
+    size_t j = 0;
+    for (size_t i = 0; i != conns.size(); ++i) {
+      ServeConn * c = conns[i];
+      if (fds[i + 2].revents == 0) {
+        conns[j++] = c;
+        continue;
+      }
+#ifdef USE_POSIX_MUTEX
+      if (num_threads > 1) {
+        LOCK(&queue.lock);
+        queue.ready.push_back(c);
+        queue.cond.broadcast();
+        continue;
+      }
+#endif
+      if (serve_connection(workers[0], *c)) conns[j++] = c;
+      else                                  close_connection(c);
+    }
+    conns.resize(j);
+
+    if (fds[0].revents) {
+      int fd = accept(sock, 0, 0);
+      if (fd < 0) {
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+        break;
+      }
+      ServeConn * c = new ServeConn;
+      c->fd = fd;
+      c->have_state = false;
+      conns.push_back(c);
+    }
+  }
+  close(sock);
+  unlink(path.str());
+}
+
+#else
+
+bool list_via_daemon(ParmString)
+{
+  return false;
+}
+
+void serve()
+{
+  print_error(_("The \"serve\" command is not supported on this platform."));
+  exit(1);
+}
+
+#endif
+
 ///////////////////////////
 //
 // convt
@@ -1665,6 +2659,7 @@ void soundslike() {
   PosibErr<Language *> res = new_language(*options);
   if (res.has_err()) {print_error(res.get_err()->mesg); exit(1);}
   lang.reset(res.data);
+  EXIT_ON_ERR(lang->setup_suggest());
   Conv iconv(setup_conv(options, lang));
   Conv oconv(setup_conv(lang, options));
   String word;
@@ -2759,6 +3754,29 @@ void dump_affix()
 
 
 
+//////////////////////////
+//
+// compile-lang
+//
+
+void compile_lang()
+{
+  using namespace aspeller;
+  find_language(*options);
+  EXIT_ON_ERR(compile_language(*options));
+}
+
+//////////////////////////
+//
+// build-index
+//
+
+void build_index()
+{
+  EXIT_ON_ERR(write_dict_index(options));
+  EXIT_ON_ERR(write_mode_index(options));
+}
+
 ///////////////////////////////////////////////////////////////////////
 
 
@@ -2824,13 +3842,17 @@ static const char * help_text[] =
   usage_text[3],
   usage_text[4],
   usage_text[5],
-  N_("  list             produce a list of misspelled words from standard input"),
+  N_("  list [<file>...]  produce a list of misspelled words from standard input"),
+  N_("    or the given files"),
+  N_("  serve            answer requests from other processes over --socket"),
   usage_text[6],
   usage_text[7],
   N_("  soundslike       returns the sounds like equivalent for each word entered"),
   N_("  munch            generate possible root words and affixes"),
   N_("  expand [1-4]     expands affix flags"),
   N_("  clean [strict]   cleans a word list so that every line is a valid word"),
+  N_("  compile-lang     precompiles the language data for faster loading"),
+  N_("  build-index      writes an index of the dictionaries and filter modes"),
   //N_("  filter           passes standard input through filters"),
   N_("  -v|version       prints a version line"),
   N_("  munch-list [simple] [single|multi] [keep]"),
@@ -34,6 +34,59 @@ else
     exit 1
 fi
 
+LONG=`awk 'BEGIN {while (i++ < 2000) printf "x"; print "ing"}'`
+if echo "$LONG" | aspell -d en_US -a --dont-suggest | egrep '^[#?] ' > /dev/null; then
+    echo "pass"
+else
+    echo "fail"
+    exit 1
+fi
+
+(cd "$OBJDIR/examples" && make clone-bench)
+printf 'personal_ws-1.1 en 0\nxyzzyq\n' > personal.pws
+if echo 'xyzzyq' | aspell -d en_US -p "`pwd`/personal.pws" -a | fgrep '*' &&
+   ASPELL_CONF="personal `pwd`/personal.pws" \
+     "$OBJDIR/examples/clone-bench" en_US 10 xyzzyq color
+then
+    echo "pass"
+else
+    echo "fail"
+    exit 1
+fi
+
+(cd "$OBJDIR/examples" && make check-bench)
+cat > batch-words <<EOF
+color
+Color
+COLOR
+cOLOR
+colour
+colors
+Colors
+coloring
+discolored
+COLORFUL
+colorcolor
+Colorcolor
+colorhouse
+housecolor
+a
+I
+x
+Q
+xyzzyq
+EOF
+for conf in "" "run-together true" "run-together true; check-cache 16"; do
+    if ASPELL_CONF="$conf" CHECK_BENCH_BATCH=4 \
+         "$OBJDIR/examples/check-bench" en_US batch-words 1
+    then
+        echo "pass"
+    else
+        echo "fail"
+        exit 1
+    fi
+done
+
 aspell -d en_US dump master | aspell -d en_US list > incorrect
 if [ -e incorrect -a ! -s incorrect ]; then
     echo "pass"